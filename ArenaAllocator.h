@@ -0,0 +1,104 @@
+#pragma once
+#include <google/protobuf/arena.h>
+#include <grpcpp/support/message_allocator.h>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace common {
+
+// Protobuf arena whose first block lives inside the object.
+//
+// Messages that fit in the block cost no malloc at all, and reset() keeps the
+// block for the next use. Larger messages spill into heap blocks that reset()
+// releases. Embed it in a reactor to give each call its own arena for its whole
+// lifecycle, or put it on the stack for a short-lived message.
+template <size_t kBlockSize>
+class InlineArena {
+public:
+    InlineArena() : arena_(block_, sizeof(block_)) {}
+
+    InlineArena(const InlineArena&) = delete;
+    InlineArena& operator=(const InlineArena&) = delete;
+
+    template <typename Message>
+    Message* create() {
+        return google::protobuf::Arena::CreateMessage<Message>(&arena_);
+    }
+
+    // Destroys every message created so far
+    void reset() { arena_.Reset(); }
+
+    google::protobuf::Arena* get() { return &arena_; }
+
+private:
+    alignas(std::max_align_t) char block_[kBlockSize];
+    google::protobuf::Arena arena_; // Declared after block_, which it borrows
+};
+
+// gRPC message allocator for unary callback methods: the request and response
+// of each call are created on one arena, and the arena goes back to a pool when
+// the call is done. A steady stream of calls therefore reuses the same few
+// arenas instead of allocating every nested message and string separately.
+//
+// Register with the generated SetMessageAllocatorFor_<Method>(); it must
+// outlive the server.
+template <typename Request, typename Response, size_t kBlockSize = 4096>
+class ArenaMessageAllocator : public grpc::MessageAllocator<Request, Response> {
+public:
+    explicit ArenaMessageAllocator(size_t max_pooled = 128) : max_pooled_(max_pooled) {}
+
+    ArenaMessageAllocator(const ArenaMessageAllocator&) = delete;
+    ArenaMessageAllocator& operator=(const ArenaMessageAllocator&) = delete;
+
+    grpc::MessageHolder<Request, Response>* AllocateMessages() override {
+        std::unique_ptr<Holder> holder;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!free_.empty()) {
+                holder = std::move(free_.back());
+                free_.pop_back();
+            }
+        }
+        if (!holder) {
+            holder = std::make_unique<Holder>(this);
+        }
+        holder->prepare();
+        return holder.release();
+    }
+
+private:
+    class Holder : public grpc::MessageHolder<Request, Response> {
+    public:
+        explicit Holder(ArenaMessageAllocator* owner) : owner_(owner) {}
+
+        void prepare() {
+            this->set_request(arena_.template create<Request>());
+            this->set_response(arena_.template create<Response>());
+        }
+
+        // Called by gRPC once the call is done with both messages
+        void Release() override {
+            arena_.reset();
+            owner_->recycle(std::unique_ptr<Holder>(this));
+        }
+
+    private:
+        ArenaMessageAllocator* owner_;
+        InlineArena<kBlockSize> arena_;
+    };
+
+    void recycle(std::unique_ptr<Holder> holder) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (free_.size() < max_pooled_) {
+            free_.push_back(std::move(holder));
+        }
+    }
+
+    const size_t max_pooled_;
+    std::mutex mutex_;
+    std::vector<std::unique_ptr<Holder>> free_;
+};
+
+} // namespace common
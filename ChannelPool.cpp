@@ -0,0 +1,68 @@
+#include "ChannelPool.h"
+#include <grpcpp/create_channel.h>
+#include <grpcpp/security/credentials.h>
+#include <algorithm>
+
+namespace common {
+
+ChannelPool::Lease& ChannelPool::Lease::operator=(Lease&& other) noexcept {
+    if (this != &other) {
+        release();
+        pool_ = other.pool_;
+        index_ = other.index_;
+        other.pool_ = nullptr;
+    }
+    return *this;
+}
+
+void ChannelPool::Lease::release() {
+    if (pool_) {
+        pool_->outstanding_[index_].fetch_sub(1, std::memory_order_relaxed);
+        pool_ = nullptr;
+    }
+}
+
+ChannelPool::ChannelPool(const std::string& target, size_t size, Policy policy, const grpc::ChannelArguments& args)
+    : policy_(policy), outstanding_(new std::atomic<int64_t>[std::max<size_t>(size, 1)]) {
+    size = std::max<size_t>(size, 1);
+    channels_.reserve(size);
+    for (size_t i = 0; i < size; ++i) {
+        grpc::ChannelArguments channel_args = args;
+        channel_args.SetInt(GRPC_ARG_USE_LOCAL_SUBCHANNEL_POOL, 1);
+        channel_args.SetInt("agent.channel_index", static_cast<int>(i));
+        channels_.push_back(grpc::CreateCustomChannel(target, grpc::InsecureChannelCredentials(), channel_args));
+        outstanding_[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+ChannelPool::Lease ChannelPool::acquire() const {
+    size_t count = channels_.size();
+    size_t chosen = static_cast<size_t>(next_.fetch_add(1, std::memory_order_relaxed) % count);
+    if (policy_ == Policy::LeastOutstanding) {
+        // Scan from the round-robin position so that ties rotate
+        int64_t fewest = outstanding(chosen);
+        for (size_t step = 1; step < count && fewest > 0; ++step) {
+            size_t index = (chosen + step) % count;
+            int64_t calls = outstanding(index);
+            if (calls < fewest) {
+                fewest = calls;
+                chosen = index;
+            }
+        }
+    }
+    outstanding_[chosen].fetch_add(1, std::memory_order_relaxed);
+    return Lease(this, chosen);
+}
+
+bool parseChannelPolicy(const std::string& name, ChannelPool::Policy* policy) {
+    if (name == "round-robin") {
+        *policy = ChannelPool::Policy::RoundRobin;
+    } else if (name == "least-outstanding") {
+        *policy = ChannelPool::Policy::LeastOutstanding;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+} // namespace common
@@ -0,0 +1,116 @@
+#pragma once
+#include <grpcpp/channel.h>
+#include <grpcpp/support/channel_arguments.h>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace common {
+
+// Several channels to one target, each on its own HTTP/2 connection.
+//
+// A single channel multiplexes every call over one connection, so concurrent
+// callers share its flow-control windows and its one poller, which shows first
+// with large frames. gRPC shares subchannels between channels with equal
+// arguments; each channel here gets a local subchannel pool and its own
+// "agent.channel_index" argument, so it opens a connection of its own. Against
+// a sharded server (ServerConfig::workers) the connections also land on
+// different workers.
+//
+// Callers lease a channel per call and hold the lease until the call is done.
+// Round robin takes the channels in turn; least outstanding takes the one with
+// the fewest calls in flight, in turn among equals, so a slow stream does not
+// hold up the calls queued behind it. Thread-safe.
+class ChannelPool {
+public:
+    enum class Policy { RoundRobin, LeastOutstanding };
+
+    // Counts a call against its channel until destroyed
+    class Lease {
+    public:
+        Lease(Lease&& other) noexcept : pool_(other.pool_), index_(other.index_) { other.pool_ = nullptr; }
+        Lease& operator=(Lease&& other) noexcept;
+        ~Lease() { release(); }
+
+        size_t index() const { return index_; }
+        const std::shared_ptr<grpc::Channel>& channel() const { return pool_->channels_[index_]; }
+
+    private:
+        friend class ChannelPool;
+        Lease(const ChannelPool* pool, size_t index) : pool_(pool), index_(index) {}
+        void release();
+
+        const ChannelPool* pool_;
+        size_t index_;
+    };
+
+    // size is at least 1; args apply to every channel
+    ChannelPool(const std::string& target, size_t size, Policy policy = Policy::LeastOutstanding,
+                const grpc::ChannelArguments& args = grpc::ChannelArguments());
+
+    ChannelPool(const ChannelPool&) = delete;
+    ChannelPool& operator=(const ChannelPool&) = delete;
+
+    Lease acquire() const;
+
+    size_t size() const { return channels_.size(); }
+    Policy policy() const { return policy_; }
+    const std::shared_ptr<grpc::Channel>& channel(size_t index) const { return channels_[index]; }
+    int64_t outstanding(size_t index) const { return outstanding_[index].load(std::memory_order_relaxed); }
+
+private:
+    const Policy policy_;
+    std::vector<std::shared_ptr<grpc::Channel>> channels_;
+    std::unique_ptr<std::atomic<int64_t>[]> outstanding_; // Calls in flight per channel
+    mutable std::atomic<uint64_t> next_{0};
+};
+
+// Accepts "round-robin" and "least-outstanding"
+bool parseChannelPolicy(const std::string& name, ChannelPool::Policy* policy);
+
+// One stub per pooled channel. A lease dereferences to the stub of the channel
+// it picked:
+//   auto stub = stubs.acquire();
+//   stub->GetImage(&context, request, &reply);
+template <typename Service>
+class StubPool {
+public:
+    using Stub = typename Service::Stub;
+
+    class Lease {
+    public:
+        Stub* operator->() const { return stub_; }
+        Stub* get() const { return stub_; }
+        size_t index() const { return channel_.index(); }
+
+    private:
+        friend class StubPool;
+        Lease(ChannelPool::Lease channel, Stub* stub) : channel_(std::move(channel)), stub_(stub) {}
+
+        ChannelPool::Lease channel_;
+        Stub* stub_;
+    };
+
+    explicit StubPool(std::shared_ptr<ChannelPool> channels) : channels_(std::move(channels)) {
+        for (size_t i = 0; i < channels_->size(); ++i) {
+            stubs_.push_back(Service::NewStub(channels_->channel(i)));
+        }
+    }
+
+    Lease acquire() const {
+        ChannelPool::Lease channel = channels_->acquire();
+        Stub* stub = stubs_[channel.index()].get();
+        return Lease(std::move(channel), stub);
+    }
+
+    const ChannelPool& channels() const { return *channels_; }
+
+private:
+    std::shared_ptr<ChannelPool> channels_;
+    std::vector<std::unique_ptr<Stub>> stubs_;
+};
+
+} // namespace common
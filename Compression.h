@@ -0,0 +1,56 @@
+#pragma once
+#include <grpc/compression.h>
+#include <grpcpp/client_context.h>
+#include <grpcpp/server_context.h>
+#include <string>
+
+namespace common {
+
+// Metadata a client sends to ask for compressed responses on one call. gRPC
+// compresses each side of a call independently: the client picks the request
+// algorithm itself, but the response algorithm is the server's choice, so the
+// servers only compress for callers that ask. Local Unix-socket clients leave
+// it unset and pay nothing; consumers behind a TCP bridge opt in.
+constexpr char kResponseCompressionKey[] = "x-response-compression";
+
+// Accepts "none" (or "identity"), "gzip" and "deflate"
+inline bool parseCompression(const std::string& name, grpc_compression_algorithm* algorithm) {
+    if (name == "none" || name == "identity") {
+        *algorithm = GRPC_COMPRESS_NONE;
+    } else if (name == "gzip") {
+        *algorithm = GRPC_COMPRESS_GZIP;
+    } else if (name == "deflate") {
+        *algorithm = GRPC_COMPRESS_DEFLATE;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Client side: compresses the request and asks for a compressed response.
+// Call before starting the RPC; GRPC_COMPRESS_NONE leaves the call untouched.
+inline void requestCompression(grpc::ClientContext* context, grpc_compression_algorithm algorithm) {
+    const char* name = nullptr;
+    if (algorithm == GRPC_COMPRESS_NONE || !grpc_compression_algorithm_name(algorithm, &name)) {
+        return;
+    }
+    context->set_compression_algorithm(algorithm);
+    context->AddMetadata(kResponseCompressionKey, name);
+}
+
+// Server side: compresses the responses of this call if the client asked for
+// it. Call from the method handler, before the initial metadata is sent.
+inline void applyRequestedCompression(grpc::CallbackServerContext* context) {
+    const auto& metadata = context->client_metadata();
+    auto it = metadata.find(kResponseCompressionKey);
+    if (it == metadata.end()) {
+        return;
+    }
+    grpc_compression_algorithm algorithm;
+    if (parseCompression(std::string(it->second.data(), it->second.size()), &algorithm) &&
+        algorithm != GRPC_COMPRESS_NONE) {
+        context->set_compression_algorithm(algorithm);
+    }
+}
+
+} // namespace common
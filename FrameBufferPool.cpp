@@ -0,0 +1,96 @@
+#include "FrameBufferPool.h"
+#include <atomic>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+namespace common {
+
+namespace {
+
+constexpr size_t kMinCapacity = 4096;
+
+size_t capacityClass(size_t size) {
+    size_t capacity = kMinCapacity;
+    while (capacity < size) {
+        capacity <<= 1;
+    }
+    return capacity;
+}
+
+} // namespace
+
+FrameBuffer::FrameBuffer(size_t capacity) : data_(new std::byte[capacity]), capacity_(capacity) {}
+
+void FrameBuffer::resize(size_t size) {
+    if (size > capacity_) {
+        throw std::length_error("FrameBuffer::resize beyond capacity");
+    }
+    size_ = size;
+}
+
+struct FrameBufferPool::State {
+    explicit State(size_t max_free_per_class) : max_free_per_class(max_free_per_class) {}
+
+    const size_t max_free_per_class;
+    std::atomic<uint64_t> allocations{0};
+    std::mutex mutex;
+    std::map<size_t, std::vector<std::unique_ptr<FrameBuffer>>> free_buffers; // By capacity
+
+    void release(FrameBuffer* buffer) {
+        std::unique_ptr<FrameBuffer> owned(buffer);
+        std::lock_guard<std::mutex> lock(mutex);
+        auto& free_list = free_buffers[buffer->capacity()];
+        if (free_list.size() < max_free_per_class) {
+            free_list.push_back(std::move(owned));
+        }
+    }
+};
+
+FrameBufferPool::FrameBufferPool(size_t max_free_per_class)
+    : state_(std::make_shared<State>(max_free_per_class)) {}
+
+FrameBufferPool::~FrameBufferPool() = default;
+
+FrameBufferPtr FrameBufferPool::acquire(size_t size) {
+    size_t capacity = capacityClass(size);
+    std::unique_ptr<FrameBuffer> buffer;
+    {
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        auto it = state_->free_buffers.find(capacity);
+        if (it != state_->free_buffers.end() && !it->second.empty()) {
+            buffer = std::move(it->second.back());
+            it->second.pop_back();
+        }
+    }
+    if (!buffer) {
+        buffer.reset(new FrameBuffer(capacity));
+        state_->allocations.fetch_add(1, std::memory_order_relaxed);
+    }
+    buffer->resize(size);
+
+    std::weak_ptr<State> pool = state_;
+    return FrameBufferPtr(buffer.release(), [pool](FrameBuffer* released) {
+        if (auto state = pool.lock()) {
+            state->release(released);
+        } else {
+            delete released;
+        }
+    });
+}
+
+FrameBufferPtr FrameBufferPool::copyOf(const void* data, size_t size) {
+    FrameBufferPtr buffer = acquire(size);
+    if (size) {
+        std::memcpy(buffer->data(), data, size);
+    }
+    return buffer;
+}
+
+uint64_t FrameBufferPool::allocations() const {
+    return state_->allocations.load(std::memory_order_relaxed);
+}
+
+} // namespace common
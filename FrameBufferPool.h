@@ -0,0 +1,64 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace common {
+
+// Byte buffer handed out by a FrameBufferPool. The capacity is fixed; size can
+// change within it.
+class FrameBuffer {
+public:
+    std::byte* data() { return data_.get(); }
+    const std::byte* data() const { return data_.get(); }
+    size_t size() const { return size_; }
+    size_t capacity() const { return capacity_; }
+    bool empty() const { return size_ == 0; }
+
+    // Throws std::length_error beyond capacity(); contents up to the new size are kept
+    void resize(size_t size);
+
+private:
+    friend class FrameBufferPool;
+
+    explicit FrameBuffer(size_t capacity);
+
+    std::unique_ptr<std::byte[]> data_;
+    size_t size_ = 0;
+    const size_t capacity_;
+};
+
+// Shared ownership: every holder (the listener, the frame cache, gRPC slices
+// still being written) keeps the buffer alive, and the last one returns it to
+// its pool. Treat the contents as read-only once the buffer has been shared.
+using FrameBufferPtr = std::shared_ptr<FrameBuffer>;
+
+// Recycles frame-sized buffers so that steady-state capture and serving make
+// no large allocations.
+//
+// Buffers are grouped by capacity, rounded up to a power of two, and each group
+// keeps up to max_free_per_class idle buffers. Buffers may outlive the pool;
+// they are then freed instead of returned. Thread-safe.
+class FrameBufferPool {
+public:
+    explicit FrameBufferPool(size_t max_free_per_class = 8);
+    ~FrameBufferPool();
+
+    FrameBufferPool(const FrameBufferPool&) = delete;
+    FrameBufferPool& operator=(const FrameBufferPool&) = delete;
+
+    // A buffer of size bytes; its contents are unspecified
+    FrameBufferPtr acquire(size_t size);
+
+    // A buffer holding a copy of data
+    FrameBufferPtr copyOf(const void* data, size_t size);
+
+    // Buffers allocated so far; flat once the pool has warmed up
+    uint64_t allocations() const;
+
+private:
+    struct State;
+    std::shared_ptr<State> state_;
+};
+
+} // namespace common
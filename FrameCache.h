@@ -0,0 +1,111 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace common {
+
+// Agent-side cache of the latest frame per key (camera type), shared by all
+// GetImage-style calls.
+//
+// A frame younger than max_age is handed out as-is. Otherwise the first caller
+// becomes the loader and runs the listener; callers that arrive while that load
+// is in flight are queued behind it instead of hitting the listener again, and
+// all of them receive the same immutable, refcounted frame. Listener calls thus
+// scale with the frame rate rather than with the number of clients.
+//
+// Callbacks run on the loader's thread (or the caller's on a hit), so waiters
+// never block a gRPC thread. A failed load is not cached: every waiter gets the
+// exception and the next call retries.
+template <typename Key, typename Frame>
+class FrameCache {
+public:
+    using FramePtr = std::shared_ptr<const Frame>;
+    using Callback = std::function<void(const FramePtr& frame, std::exception_ptr error)>;
+
+    explicit FrameCache(std::chrono::milliseconds max_age) : max_age_(max_age) {}
+
+    FrameCache(const FrameCache&) = delete;
+    FrameCache& operator=(const FrameCache&) = delete;
+
+    // loader is only invoked if this caller ends up performing the load
+    template <typename Loader>
+    void get(const Key& key, Loader&& loader, Callback callback) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        Entry& entry = entries_[key]; // std::map references stay valid across inserts
+        if (entry.frame && Clock::now() - entry.loaded_at <= max_age_) {
+            FramePtr frame = entry.frame;
+            lock.unlock();
+            callback(frame, nullptr);
+            return;
+        }
+
+        entry.waiters.push_back(std::move(callback));
+        if (entry.loading) {
+            return;
+        }
+        entry.loading = true;
+        lock.unlock();
+
+        FramePtr frame;
+        std::exception_ptr error;
+        try {
+            frame = std::make_shared<const Frame>(loader());
+        } catch (...) {
+            error = std::current_exception();
+        }
+
+        std::vector<Callback> waiters;
+        lock.lock();
+        entry.loading = false;
+        if (frame) {
+            entry.frame = frame;
+            entry.loaded_at = Clock::now();
+        }
+        waiters.swap(entry.waiters);
+        loads_++;
+        lock.unlock();
+
+        for (auto& waiter : waiters) {
+            waiter(frame, error);
+        }
+    }
+
+    // Stores a frame pushed by its producer; it is served like a loaded frame
+    // until it is older than max_age
+    void put(const Key& key, FramePtr frame) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Entry& entry = entries_[key];
+        entry.frame = std::move(frame);
+        entry.loaded_at = Clock::now();
+    }
+
+    // Number of listener calls made so far
+    uint64_t loads() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return loads_;
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Entry {
+        FramePtr frame;
+        Clock::time_point loaded_at;
+        bool loading = false;
+        std::vector<Callback> waiters;
+    };
+
+    const std::chrono::milliseconds max_age_;
+    mutable std::mutex mutex_;
+    std::map<Key, Entry> entries_;
+    uint64_t loads_ = 0;
+};
+
+} // namespace common
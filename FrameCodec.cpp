@@ -0,0 +1,93 @@
+#include "FrameCodec.h"
+#include <zlib.h>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace common {
+
+namespace {
+
+// Raw deflate: no zlib header or checksum, the frame size is carried alongside
+constexpr int kWindowBits = -15;
+constexpr int kMemLevel = 8;
+
+// zlib counts in 32 bits; larger frames are always sent raw
+constexpr size_t kMaxFrameSize = UINT_MAX;
+
+void xorInto(const unsigned char* a, const unsigned char* b, unsigned char* out, size_t size) {
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+        uint64_t x, y;
+        std::memcpy(&x, a + i, sizeof(x));
+        std::memcpy(&y, b + i, sizeof(y));
+        x ^= y;
+        std::memcpy(out + i, &x, sizeof(x));
+    }
+    for (; i < size; ++i) {
+        out[i] = a[i] ^ b[i];
+    }
+}
+
+} // namespace
+
+size_t encodeFrame(const void* frame, size_t size, const void* reference, void* out) {
+    if (size == 0 || size > kMaxFrameSize) {
+        return 0;
+    }
+
+    const auto* input = static_cast<const unsigned char*>(frame);
+    // Per thread, so that steady encoding allocates nothing once warmed up
+    thread_local std::vector<unsigned char> delta;
+    if (reference) {
+        delta.resize(size);
+        xorInto(input, static_cast<const unsigned char*>(reference), delta.data(), size);
+        input = delta.data();
+    }
+
+    // Deltas are runs of zeros with sparse changes: run-length matching is
+    // several times faster than full LZ77 and compresses them just as well
+    z_stream stream{};
+    if (deflateInit2(&stream, Z_BEST_SPEED, Z_DEFLATED, kWindowBits, kMemLevel,
+                     reference ? Z_RLE : Z_DEFAULT_STRATEGY) != Z_OK) {
+        return 0;
+    }
+    stream.next_in = const_cast<unsigned char*>(input);
+    stream.avail_in = static_cast<uInt>(size);
+    stream.next_out = static_cast<unsigned char*>(out);
+    stream.avail_out = static_cast<uInt>(size - 1); // Anything larger is not worth sending
+    int result = deflate(&stream, Z_FINISH);
+    size_t encoded_size = stream.total_out;
+    deflateEnd(&stream);
+    return result == Z_STREAM_END ? encoded_size : 0;
+}
+
+bool decodeFrame(const void* encoded, size_t encoded_size, const void* reference, void* frame, size_t frame_size) {
+    if (encoded_size > kMaxFrameSize || frame_size > kMaxFrameSize) {
+        return false;
+    }
+
+    z_stream stream{};
+    if (inflateInit2(&stream, kWindowBits) != Z_OK) {
+        return false;
+    }
+    stream.next_in = const_cast<unsigned char*>(static_cast<const unsigned char*>(encoded));
+    stream.avail_in = static_cast<uInt>(encoded_size);
+    stream.next_out = static_cast<unsigned char*>(frame);
+    stream.avail_out = static_cast<uInt>(frame_size);
+    int result = inflate(&stream, Z_FINISH);
+    size_t decoded_size = stream.total_out;
+    inflateEnd(&stream);
+    if (result != Z_STREAM_END || decoded_size != frame_size) {
+        return false;
+    }
+
+    if (reference) {
+        auto* output = static_cast<unsigned char*>(frame);
+        xorInto(output, static_cast<const unsigned char*>(reference), output, frame_size);
+    }
+    return true;
+}
+
+} // namespace common
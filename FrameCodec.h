@@ -0,0 +1,27 @@
+#pragma once
+#include <cstddef>
+
+namespace common {
+
+// Image-aware frame compression for links where bandwidth matters more than a
+// few milliseconds of CPU.
+//
+// A frame is either coded on its own (a key frame) or as the XOR against an
+// earlier frame of the same camera. In a near-static scene that XOR is almost
+// entirely zero bytes, which the entropy coder (raw deflate, run-length
+// matching only for deltas) shrinks to a tiny fraction of the frame. Both
+// sides must agree on the reference: the encoder's reference is the frame the
+// decoder last reconstructed.
+
+// Compresses size bytes of frame into out, which must have room for size
+// bytes. A non-null reference must also be size bytes and makes this a delta.
+// Returns the encoded size, or 0 when encoding would not make the frame
+// smaller; send it raw then.
+size_t encodeFrame(const void* frame, size_t size, const void* reference, void* out);
+
+// Reverses encodeFrame into frame_size bytes at frame, given the same
+// reference (null for a key frame). False if the data is corrupt or does not
+// decode to exactly frame_size bytes.
+bool decodeFrame(const void* encoded, size_t encoded_size, const void* reference, void* frame, size_t frame_size);
+
+} // namespace common
@@ -1,37 +1,169 @@
 #include "ImageServiceAgent.h"
+#include "ArenaAllocator.h"
+#include "Compression.h"
+#include "FrameCache.h"
+#include "Logger.h"
+#include "Metrics.h"
+#include "SharedFrameRing.h"
+#include "TopicTrie.h"
+#include <grpcpp/alarm.h>
 #include <grpcpp/grpcpp.h>
 #include <grpcpp/health_check_service_interface.h>
 #include "image_service.grpc.pb.h"
-#include <iostream>
+#include <google/protobuf/io/coded_stream.h>
+#include <algorithm>
 #include <memory>
 #include <thread>
 #include <atomic>
 #include <mutex>
-#include <condition_variable>
 #include <deque>
+#include <optional>
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 #include <chrono>
+#include <cstdlib>
 #include <unistd.h>
 
 using grpc::Server;
 using grpc::ServerBuilder;
-using grpc::ServerContext;
-using grpc::ServerWriter;
-using grpc::ServerReaderWriter;
+using grpc::CallbackServerContext;
 using grpc::Status;
+using grpc::ServerUnaryReactor;
+using grpc::ServerWriteReactor;
+using grpc::ServerBidiReactor;
 using imageservice::ImageService;
 using imageservice::GetImageRequest;
 using imageservice::ImageData;
-using imageservice::SegmentationRequest;
 using imageservice::SegmentationResult;
 using imageservice::SubscriptionRequest;
 using imageservice::ServerNotification;
 
 namespace vision {
 
+namespace {
+
+// Batched delivery limits: notifications per message, bytes per message (a
+// single larger notification still goes alone), and how long a partial batch
+// may wait for more
+constexpr size_t kMaxBatchSize = 1024;
+constexpr size_t kMaxBatchBytes = 1 << 20;
+constexpr double kMaxBatchLingerMs = 1000.0;
+
+// Batched notifications up to this size are copied into one contiguous slice;
+// larger ones keep referencing the bytes they were published with
+constexpr size_t kBatchCopyLimit = 1024;
+
+void appendVarint(std::string* out, uint64_t value) {
+    while (value >= 0x80) {
+        out->push_back(static_cast<char>(value | 0x80));
+        value >>= 7;
+    }
+    out->push_back(static_cast<char>(value));
+}
+
+constexpr uint32_t lengthDelimitedTag(int field) {
+    return (static_cast<uint32_t>(field) << 3) | 2;
+}
+
+// Wraps the first count serialized notifications in one ServerNotification
+// whose batch field holds them. Nothing is re-serialized: on the wire a batch
+// is each notification's bytes behind a tag and length.
+void serializeBatch(const std::deque<grpc::ByteBuffer>& notifications, size_t count, grpc::ByteBuffer* batch) {
+    using google::protobuf::io::CodedOutputStream;
+    const uint32_t batch_tag = lengthDelimitedTag(ServerNotification::kBatchFieldNumber);
+    const uint32_t entry_tag = lengthDelimitedTag(imageservice::ServerNotificationBatch::kNotificationsFieldNumber);
+
+    size_t batch_size = 0;
+    for (size_t i = 0; i < count; ++i) {
+        size_t size = notifications[i].Length();
+        batch_size += CodedOutputStream::VarintSize32(entry_tag) + CodedOutputStream::VarintSize64(size) + size;
+    }
+
+    std::string scratch;
+    scratch.reserve(std::min(batch_size, kMaxBatchBytes) + 16);
+    appendVarint(&scratch, batch_tag);
+    appendVarint(&scratch, batch_size);
+    std::vector<grpc::Slice> slices;
+    std::vector<grpc::Slice> entry_slices;
+    for (size_t i = 0; i < count; ++i) {
+        const auto& notification = notifications[i];
+        appendVarint(&scratch, entry_tag);
+        appendVarint(&scratch, notification.Length());
+        entry_slices.clear();
+        notification.Dump(&entry_slices);
+        if (notification.Length() <= kBatchCopyLimit) {
+            for (const auto& slice : entry_slices) {
+                scratch.append(reinterpret_cast<const char*>(slice.begin()), slice.size());
+            }
+            continue;
+        }
+        slices.emplace_back(scratch);
+        scratch.clear();
+        slices.insert(slices.end(), entry_slices.begin(), entry_slices.end());
+    }
+    if (!scratch.empty()) {
+        slices.emplace_back(scratch);
+    }
+    grpc::ByteBuffer(slices.data(), slices.size()).Swap(batch);
+}
+
+// Reads the batching preferences of a SubscriptionRequest: batch_max_size
+// (notifications per message) and batch_linger_ms (how long a partial batch
+// waits for more; fractions allowed). Absent ones keep their defaults of one
+// notification per message and no lingering. Returns an error message, or an
+// empty string if both are valid.
+std::string parseBatchPreferences(const SubscriptionRequest& request, size_t* max_size,
+                                  std::chrono::steady_clock::duration* linger) {
+    const auto& preferences = request.preferences();
+    auto size = preferences.find("batch_max_size");
+    if (size != preferences.end()) {
+        char* end = nullptr;
+        unsigned long value = std::strtoul(size->second.c_str(), &end, 10);
+        if (size->second.empty() || *end != '\0' || value < 1 || value > kMaxBatchSize) {
+            return "batch_max_size must be between 1 and " + std::to_string(kMaxBatchSize);
+        }
+        *max_size = value;
+    }
+    auto linger_ms = preferences.find("batch_linger_ms");
+    if (linger_ms != preferences.end()) {
+        char* end = nullptr;
+        double value = std::strtod(linger_ms->second.c_str(), &end);
+        if (linger_ms->second.empty() || *end != '\0' || !(value >= 0 && value <= kMaxBatchLingerMs)) {
+            return "batch_linger_ms must be between 0 and " + std::to_string(static_cast<int>(kMaxBatchLingerMs));
+        }
+        *linger = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double, std::milli>(value));
+    }
+    return "";
+}
+
+} // namespace
+
 class ImageServiceAgent::Impl {
+private:
+    // Forward declaration of nested classes
+    class DoSegmentationReactor;
+    class SubscribeReactor;
+
+    // The listener exposes a single image source, so every call shares one key
+    using FrameCache = common::FrameCache<int, ImageData>;
+    static constexpr int kImageSourceKey = 0;
+
+    static constexpr char kDefaultListenAddress[] = "unix:///tmp/image_service.sock";
+    static constexpr char kDefaultFrameChannelPath[] = "/tmp/image_service.shm.sock";
+
 public:
-    Impl(std::weak_ptr<IImageServiceListener> listener)
-        : listener_(listener), stop_server_(false) {
+    Impl(std::weak_ptr<IImageServiceListener> listener, std::chrono::milliseconds frame_max_age,
+         const NotificationOptions& notification_options, const common::ServerConfig& server_config)
+        : listener_(listener), stop_server_(false), notification_options_(notification_options),
+          server_config_(server_config),
+          listen_addresses_(common::listenAddresses(server_config, kDefaultListenAddress)),
+          frame_cache_(frame_max_age),
+          frame_ring_(std::make_unique<common::SharedFrameRing>(
+              common::frameChannelPath(server_config, kDefaultFrameChannelPath), kFrameRingSlots,
+              kFrameRingSlotSize)) {
         startServer();
     }
 
@@ -39,221 +171,948 @@ public:
         stopServer();
     }
 
-    void sendSegmentationResult(const SegmentationResult& segmentation_result) {
-        std::lock_guard<std::mutex> lock(segmentation_results_mutex_);
-        pending_segmentation_results_.push_back(segmentation_result);
-        segmentation_results_cv_.notify_one();
+    void sendSegmentationResult(uint64_t request_id, const SegmentationResult& segmentation_result) {
+        std::lock_guard<std::mutex> lock(segmentation_mutex_);
+        auto it = in_flight_segmentations_.find(request_id);
+        if (it == in_flight_segmentations_.end()) {
+            AGENT_LOG_WARN("[AGENT] Dropping segmentation result for unknown or finished request " << request_id);
+            return;
+        }
+        metrics_.segmentation.listenerFinished(it->second.started_at);
+        for (auto* reactor : it->second.reactors) {
+            reactor->DeliverResult(segmentation_result);
+        }
+        eraseSegmentationLocked(it);
+    }
+
+    size_t publishNotification(const std::string& topic, const vision::Notification& notification) {
+        if (!SubscriptionTrie::isValidTopic(topic)) {
+            AGENT_LOG_WARN("[AGENT] Not publishing to invalid topic '" << topic << "'");
+            return 0;
+        }
+        std::vector<SubscriptionTrie::SubscribersPtr> matches;
+        {
+            std::lock_guard<std::mutex> lock(subscribers_mutex_);
+            subscriptions_.match(topic, &matches);
+        }
+        if (matches.empty()) {
+            return 0;
+        }
+
+        ServerNotification message;
+        message.set_notification_id(std::to_string(next_notification_id_.fetch_add(1)));
+        message.set_topic(topic);
+        message.set_message(notification.message);
+        message.set_notification_type(notification.notification_type);
+        message.set_timestamp(std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count());
+        message.mutable_metadata()->insert(notification.metadata.begin(), notification.metadata.end());
+        message.set_data(notification.data);
+
+        // Serialized once; every stream queues a reference to the same slices
+        grpc::ByteBuffer payload;
+        bool own_buffer;
+        grpc::SerializationTraits<ServerNotification>::Serialize(message, &payload, &own_buffer);
+        metrics_.notifications_published.add(1);
+
+        size_t queued = 0;
+        if (matches.size() == 1) {
+            for (const auto& subscriber : *matches.front()) {
+                if (subscriber->Offer(payload)) {
+                    queued++;
+                }
+            }
+            return queued;
+        }
+
+        // A stream whose filters overlap, e.g. "camera/#" and "camera/+/exposure",
+        // still gets each notification once
+        std::unordered_set<SubscribeReactor*> offered;
+        for (const auto& subscribers : matches) {
+            for (const auto& subscriber : *subscribers) {
+                if (offered.insert(subscriber.get()).second && subscriber->Offer(payload)) {
+                    queued++;
+                }
+            }
+        }
+        return queued;
+    }
+
+    void enableMetricsDump(const std::string& path, std::chrono::milliseconds interval) {
+        metrics_.registry.startPeriodicDump(path, interval);
+    }
+
+    // Attaches a new doSegmentation call to the running job with the same content,
+    // or starts a job under a fresh request ID. Returns true if the caller must
+    // hand the job to the listener.
+    bool attachSegmentation(DoSegmentationReactor* reactor, const std::string& key, uint64_t* request_id) {
+        std::lock_guard<std::mutex> lock(segmentation_mutex_);
+        auto running = segmentations_by_key_.find(key);
+        if (running != segmentations_by_key_.end()) {
+            *request_id = running->second;
+            in_flight_segmentations_[running->second].reactors.push_back(reactor);
+            return false;
+        }
+
+        *request_id = next_request_id_.fetch_add(1);
+        in_flight_segmentations_.emplace(*request_id,
+                                         SegmentationJob{key, {reactor}, std::chrono::steady_clock::now()});
+        segmentations_by_key_.emplace(key, *request_id);
+        metrics_.segmentation_jobs.set(in_flight_segmentations_.size());
+        return true;
+    }
+
+    // The job is dropped with its last caller; a late listener result is then ignored
+    void detachSegmentation(uint64_t request_id, DoSegmentationReactor* reactor) {
+        std::lock_guard<std::mutex> lock(segmentation_mutex_);
+        auto it = in_flight_segmentations_.find(request_id);
+        if (it == in_flight_segmentations_.end()) {
+            return;
+        }
+        auto& reactors = it->second.reactors;
+        reactors.erase(std::remove(reactors.begin(), reactors.end(), reactor), reactors.end());
+        if (reactors.empty()) {
+            eraseSegmentationLocked(it);
+        }
+    }
+
+    // Fails every call attached to the job, e.g. when the listener threw
+    void failSegmentation(uint64_t request_id, const std::string& message,
+                          grpc::StatusCode code = grpc::StatusCode::INTERNAL) {
+        std::lock_guard<std::mutex> lock(segmentation_mutex_);
+        auto it = in_flight_segmentations_.find(request_id);
+        if (it == in_flight_segmentations_.end()) {
+            return;
+        }
+        for (auto* reactor : it->second.reactors) {
+            reactor->DeliverError(message, code);
+        }
+        eraseSegmentationLocked(it);
     }
 
 private:
+    // One listener job and every call waiting on it
+    struct SegmentationJob {
+        std::string key;
+        std::vector<DoSegmentationReactor*> reactors;
+        std::chrono::steady_clock::time_point started_at; // Handed to the listener
+    };
+
+    void eraseSegmentationLocked(std::unordered_map<uint64_t, SegmentationJob>::iterator it) {
+        segmentations_by_key_.erase(it->second.key);
+        in_flight_segmentations_.erase(it);
+        metrics_.segmentation_jobs.set(in_flight_segmentations_.size());
+    }
+
+    // Handles resolved once at startup, so recording never takes a lock
+    struct AgentMetrics {
+        common::MetricsRegistry registry;
+        common::MethodMetrics& get_image = registry.method("GetImage");
+        common::MethodMetrics& segmentation = registry.method("doSegmentation");
+        common::MethodMetrics& notifications = registry.method("subscribeToNotifications");
+        common::Gauge& segmentation_calls = registry.gauge("segmentation_active_calls");
+        common::Gauge& segmentation_jobs = registry.gauge("segmentation_jobs_in_flight");
+        common::Gauge& segmentation_write_queue = registry.gauge("segmentation_write_queue_depth");
+        common::Gauge& notification_streams = registry.gauge("notification_active_streams");
+        common::Gauge& notification_write_queue = registry.gauge("notification_write_queue_depth");
+        common::Gauge& notification_filters = registry.gauge("notification_filters");
+        common::Gauge& notifications_published = registry.gauge("notifications_published_total");
+        common::Gauge& notifications_dropped = registry.gauge("notifications_dropped_total");
+    };
+
+    // Subscriber lists are copy-on-write: publishers iterate the lists they
+    // matched without holding the registry lock
+    using SubscriptionTrie = common::TopicTrie<std::shared_ptr<SubscribeReactor>>;
+
+    static constexpr size_t kMaxTopicsPerStream = 256;
+
+    // Moves the stream from the filters it had to the ones it asked for,
+    // touching only the filters that changed
+    void updateSubscriptions(const std::shared_ptr<SubscribeReactor>& reactor, const std::set<std::string>& previous,
+                             const std::set<std::string>& topics) {
+        std::lock_guard<std::mutex> lock(subscribers_mutex_);
+        for (const auto& topic : previous) {
+            if (!topics.count(topic)) {
+                subscriptions_.remove(topic, reactor);
+            }
+        }
+        for (const auto& topic : topics) {
+            if (!previous.count(topic)) {
+                subscriptions_.add(topic, reactor);
+            }
+        }
+        metrics_.notification_filters.set(subscriptions_.filterCount());
+    }
+
+    void registerNotificationStream(SubscribeReactor* reactor) {
+        std::lock_guard<std::mutex> lock(subscribers_mutex_);
+        notification_streams_.insert(reactor);
+    }
+
+    void unregisterNotificationStream(const std::shared_ptr<SubscribeReactor>& reactor,
+                                      const std::set<std::string>& topics) {
+        std::lock_guard<std::mutex> lock(subscribers_mutex_);
+        notification_streams_.erase(reactor.get());
+        for (const auto& topic : topics) {
+            subscriptions_.remove(topic, reactor);
+        }
+        metrics_.notification_filters.set(subscriptions_.filterCount());
+    }
+
+    // Canonical form of a request's content: identical requests map to the same
+    // key regardless of parameter order. Fields are length-prefixed so that no
+    // two different requests can collide. Priority only affects scheduling and
+    // is not part of the content.
+    static std::string segmentationKey(const vision::SegmentationRequest& request) {
+        std::string key;
+        auto append = [&key](const std::string& field) {
+            key += std::to_string(field.size());
+            key += ':';
+            key += field;
+        };
+        append(request.image_id);
+        append(request.segmentation_type);
+        for (const auto& parameter : request.parameters) { // std::map: sorted by name
+            append(parameter.first);
+            append(parameter.second);
+        }
+        return key;
+    }
+
+    static constexpr uint32_t kFrameRingSlots = 8;
+    static constexpr uint64_t kFrameRingSlotSize = 16 * 1024 * 1024;
+
+    // Copies the frame into the shared-memory ring; false means the caller must
+    // send the bytes inline instead.
+    bool writeSharedFrame(const std::string& frame, imageservice::SharedFrameHandle* grpc_handle) {
+        common::SharedFrameHandle handle;
+        if (!frame_ring_->write(frame.data(), frame.size(), &handle)) {
+            return false;
+        }
+        grpc_handle->set_slot(handle.slot);
+        grpc_handle->set_sequence(handle.sequence);
+        grpc_handle->set_offset(handle.offset);
+        grpc_handle->set_length(handle.length);
+        grpc_handle->set_channel_path(frame_ring_->channelPath());
+        return true;
+    }
+
     void startServer() {
         server_thread_ = std::thread([this]() {
-            std::string server_address("unix:///tmp/image_service.sock"); // Unix socket path
-
             // Create service implementation
             auto service = std::make_unique<ImageServiceImpl>(this);
 
             // Build server
             ServerBuilder builder;
-            builder.AddListeningPort(server_address, grpc::InsecureServerCredentials());
+            common::applyServerConfig(server_config_, listen_addresses_, &builder);
             builder.RegisterService(service.get());
 
             // Add health check service
             grpc::EnableDefaultHealthCheckService(true);
 
             // Build and start server
-            std::unique_ptr<Server> server(builder.BuildAndStart());
-            std::cout << "[AGENT] ImageServiceAgent server listening on " << server_address << std::endl;
+            {
+                std::lock_guard<std::mutex> lock(server_mutex_);
+                server_ = builder.BuildAndStart();
+            }
+            if (!server_) {
+                AGENT_LOG_ERROR("[AGENT] ImageServiceAgent failed to listen on "
+                                << common::joinAddresses(listen_addresses_));
+                return;
+            }
+            std::string settings = common::describeServerConfig(server_config_);
+            AGENT_LOG_INFO("[AGENT] ImageServiceAgent server listening on " << common::joinAddresses(listen_addresses_)
+                           << (settings.empty() ? "" : " (" + settings + ")"));
 
             // Wait for server to shutdown
-            server->Wait();
+            server_->Wait();
         });
     }
 
     void stopServer() {
         stop_server_ = true;
-        segmentation_results_cv_.notify_all();
 
-        // Clean up Unix socket
-        if (unlink("/tmp/image_service.sock") == 0) {
-            std::cout << "[AGENT] Unix socket cleaned up" << std::endl;
+        // Fail segmentations that are still waiting for a result
+        {
+            std::lock_guard<std::mutex> lock(segmentation_mutex_);
+            for (auto& entry : in_flight_segmentations_) {
+                for (auto* reactor : entry.second.reactors) {
+                    reactor->Cancel(Status(grpc::StatusCode::CANCELLED, "Server shutting down"));
+                }
+            }
+            in_flight_segmentations_.clear();
+            segmentations_by_key_.clear();
+            metrics_.segmentation_jobs.set(0);
+        }
+
+        // Clean up Unix sockets
+        for (const auto& address : listen_addresses_) {
+            std::string socket_path = common::unixSocketPath(address);
+            if (!socket_path.empty() && unlink(socket_path.c_str()) == 0) {
+                AGENT_LOG_INFO("[AGENT] Unix socket " << socket_path << " cleaned up");
+            }
+        }
+
+        // Notification streams only end when their client hangs up; end them here
+        // so that Shutdown does not wait for every subscriber to go away
+        std::vector<std::shared_ptr<SubscribeReactor>> streams;
+        {
+            std::lock_guard<std::mutex> lock(subscribers_mutex_);
+            for (auto* reactor : notification_streams_) {
+                streams.push_back(reactor->shared_from_this());
+            }
+        }
+        for (const auto& reactor : streams) {
+            reactor->Close(Status(grpc::StatusCode::CANCELLED, "Server shutting down"));
+        }
+
+        // Shutdown the server, cancelling whatever is still in flight after a grace period
+        {
+            std::lock_guard<std::mutex> lock(server_mutex_);
+            if (server_) {
+                AGENT_LOG_INFO("[AGENT] Shutting down server...");
+                server_->Shutdown(std::chrono::system_clock::now() + std::chrono::seconds(1));
+            }
         }
 
         if (server_thread_.joinable()) {
             server_thread_.join();
         }
+
+        // Clear server reference
+        {
+            std::lock_guard<std::mutex> lock(server_mutex_);
+            server_.reset();
+        }
     }
 
-    // Traditional gRPC Service Implementation
-    class ImageServiceImpl final : public ImageService::Service {
+    // gRPC Service Implementation
+    class GetImageReactor : public grpc::ServerUnaryReactor {
     public:
-        ImageServiceImpl(Impl* agent_impl) : agent_impl_(agent_impl) {}
-
-        Status GetImage(ServerContext* context, const imageservice::GetImageRequest* request,
-                       imageservice::ImageData* response) override {
-            std::cout << "[AGENT] GetImage request received for image_id: " << request->image_id() << std::endl;
+        GetImageReactor(Impl* agent_impl, const GetImageRequest* request, imageservice::ImageData* response)
+            : agent_impl_(agent_impl), request_(request), response_(response),
+              received_at_(std::chrono::steady_clock::now()) {
+            agent_impl_->metrics_.get_image.callStarted(request_->ByteSizeLong());
+            StartProcessing();
+        }
 
+        void StartProcessing() {
             auto listener = agent_impl_->listener_.lock();
             if (!listener) {
-                response->set_image_id(request->image_id());
-                response->set_image_name("error");
-                response->set_image_content("Listener not available");
-                response->set_format("error");
-                response->set_width(0);
-                response->set_height(0);
-                response->set_size(0);
-                return Status(grpc::StatusCode::INTERNAL, "Listener not available");
+                setErrorResponse("Listener not available");
+                Finish(Status(grpc::StatusCode::INTERNAL, "Listener not available"));
+                return;
             }
 
+            // Concurrent GetImage calls share one listener call
+            auto& metrics = agent_impl_->metrics_.get_image;
+            agent_impl_->frame_cache_.get(
+                kImageSourceKey,
+                [&listener, &metrics]() {
+                    auto listener_started = std::chrono::steady_clock::now();
+                    auto image_data = listener->onGetImage();
+                    metrics.listenerFinished(listener_started);
+                    return image_data;
+                },
+                [this](const FrameCache::FramePtr& frame, std::exception_ptr error) { OnFrame(frame, error); });
+        }
+
+        void OnFrame(const FrameCache::FramePtr& image_data, std::exception_ptr error) {
             try {
-                // Call listener to get image data
-                auto image_data = listener->onGetImage();
+                if (error) {
+                    std::rethrow_exception(error);
+                }
 
                 // Convert to gRPC response
-                response->set_image_id(request->image_id());
-                response->set_image_name("image_from_listener");
-                response->set_image_content(image_data.image_data);
-                response->set_format(image_data.image_type);
-                response->set_width(1920);
-                response->set_height(1080);
-                response->set_size(image_data.image_data.size());
-
-                std::cout << "[AGENT] GetImage response prepared (size: " << response->size() << " bytes)" << std::endl;
-                return Status::OK;
+                response_->set_image_id(request_->image_id());
+                response_->set_image_name("image_from_listener");
+                if (!request_->use_shared_memory() ||
+                    !agent_impl_->writeSharedFrame(image_data->image_data, response_->mutable_shared_frame())) {
+                    response_->clear_shared_frame();
+                    response_->set_image_content(image_data->image_data);
+                }
+                response_->set_format(image_data->image_type);
+                response_->set_width(1920);
+                response_->set_height(1080);
+                response_->set_size(image_data->image_data.size());
+
+                AGENT_LOG_DEBUG("[AGENT] GetImage response prepared (size: " << response_->size() << " bytes)");
+                agent_impl_->metrics_.get_image.messageSent(response_->ByteSizeLong());
+                ok_ = true;
+                Finish(Status::OK);
             } catch (const std::exception& e) {
-                std::cerr << "[AGENT] GetImage error: " << e.what() << std::endl;
-                response->set_image_id(request->image_id());
-                response->set_image_name("error");
-                response->set_image_content("Failed to get image: " + std::string(e.what()));
-                response->set_format("error");
-                response->set_width(0);
-                response->set_height(0);
-                response->set_size(0);
-                return Status(grpc::StatusCode::INTERNAL, "Failed to get image: " + std::string(e.what()));
+                AGENT_LOG_ERROR("[AGENT] GetImage error: " << e.what());
+                setErrorResponse("Failed to get image: " + std::string(e.what()));
+                Finish(Status(grpc::StatusCode::INTERNAL, "Failed to get image: " + std::string(e.what())));
             }
         }
 
-        Status doSegmentation(ServerContext* context, const imageservice::SegmentationRequest* request,
-                             ServerWriter<imageservice::SegmentationResult>* writer) override {
-            std::cout << "[AGENT] doSegmentation request received for image_id: " << request->image_id()
-                      << ", type: " << request->segmentation_type() << std::endl;
+        void OnDone() override {
+            agent_impl_->metrics_.get_image.callFinished(received_at_, ok_);
+            delete this;
+        }
+
+    private:
+        void setErrorResponse(const std::string& message) {
+            response_->set_image_id(request_->image_id());
+            response_->set_image_name("error");
+            response_->set_image_content(message);
+            response_->set_format("error");
+            response_->set_width(0);
+            response_->set_height(0);
+            response_->set_size(0);
+        }
+
+        Impl* agent_impl_;
+        const GetImageRequest* request_;
+        imageservice::ImageData* response_;
+        const std::chrono::steady_clock::time_point received_at_;
+        bool ok_ = false;
+    };
+
+    // Holds no thread while waiting: the reactor sits in the agent's completion
+    // table, attached to the job for its request content, until
+    // sendSegmentationResult hands the job's result to every attached call.
+    class DoSegmentationReactor : public grpc::ServerWriteReactor<imageservice::SegmentationResult> {
+    public:
+        DoSegmentationReactor(Impl* agent_impl, const imageservice::SegmentationRequest* request)
+            : agent_impl_(agent_impl), request_(request), request_id_(0),
+              received_at_(std::chrono::steady_clock::now()) {
+            agent_impl_->metrics_.segmentation.callStarted(request_->ByteSizeLong());
+            agent_impl_->metrics_.segmentation_calls.add(1);
+            StartProcessing();
+        }
+
+        void StartProcessing() {
+            if (agent_impl_->stop_server_) {
+                Finish(Status(grpc::StatusCode::CANCELLED, "Server shutting down"));
+                return;
+            }
 
             auto listener = agent_impl_->listener_.lock();
             if (!listener) {
-                return Status(grpc::StatusCode::INTERNAL, "Listener not available");
+                Finish(Status(grpc::StatusCode::INTERNAL, "Listener not available"));
+                return;
+            }
+
+            vision::SegmentationRequest segmentation_request;
+            segmentation_request.image_id = request_->image_id();
+            segmentation_request.segmentation_type = request_->segmentation_type();
+            segmentation_request.parameters.insert(request_->parameters().begin(), request_->parameters().end());
+            segmentation_request.priority = request_->priority();
+
+            // Attach before calling the listener, which may answer from any thread.
+            // An identical request that is already running is shared, not re-run.
+            bool start_job = agent_impl_->attachSegmentation(this, segmentationKey(segmentation_request), &request_id_);
+            segmentation_request.request_id = request_id_;
+
+            // Send initial processing status
+            auto* processing_result = arena_.create<imageservice::SegmentationResult>();
+            processing_result->set_request_id(std::to_string(request_id_));
+            processing_result->set_status("processing");
+            processing_result->set_result_format("raw");
+            Enqueue(processing_result);
+
+            if (!start_job) {
+                AGENT_LOG_DEBUG("[AGENT] Segmentation for image " << segmentation_request.image_id
+                                << " attached to running request " << request_id_);
+                return;
             }
 
             try {
                 // Call listener to perform segmentation
-                listener->onDoSegmentation();
+                if (!listener->onDoSegmentation(segmentation_request)) {
+                    AGENT_LOG_WARN("[AGENT] Segmentation " << request_id_ << " rejected, listener is busy");
+                    agent_impl_->failSegmentation(request_id_, "Server busy, try again later",
+                                                  grpc::StatusCode::RESOURCE_EXHAUSTED);
+                }
+            } catch (const std::exception& e) {
+                AGENT_LOG_ERROR("[AGENT] Segmentation error: " << e.what());
+                agent_impl_->failSegmentation(request_id_, e.what());
+            }
+        }
+
+        // Called with the agent's segmentation mutex held. Returns false if the call
+        // already ended.
+        bool DeliverResult(const vision::SegmentationResult& result) {
+            auto* grpc_result = arena_.create<imageservice::SegmentationResult>();
+            grpc_result->set_request_id(std::to_string(request_id_));
+            grpc_result->set_status("completed");
+            grpc_result->set_segmented_image(result.segmentation_result);
+            grpc_result->set_result_format("raw");
+            return Enqueue(grpc_result, Status::OK);
+        }
 
-                // Send initial processing status
-                imageservice::SegmentationResult processing_result;
-                processing_result.set_request_id(request->image_id());
-                processing_result.set_status("processing");
-                processing_result.set_result_format("raw");
+        // Called with the agent's segmentation mutex held
+        bool DeliverError(const std::string& message, grpc::StatusCode code) {
+            auto* error_result = arena_.create<imageservice::SegmentationResult>();
+            error_result->set_request_id(std::to_string(request_id_));
+            error_result->set_status("failed");
+            error_result->set_error_message(message);
+            return Enqueue(error_result, Status(code, "Segmentation failed: " + message));
+        }
+
+        void Cancel(const Status& status) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            finishLocked(status);
+        }
 
-                if (!writer->Write(processing_result)) {
-                    return Status(grpc::StatusCode::INTERNAL, "Failed to write processing status");
+        void OnWriteDone(bool ok) override {
+            std::lock_guard<std::mutex> lock(mutex_);
+            write_queue_.pop_front();
+            agent_impl_->metrics_.segmentation_write_queue.add(-1);
+            if (finished_) {
+                return;
+            }
+            if (!ok) {
+                finishLocked(Status(grpc::StatusCode::INTERNAL, "Failed to write segmentation result"));
+                return;
+            }
+            if (!write_queue_.empty()) {
+                StartWrite(write_queue_.front());
+            } else if (finish_status_) {
+                AGENT_LOG_DEBUG("[AGENT] Segmentation result sent successfully");
+                finishLocked(*finish_status_);
+            }
+        }
+
+        void OnCancel() override {
+            agent_impl_->detachSegmentation(request_id_, this);
+            std::lock_guard<std::mutex> lock(mutex_);
+            finishLocked(Status::CANCELLED);
+        }
+
+        void OnDone() override {
+            agent_impl_->detachSegmentation(request_id_, this);
+            auto& metrics = agent_impl_->metrics_;
+            metrics.segmentation_write_queue.add(-static_cast<int64_t>(write_queue_.size()));
+            metrics.segmentation_calls.add(-1);
+            metrics.segmentation.callFinished(received_at_, ok_);
+            delete this;
+        }
+
+    private:
+        // Queues a message created on the call's arena; with a final status the
+        // call finishes once it is written
+        bool Enqueue(imageservice::SegmentationResult* message, std::optional<Status> final_status = std::nullopt) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (finished_ || finish_status_) {
+                return false;
+            }
+            finish_status_ = std::move(final_status);
+            agent_impl_->metrics_.segmentation.messageSent(message->ByteSizeLong());
+            agent_impl_->metrics_.segmentation_write_queue.add(1);
+            write_queue_.push_back(message);
+            if (write_queue_.size() == 1) {
+                StartWrite(write_queue_.front());
+            }
+            return true;
+        }
+
+        void finishLocked(const Status& status) {
+            if (!finished_) {
+                finished_ = true;
+                ok_ = status.ok();
+                Finish(status);
+            }
+        }
+
+        Impl* agent_impl_;
+        const imageservice::SegmentationRequest* request_;
+        uint64_t request_id_;
+        const std::chrono::steady_clock::time_point received_at_;
+        bool ok_ = false;
+        // Every message of the call (status, result or error) lives here; the
+        // call sends at most three, so the inline block normally covers them all
+        common::InlineArena<2048> arena_;
+        std::mutex mutex_;
+        std::deque<imageservice::SegmentationResult*> write_queue_; // Front is the write in flight
+        std::optional<Status> finish_status_;
+        bool finished_ = false;
+    };
+
+    // Raw bidi stream: published notifications arrive serialized, and every
+    // subscribed stream writes the same refcounted slices. Each subscription
+    // request replaces the stream's topics and is acknowledged with a welcome
+    // notification. Writes are queued up to the configured bound; past it the
+    // overflow policy decides, so a slow client never blocks a publisher.
+    class SubscribeReactor : public grpc::ServerBidiReactor<grpc::ByteBuffer, grpc::ByteBuffer>,
+                             public std::enable_shared_from_this<SubscribeReactor> {
+    public:
+        SubscribeReactor(Impl* agent_impl)
+            : agent_impl_(agent_impl), options_(agent_impl->notification_options_),
+              received_at_(std::chrono::steady_clock::now()) {
+            agent_impl_->metrics_.notifications.callStarted(0);
+            agent_impl_->metrics_.notification_streams.add(1);
+        }
+
+        void Start() {
+            self_ = shared_from_this();
+            agent_impl_->registerNotificationStream(this);
+            if (agent_impl_->stop_server_) {
+                Close(Status(grpc::StatusCode::CANCELLED, "Server shutting down"));
+                return; // No reads after Finish
+            }
+            StartRead(&read_buffer_);
+        }
+
+        void OnReadDone(bool ok) override {
+            if (!ok) {
+                AGENT_LOG_INFO("[AGENT] Client disconnected from notifications");
+                std::lock_guard<std::mutex> lock(mutex_);
+                reads_done_ = true;
+                flushLocked();
+                return;
+            }
+
+            auto& metrics = agent_impl_->metrics_;
+            metrics.notifications.messageReceived(read_buffer_.Length());
+            SubscriptionRequest request;
+            if (!grpc::SerializationTraits<SubscriptionRequest>::Deserialize(&read_buffer_, &request).ok()) {
+                Close(Status(grpc::StatusCode::INVALID_ARGUMENT, "Malformed SubscriptionRequest"));
+                return;
+            }
+            std::set<std::string> topics;
+            for (const auto& topic : request.topics()) {
+                if (topic.empty()) {
+                    continue;
+                }
+                if (!SubscriptionTrie::isValidFilter(topic)) {
+                    Close(Status(grpc::StatusCode::INVALID_ARGUMENT, "Invalid topic filter '" + topic + "'"));
+                    return;
                 }
+                topics.insert(topic);
+            }
+            if (topics.size() > kMaxTopicsPerStream) {
+                Close(Status(grpc::StatusCode::INVALID_ARGUMENT,
+                             "At most " + std::to_string(kMaxTopicsPerStream) + " topics per stream"));
+                return;
+            }
 
-                // Wait for segmentation result
-                std::unique_lock<std::mutex> lock(agent_impl_->segmentation_results_mutex_);
-                agent_impl_->segmentation_results_cv_.wait(lock, [this]() {
-                    return !agent_impl_->pending_segmentation_results_.empty() || agent_impl_->stop_server_;
-                });
+            size_t batch_max_size = 1;
+            std::chrono::steady_clock::duration batch_linger{0};
+            std::string error = parseBatchPreferences(request, &batch_max_size, &batch_linger);
+            if (!error.empty()) {
+                Close(Status(grpc::StatusCode::INVALID_ARGUMENT, error));
+                return;
+            }
 
-                if (agent_impl_->stop_server_) {
-                    return Status(grpc::StatusCode::CANCELLED, "Server shutting down");
+            std::string topic_list;
+            for (const auto& topic : topics) {
+                topic_list += topic + " ";
+            }
+            AGENT_LOG_INFO("[AGENT] Client " << request.client_name() << " subscribed to topics: " << topic_list);
+            {
+                // Reads are sequential, so only OnDone competes for topics_
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (finished_) {
+                    return;
                 }
+                agent_impl_->updateSubscriptions(self_, topics_, topics);
+                topics_ = std::move(topics);
+                // A full queue always makes a full batch, so lingering never forces the overflow policy
+                batch_max_size_ = std::min(batch_max_size, options_.max_queued_notifications);
+                batch_linger_ = batch_linger;
+            }
 
-                // Send the segmentation result
-                if (!agent_impl_->pending_segmentation_results_.empty()) {
-                    const auto& result = agent_impl_->pending_segmentation_results_.front();
+            // Acknowledge with a welcome notification
+            ServerNotification welcome_notification;
+            welcome_notification.set_notification_id("welcome");
+            welcome_notification.set_topic("system");
+            welcome_notification.set_message("Welcome to ImageService notifications");
+            welcome_notification.set_notification_type("info");
+            welcome_notification.set_timestamp(std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count());
+            grpc::ByteBuffer payload;
+            bool own_buffer;
+            grpc::SerializationTraits<ServerNotification>::Serialize(welcome_notification, &payload, &own_buffer);
+            Offer(payload);
 
-                    imageservice::SegmentationResult grpc_result;
-                    grpc_result.set_request_id(request->image_id());
-                    grpc_result.set_status("completed");
-                    grpc_result.set_segmented_image(result.segmentation_result);
-                    grpc_result.set_result_format("raw");
+            StartRead(&read_buffer_);
+        }
 
-                    if (!writer->Write(grpc_result)) {
-                        return Status(grpc::StatusCode::INTERNAL, "Failed to write segmentation result");
+        // Queues a serialized notification; false if the stream did not take it
+        bool Offer(const grpc::ByteBuffer& payload) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (finished_) {
+                return false;
+            }
+            auto& metrics = agent_impl_->metrics_;
+            size_t queued = pending_.size() + (write_in_flight_ ? 1 : 0);
+            if (queued >= options_.max_queued_notifications) {
+                switch (options_.overflow_policy) {
+                case NotificationOverflowPolicy::DropOldest:
+                    if (pending_.empty()) {
+                        metrics.notifications_dropped.add(1);
+                        return false; // Only the write in flight is left, and it cannot be recalled
                     }
-                    agent_impl_->pending_segmentation_results_.pop_front();
-
-                    std::cout << "[AGENT] Segmentation result sent successfully" << std::endl;
+                    pending_.pop_front();
+                    metrics.notification_write_queue.add(-1);
+                    metrics.notifications_dropped.add(1);
+                    break;
+                case NotificationOverflowPolicy::DropNewest:
+                    metrics.notifications_dropped.add(1);
+                    return false;
+                case NotificationOverflowPolicy::Disconnect:
+                    AGENT_LOG_WARN("[AGENT] Disconnecting notification stream that fell "
+                                   << queued << " notifications behind");
+                    finishLocked(Status(grpc::StatusCode::RESOURCE_EXHAUSTED,
+                                        "Notification stream could not keep up"));
+                    return false;
                 }
+            }
+            if (pending_.empty()) {
+                first_pending_at_ = std::chrono::steady_clock::now();
+            }
+            pending_.push_back(payload);
+            metrics.notification_write_queue.add(1);
+            sendNextLocked();
+            return true;
+        }
 
-                return Status::OK;
-            } catch (const std::exception& e) {
-                std::cerr << "[AGENT] Segmentation error: " << e.what() << std::endl;
-                imageservice::SegmentationResult error_result;
-                error_result.set_request_id(request->image_id());
-                error_result.set_status("failed");
-                error_result.set_error_message(e.what());
-
-                writer->Write(error_result);
-                return Status(grpc::StatusCode::INTERNAL, "Segmentation failed: " + std::string(e.what()));
+        void OnWriteDone(bool ok) override {
+            std::lock_guard<std::mutex> lock(mutex_);
+            write_in_flight_ = false;
+            agent_impl_->metrics_.notification_write_queue.add(-static_cast<int64_t>(write_count_));
+            if (finished_) {
+                return;
+            }
+            if (!ok) {
+                finishLocked(Status(grpc::StatusCode::INTERNAL, "Failed to write notification"));
+                return;
             }
+            flushLocked();
+        }
+
+        // Ends the stream, e.g. when the server shuts down
+        void Close(const Status& status) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            finishLocked(status);
         }
 
-        Status subscribeToNotifications(ServerContext* context,
-                                       ServerReaderWriter<imageservice::ServerNotification, imageservice::SubscriptionRequest>* stream) override {
-            std::cout << "[AGENT] Notification subscription request received" << std::endl;
+        void OnCancel() override {
+            Close(Status::CANCELLED);
+        }
 
-            imageservice::SubscriptionRequest request;
-            while (stream->Read(&request)) {
-                std::cout << "[AGENT] Client " << request.client_name() << " subscribed to topics: ";
-                for (const auto& topic : request.topics()) {
-                    std::cout << topic << " ";
+        void OnDone() override {
+            // The alarm callback only holds a weak reference; the last shared one deletes the reactor
+            std::set<std::string> topics;
+            std::unique_ptr<grpc::Alarm> alarm;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                topics.swap(topics_);
+                alarm = std::move(alarm_);
+            }
+            alarm.reset(); // Cancels a pending alarm, outside the lock its callback takes
+            agent_impl_->unregisterNotificationStream(self_, topics);
+            auto& metrics = agent_impl_->metrics_;
+            metrics.notification_streams.add(-1);
+            metrics.notifications.callFinished(received_at_, ok_);
+            self_.reset(); // Publishers may still hold a reference; Offer is a no-op from here on
+        }
+
+    private:
+        // Writes what is pending: one notification, or on a batched stream up
+        // to batch_max_size_ of them in one message. A partial batch waits on
+        // the alarm until its oldest notification has lingered batch_linger_,
+        // unless the client has stopped reading and only a flush is left.
+        void sendNextLocked() {
+            if (write_in_flight_ || alarm_armed_ || pending_.empty()) {
+                return;
+            }
+            if (batch_max_size_ <= 1) {
+                write_buffer_ = std::move(pending_.front());
+                pending_.pop_front();
+                write_count_ = 1;
+            } else {
+                auto now = std::chrono::steady_clock::now();
+                auto send_at = first_pending_at_ + batch_linger_;
+                if (pending_.size() < batch_max_size_ && now < send_at && !reads_done_) {
+                    alarm_armed_ = true;
+                    // A fresh alarm each time: this may run inside the previous one's callback
+                    alarm_ = std::make_unique<grpc::Alarm>();
+                    std::weak_ptr<SubscribeReactor> weak_self = weak_from_this();
+                    alarm_->Set(std::chrono::system_clock::now() + (send_at - now), [weak_self](bool) {
+                        if (auto self = weak_self.lock()) {
+                            self->OnAlarm();
+                        }
+                    });
+                    return;
                 }
-                std::cout << std::endl;
-
-                // Send welcome notification
-                imageservice::ServerNotification welcome_notification;
-                welcome_notification.set_notification_id("welcome");
-                welcome_notification.set_topic("system");
-                welcome_notification.set_message("Welcome to ImageService notifications");
-                welcome_notification.set_notification_type("info");
-                welcome_notification.set_timestamp(std::chrono::duration_cast<std::chrono::milliseconds>(
-                    std::chrono::system_clock::now().time_since_epoch()).count());
-
-                if (!stream->Write(welcome_notification)) {
-                    return Status(grpc::StatusCode::INTERNAL, "Failed to write notification");
+
+                size_t count = 0;
+                size_t bytes = 0;
+                while (count < pending_.size() && count < batch_max_size_ &&
+                       (count == 0 || bytes + pending_[count].Length() <= kMaxBatchBytes)) {
+                    bytes += pending_[count++].Length();
                 }
+                serializeBatch(pending_, count, &write_buffer_);
+                pending_.erase(pending_.begin(), pending_.begin() + count);
+                write_count_ = count;
+                first_pending_at_ = now; // Leftovers start a new window
             }
+            write_in_flight_ = true;
+            agent_impl_->metrics_.notifications.messageSent(write_buffer_.Length());
+            StartWrite(&write_buffer_);
+        }
 
-            std::cout << "[AGENT] Client disconnected from notifications" << std::endl;
-            return Status::OK;
+        // Sends what is due and ends the stream once a client that stopped
+        // reading has been sent everything
+        void flushLocked() {
+            sendNextLocked();
+            if (!write_in_flight_ && !alarm_armed_ && reads_done_ && !finished_) {
+                finishLocked(Status::OK);
+            }
+        }
+
+        void OnAlarm() {
+            std::lock_guard<std::mutex> lock(mutex_);
+            alarm_armed_ = false;
+            if (!finished_) {
+                flushLocked();
+            }
+        }
+
+        void finishLocked(const Status& status) {
+            if (!finished_) {
+                finished_ = true;
+                ok_ = status.ok();
+                agent_impl_->metrics_.notification_write_queue.add(-static_cast<int64_t>(pending_.size()));
+                pending_.clear();
+                Finish(status);
+            }
+        }
+
+        Impl* agent_impl_;
+        const NotificationOptions options_;
+        const std::chrono::steady_clock::time_point received_at_;
+        std::shared_ptr<SubscribeReactor> self_; // Keeps the reactor alive until OnDone
+        grpc::ByteBuffer read_buffer_;
+
+        std::mutex mutex_;
+        std::set<std::string> topics_;         // Subscribed topics, as registered with the agent
+        std::deque<grpc::ByteBuffer> pending_; // Oldest first
+        std::chrono::steady_clock::time_point first_pending_at_; // When pending_ last became non-empty
+        grpc::ByteBuffer write_buffer_;        // The write in flight
+        size_t write_count_ = 0;               // Notifications in the write in flight
+        size_t batch_max_size_ = 1;            // Notifications per message, as the client asked
+        std::chrono::steady_clock::duration batch_linger_{0};
+        std::unique_ptr<grpc::Alarm> alarm_;   // Fires when a partial batch has lingered long enough
+        bool alarm_armed_ = false;
+        bool write_in_flight_ = false;
+        bool reads_done_ = false;
+        bool finished_ = false;
+        bool ok_ = false;
+    };
+
+    // subscribeToNotifications is a raw method so that a published notification
+    // is serialized once for all of its streams. CallbackService cannot be the
+    // base: its typed bidi handler has the same signature as the raw one.
+    using ImageServiceBase = ImageService::WithCallbackMethod_GetImage<
+        ImageService::WithCallbackMethod_doSegmentation<
+            ImageService::WithRawCallbackMethod_subscribeToNotifications<
+                ImageService::WithCallbackMethod_GetStats<ImageService::Service>>>>;
+
+    class ImageServiceImpl final : public ImageServiceBase {
+    public:
+        ImageServiceImpl(Impl* agent_impl) : agent_impl_(agent_impl) {
+            // Unary requests and responses are built on pooled arenas
+            SetMessageAllocatorFor_GetImage(&get_image_allocator_);
+            SetMessageAllocatorFor_GetStats(&stats_allocator_);
+        }
+
+        ServerUnaryReactor* GetImage(CallbackServerContext* context, const GetImageRequest* request,
+                                     imageservice::ImageData* response) override {
+            AGENT_LOG_DEBUG("[AGENT] GetImage request received for image_id: " << request->image_id());
+            common::applyRequestedCompression(context);
+
+            return new GetImageReactor(agent_impl_, request, response);
+        }
+
+        ServerWriteReactor<imageservice::SegmentationResult>* doSegmentation(CallbackServerContext* context,
+                                                               const imageservice::SegmentationRequest* request) override {
+            AGENT_LOG_DEBUG("[AGENT] doSegmentation request received for image_id: " << request->image_id()
+                            << ", type: " << request->segmentation_type());
+            common::applyRequestedCompression(context);
+
+            return new DoSegmentationReactor(agent_impl_, request);
+        }
+
+        ServerBidiReactor<grpc::ByteBuffer, grpc::ByteBuffer>* subscribeToNotifications(
+            CallbackServerContext* context) override {
+            AGENT_LOG_INFO("[AGENT] Notification subscription request received");
+            common::applyRequestedCompression(context);
+
+            auto reactor = std::make_shared<SubscribeReactor>(agent_impl_);
+            reactor->Start();
+            return reactor.get();
+        }
+
+        ServerUnaryReactor* GetStats(CallbackServerContext* context, const imageservice::StatsRequest* /*request*/,
+                                     imageservice::StatsReply* response) override {
+            common::applyRequestedCompression(context);
+            common::fillStatsReply(agent_impl_->metrics_.registry.snapshot(), response);
+
+            auto* reactor = context->DefaultReactor();
+            reactor->Finish(Status::OK);
+            return reactor;
         }
 
     private:
         Impl* agent_impl_;
+        common::ArenaMessageAllocator<GetImageRequest, imageservice::ImageData> get_image_allocator_;
+        common::ArenaMessageAllocator<imageservice::StatsRequest, imageservice::StatsReply> stats_allocator_;
     };
 
+    AgentMetrics metrics_; // First member: outlives every reactor that records into it
     std::weak_ptr<IImageServiceListener> listener_;
     std::thread server_thread_;
     std::atomic<bool> stop_server_;
+    const NotificationOptions notification_options_;
+    const common::ServerConfig server_config_;
+    const std::vector<std::string> listen_addresses_;
+    FrameCache frame_cache_;
+    std::unique_ptr<common::SharedFrameRing> frame_ring_; // Opt-in shared-memory transport for GetImage
+    std::unique_ptr<Server> server_; // Store server reference for shutdown
+    std::mutex server_mutex_; // Protect server access
+
+    // Completion table: in-flight segmentation jobs keyed by request ID, plus an
+    // index by request content used to coalesce identical requests
+    std::atomic<uint64_t> next_request_id_{1};
+    std::mutex segmentation_mutex_;
+    std::unordered_map<uint64_t, SegmentationJob> in_flight_segmentations_;
+    std::unordered_map<std::string, uint64_t> segmentations_by_key_;
 
-    // Segmentation results queue
-    std::mutex segmentation_results_mutex_;
-    std::condition_variable segmentation_results_cv_;
-    std::deque<SegmentationResult> pending_segmentation_results_;
+    // Notification broker: subscribed streams by topic filter, plus every open stream
+    std::atomic<uint64_t> next_notification_id_{1};
+    std::mutex subscribers_mutex_;
+    SubscriptionTrie subscriptions_;
+    std::set<SubscribeReactor*> notification_streams_;
 };
 
 // Public interface implementation
-ImageServiceAgent::ImageServiceAgent(std::weak_ptr<IImageServiceListener> listener)
-    : mImpl(std::make_unique<Impl>(listener)) {
-    std::cout << "[AGENT] ImageServiceAgent created" << std::endl;
+ImageServiceAgent::ImageServiceAgent(std::weak_ptr<IImageServiceListener> listener,
+                                     std::chrono::milliseconds frame_max_age,
+                                     const NotificationOptions& notification_options,
+                                     const common::ServerConfig& server_config)
+    : mImpl(std::make_unique<Impl>(listener, frame_max_age, notification_options, server_config)) {
+    AGENT_LOG_INFO("[AGENT] ImageServiceAgent created");
 }
 
 ImageServiceAgent::~ImageServiceAgent() {
-    std::cout << "[AGENT] ImageServiceAgent destroyed" << std::endl;
+    AGENT_LOG_INFO("[AGENT] ImageServiceAgent destroyed");
+}
+
+void ImageServiceAgent::sendSegmentationResult(uint64_t request_id, const SegmentationResult& segmentation_result) {
+    mImpl->sendSegmentationResult(request_id, segmentation_result);
+}
+
+size_t ImageServiceAgent::publishNotification(const std::string& topic, const Notification& notification) {
+    return mImpl->publishNotification(topic, notification);
 }
 
-void ImageServiceAgent::sendSegmentationResult(const SegmentationResult& segmentation_result) {
-    mImpl->sendSegmentationResult(segmentation_result);
+void ImageServiceAgent::enableMetricsDump(const std::string& path, std::chrono::milliseconds interval) {
+    mImpl->enableMetricsDump(path, interval);
 }
 
-} // namespace vision
\ No newline at end of file
+} // namespace vision
@@ -1,4 +1,9 @@
 #pragma once
+#include "ServerConfig.h"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <map>
 #include <memory>
 #include <string>
 
@@ -8,23 +13,71 @@ struct ImageData {
     std::string image_type;
 };
 
+struct SegmentationRequest {
+    uint64_t request_id; // Pass back to sendSegmentationResult
+    std::string image_id;
+    std::string segmentation_type;
+    std::map<std::string, std::string> parameters;
+    int priority; // Higher runs first when the listener is busy
+};
+
 struct SegmentationResult {
     std::string segmentation_result;
 };
 
+// Published to the subscribeToNotifications streams subscribed to its topic
+struct Notification {
+    std::string message;
+    std::string notification_type = "info"; // "info", "warning", "error", "update"
+    std::map<std::string, std::string> metadata;
+    std::string data; // Optional binary payload
+};
+
+// What a notification stream does when its outbound queue is full
+enum class NotificationOverflowPolicy {
+    DropOldest, // Discard the oldest queued notification: a slow stream samples the newest ones
+    DropNewest, // Discard the incoming notification: a slow stream keeps what it has queued
+    Disconnect  // End the slow stream with RESOURCE_EXHAUSTED
+};
+
+struct NotificationOptions {
+    size_t max_queued_notifications = 64; // Per stream, including the write in flight
+    NotificationOverflowPolicy overflow_policy = NotificationOverflowPolicy::DropOldest;
+};
+
 class ImageServiceAgent {
 public:
     class IImageServiceListener {
     public:
         virtual ~IImageServiceListener() = default;
-        virtual void onDoSegmentation() = 0;
+        // Return false to reject the request (e.g. the work queue is full); the
+        // caller then gets RESOURCE_EXHAUSTED and no result is expected.
+        virtual bool onDoSegmentation(const SegmentationRequest& request) = 0;
         virtual ImageData onGetImage() = 0;
     };
 
-    ImageServiceAgent(std::weak_ptr<IImageServiceListener> listener);
+    // GetImage calls reuse the last frame for up to frame_max_age (one frame at
+    // 30 Hz by default); zero only coalesces calls that overlap a capture. The
+    // server listens on unix:///tmp/image_service.sock unless server_config
+    // names another address.
+    ImageServiceAgent(std::weak_ptr<IImageServiceListener> listener,
+                      std::chrono::milliseconds frame_max_age = std::chrono::milliseconds(33),
+                      const NotificationOptions& notification_options = NotificationOptions(),
+                      const common::ServerConfig& server_config = common::ServerConfig());
     ~ImageServiceAgent();
 
-    void sendSegmentationResult(const SegmentationResult& segmentation_result);
+    // Routes the result to the call that issued request_id
+    void sendSegmentationResult(uint64_t request_id, const SegmentationResult& segmentation_result);
+
+    // Sends the notification to every stream with a filter matching topic,
+    // e.g. "camera/head/exposure" (no wildcards). It is serialized once and
+    // queued on each stream without waiting for any of them; streams that
+    // fall behind are handled by the overflow policy. Returns the number of
+    // streams it was queued on.
+    size_t publishNotification(const std::string& topic, const Notification& notification);
+
+    // Periodically writes the metrics served by GetStats to path as JSON
+    void enableMetricsDump(const std::string& path, std::chrono::milliseconds interval);
 
 private:
     struct Impl;
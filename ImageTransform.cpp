@@ -0,0 +1,344 @@
+#include "ImageTransform.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define IMAGE_TRANSFORM_X86 1
+#endif
+
+namespace common {
+
+namespace {
+
+// --- Scalar kernels: the reference every SIMD kernel must match ---
+
+inline uint8_t lumaOf(uint32_t r, uint32_t g, uint32_t b) {
+    return static_cast<uint8_t>((r * 77 + g * 150 + b * 29 + 128) >> 8);
+}
+
+void rgbToGrayRowScalar(const uint8_t* rgb, uint8_t* gray, size_t pixels) {
+    for (size_t i = 0; i < pixels; ++i) {
+        gray[i] = lumaOf(rgb[3 * i], rgb[3 * i + 1], rgb[3 * i + 2]);
+    }
+}
+
+void grayToRgbRowScalar(const uint8_t* gray, uint8_t* rgb, size_t pixels) {
+    for (size_t i = 0; i < pixels; ++i, rgb += 3) {
+        rgb[0] = rgb[1] = rgb[2] = gray[i];
+    }
+}
+
+// Adds a row of bytes into 16-bit column sums
+void accumulateRowScalar(const uint8_t* row, uint16_t* sums, size_t bytes) {
+    for (size_t i = 0; i < bytes; ++i) {
+        sums[i] = static_cast<uint16_t>(sums[i] + row[i]);
+    }
+}
+
+// Blends two rows into 16-bit sums top * (256 - weight) + bottom * weight; at
+// most 255 * 256, so every sum fits
+void blendRowsScalar(const uint8_t* top, const uint8_t* bottom, uint32_t weight, uint16_t* out, size_t bytes) {
+    for (size_t i = 0; i < bytes; ++i) {
+        out[i] = static_cast<uint16_t>(top[i] * (256 - weight) + bottom[i] * weight);
+    }
+}
+
+#ifdef IMAGE_TRANSFORM_X86
+
+// Eight 16-bit R, G and B lanes to luma, matching lumaOf()
+__attribute__((target("sse2"))) inline __m128i lumaSse2(__m128i r, __m128i g, __m128i b) {
+    __m128i sum = _mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(77)), _mm_mullo_epi16(g, _mm_set1_epi16(150)));
+    sum = _mm_add_epi16(sum, _mm_mullo_epi16(b, _mm_set1_epi16(29)));
+    return _mm_srli_epi16(_mm_add_epi16(sum, _mm_set1_epi16(128)), 8); // At most 65408: no overflow
+}
+
+// 16 pixels per step: three shuffles per channel pull R, G and B out of the 48
+// interleaved bytes, then the weighted sum runs in 16-bit lanes
+__attribute__((target("ssse3"))) void rgbToGrayRowSsse3(const uint8_t* rgb, uint8_t* gray, size_t pixels) {
+    const __m128i r0 = _mm_setr_epi8(0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m128i r1 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14, -1, -1, -1, -1, -1);
+    const __m128i r2 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, 4, 7, 10, 13);
+    const __m128i g0 = _mm_setr_epi8(1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m128i g1 = _mm_setr_epi8(-1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1);
+    const __m128i g2 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14);
+    const __m128i b0 = _mm_setr_epi8(2, 5, 8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m128i b1 = _mm_setr_epi8(-1, -1, -1, -1, -1, 1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1);
+    const __m128i b2 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15);
+    const __m128i zero = _mm_setzero_si128();
+
+    size_t i = 0;
+    for (; i + 16 <= pixels; i += 16) {
+        const uint8_t* p = rgb + 3 * i;
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16));
+        __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 32));
+        __m128i red = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a, r0), _mm_shuffle_epi8(b, r1)),
+                                   _mm_shuffle_epi8(c, r2));
+        __m128i green = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a, g0), _mm_shuffle_epi8(b, g1)),
+                                     _mm_shuffle_epi8(c, g2));
+        __m128i blue = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a, b0), _mm_shuffle_epi8(b, b1)),
+                                    _mm_shuffle_epi8(c, b2));
+        __m128i low = lumaSse2(_mm_unpacklo_epi8(red, zero), _mm_unpacklo_epi8(green, zero),
+                               _mm_unpacklo_epi8(blue, zero));
+        __m128i high = lumaSse2(_mm_unpackhi_epi8(red, zero), _mm_unpackhi_epi8(green, zero),
+                                _mm_unpackhi_epi8(blue, zero));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(gray + i), _mm_packus_epi16(low, high));
+    }
+    rgbToGrayRowScalar(rgb + 3 * i, gray + i, pixels - i);
+}
+
+// 16 pixels per step: each output register repeats five or six gray bytes
+__attribute__((target("ssse3"))) void grayToRgbRowSsse3(const uint8_t* gray, uint8_t* rgb, size_t pixels) {
+    const __m128i first = _mm_setr_epi8(0, 0, 0, 1, 1, 1, 2, 2, 2, 3, 3, 3, 4, 4, 4, 5);
+    const __m128i second = _mm_setr_epi8(5, 5, 6, 6, 6, 7, 7, 7, 8, 8, 8, 9, 9, 9, 10, 10);
+    const __m128i third = _mm_setr_epi8(10, 11, 11, 11, 12, 12, 12, 13, 13, 13, 14, 14, 14, 15, 15, 15);
+
+    size_t i = 0;
+    for (; i + 16 <= pixels; i += 16) {
+        __m128i values = _mm_loadu_si128(reinterpret_cast<const __m128i*>(gray + i));
+        auto* out = reinterpret_cast<__m128i*>(rgb + 3 * i);
+        _mm_storeu_si128(out, _mm_shuffle_epi8(values, first));
+        _mm_storeu_si128(out + 1, _mm_shuffle_epi8(values, second));
+        _mm_storeu_si128(out + 2, _mm_shuffle_epi8(values, third));
+    }
+    grayToRgbRowScalar(gray + i, rgb + 3 * i, pixels - i);
+}
+
+__attribute__((target("sse2"))) void accumulateRowSse2(const uint8_t* row, uint16_t* sums, size_t bytes) {
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 16 <= bytes; i += 16) {
+        __m128i values = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i));
+        auto* out = reinterpret_cast<__m128i*>(sums + i);
+        _mm_storeu_si128(out, _mm_add_epi16(_mm_loadu_si128(out), _mm_unpacklo_epi8(values, zero)));
+        _mm_storeu_si128(out + 1, _mm_add_epi16(_mm_loadu_si128(out + 1), _mm_unpackhi_epi8(values, zero)));
+    }
+    accumulateRowScalar(row + i, sums + i, bytes - i);
+}
+
+__attribute__((target("avx2"))) void accumulateRowAvx2(const uint8_t* row, uint16_t* sums, size_t bytes) {
+    size_t i = 0;
+    for (; i + 32 <= bytes; i += 32) {
+        __m256i low = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i)));
+        __m256i high = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i + 16)));
+        auto* out = reinterpret_cast<__m256i*>(sums + i);
+        _mm256_storeu_si256(out, _mm256_add_epi16(_mm256_loadu_si256(out), low));
+        _mm256_storeu_si256(out + 1, _mm256_add_epi16(_mm256_loadu_si256(out + 1), high));
+    }
+    accumulateRowScalar(row + i, sums + i, bytes - i);
+}
+
+__attribute__((target("sse2"))) void blendRowsSse2(const uint8_t* top, const uint8_t* bottom, uint32_t weight,
+                                                    uint16_t* out, size_t bytes) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i top_weight = _mm_set1_epi16(static_cast<int16_t>(256 - weight));
+    const __m128i bottom_weight = _mm_set1_epi16(static_cast<int16_t>(weight));
+    size_t i = 0;
+    for (; i + 16 <= bytes; i += 16) {
+        __m128i upper = _mm_loadu_si128(reinterpret_cast<const __m128i*>(top + i));
+        __m128i lower = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bottom + i));
+        __m128i low = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(upper, zero), top_weight),
+                                    _mm_mullo_epi16(_mm_unpacklo_epi8(lower, zero), bottom_weight));
+        __m128i high = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(upper, zero), top_weight),
+                                     _mm_mullo_epi16(_mm_unpackhi_epi8(lower, zero), bottom_weight));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), low);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i + 8), high);
+    }
+    blendRowsScalar(top + i, bottom + i, weight, out + i, bytes - i);
+}
+
+__attribute__((target("avx2"))) void blendRowsAvx2(const uint8_t* top, const uint8_t* bottom, uint32_t weight,
+                                                   uint16_t* out, size_t bytes) {
+    const __m256i top_weight = _mm256_set1_epi16(static_cast<int16_t>(256 - weight));
+    const __m256i bottom_weight = _mm256_set1_epi16(static_cast<int16_t>(weight));
+    size_t i = 0;
+    for (; i + 16 <= bytes; i += 16) {
+        __m256i upper = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(top + i)));
+        __m256i lower = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(bottom + i)));
+        __m256i sum = _mm256_add_epi16(_mm256_mullo_epi16(upper, top_weight), _mm256_mullo_epi16(lower, bottom_weight));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), sum);
+    }
+    blendRowsScalar(top + i, bottom + i, weight, out + i, bytes - i);
+}
+
+#endif // IMAGE_TRANSFORM_X86
+
+struct Kernels {
+    void (*rgb_to_gray_row)(const uint8_t* rgb, uint8_t* gray, size_t pixels);
+    void (*gray_to_rgb_row)(const uint8_t* gray, uint8_t* rgb, size_t pixels);
+    void (*accumulate_row)(const uint8_t* row, uint16_t* sums, size_t bytes);
+    void (*blend_rows)(const uint8_t* top, const uint8_t* bottom, uint32_t weight, uint16_t* out, size_t bytes);
+    const char* name;
+};
+
+Kernels selectKernels() {
+#ifdef IMAGE_TRANSFORM_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return {rgbToGrayRowSsse3, grayToRgbRowSsse3, accumulateRowAvx2, blendRowsAvx2, "avx2"};
+    }
+    if (__builtin_cpu_supports("ssse3")) {
+        return {rgbToGrayRowSsse3, grayToRgbRowSsse3, accumulateRowSse2, blendRowsSse2, "ssse3"};
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return {rgbToGrayRowScalar, grayToRgbRowScalar, accumulateRowSse2, blendRowsSse2, "sse2"};
+    }
+#endif
+    return {rgbToGrayRowScalar, grayToRgbRowScalar, accumulateRowScalar, blendRowsScalar, "scalar"};
+}
+
+const Kernels& kernels() {
+    static const Kernels selected = selectKernels();
+    return selected;
+}
+
+// Rows summed into 16-bit column sums before they are folded into 32-bit
+// block sums: 257 * 255 is the most a uint16_t holds
+constexpr int kMaxRowsPerPass = 257;
+
+void boxDownscale(const ImageView& src, int dst_width, int dst_height, uint8_t* dst) {
+    const Kernels& k = kernels();
+    const int fx = src.width / dst_width;
+    const int fy = src.height / dst_height;
+    const int channels = src.channels;
+    const size_t row_bytes = static_cast<size_t>(src.width) * channels;
+    const uint32_t area = static_cast<uint32_t>(fx) * fy;
+
+    std::vector<uint16_t> column_sums(row_bytes);
+    std::vector<uint32_t> block_sums(static_cast<size_t>(dst_width) * channels);
+    for (int y = 0; y < dst_height; ++y) {
+        std::fill(block_sums.begin(), block_sums.end(), 0);
+        for (int first = 0; first < fy; first += kMaxRowsPerPass) {
+            int rows = std::min(kMaxRowsPerPass, fy - first);
+            std::fill(column_sums.begin(), column_sums.end(), 0);
+            for (int r = 0; r < rows; ++r) {
+                k.accumulate_row(src.data + static_cast<size_t>(y * fy + first + r) * src.stride, column_sums.data(),
+                                 row_bytes);
+            }
+            // Horizontal pass: fx pixels per block, channel by channel
+            const uint16_t* column = column_sums.data();
+            uint32_t* block = block_sums.data();
+            for (int x = 0; x < dst_width; ++x, block += channels) {
+                for (int j = 0; j < fx; ++j, column += channels) {
+                    for (int c = 0; c < channels; ++c) {
+                        block[c] += column[c];
+                    }
+                }
+            }
+        }
+
+        uint8_t* out = dst + static_cast<size_t>(y) * dst_width * channels;
+        for (size_t i = 0; i < block_sums.size(); ++i) {
+            out[i] = static_cast<uint8_t>((block_sums[i] + area / 2) / area);
+        }
+    }
+}
+
+// Pixel-centre aligned source positions: left/top neighbour and the weight of
+// the right/bottom one, in 1/256
+struct Taps {
+    std::vector<int> first;
+    std::vector<int> second;
+    std::vector<uint32_t> weight;
+};
+
+Taps bilinearTaps(int src_size, int dst_size) {
+    Taps taps;
+    taps.first.resize(dst_size);
+    taps.second.resize(dst_size);
+    taps.weight.resize(dst_size);
+    double scale = static_cast<double>(src_size) / dst_size;
+    for (int i = 0; i < dst_size; ++i) {
+        double position = std::clamp((i + 0.5) * scale - 0.5, 0.0, static_cast<double>(src_size - 1));
+        int first = static_cast<int>(position);
+        taps.first[i] = first;
+        taps.second[i] = std::min(first + 1, src_size - 1);
+        taps.weight[i] = static_cast<uint32_t>(std::lround((position - first) * 256));
+    }
+    return taps;
+}
+
+// Vertical blend of the two source rows first, with SIMD, then the horizontal
+// taps per output pixel. Splitting the blend this way gives exactly the same
+// integer result as blending each 2x2 neighbourhood at once.
+void bilinearDownscale(const ImageView& src, int dst_width, int dst_height, uint8_t* dst) {
+    const Kernels& k = kernels();
+    const int channels = src.channels;
+    const size_t row_bytes = static_cast<size_t>(src.width) * channels;
+    Taps columns = bilinearTaps(src.width, dst_width);
+    Taps rows = bilinearTaps(src.height, dst_height);
+    for (size_t x = 0; x < columns.first.size(); ++x) {
+        columns.first[x] *= channels;
+        columns.second[x] *= channels;
+    }
+
+    std::vector<uint16_t> blended(row_bytes);
+    for (int y = 0; y < dst_height; ++y) {
+        const uint8_t* top = src.data + static_cast<size_t>(rows.first[y]) * src.stride;
+        const uint8_t* bottom = src.data + static_cast<size_t>(rows.second[y]) * src.stride;
+        k.blend_rows(top, bottom, rows.weight[y], blended.data(), row_bytes);
+        uint8_t* out = dst + static_cast<size_t>(y) * dst_width * channels;
+        for (int x = 0; x < dst_width; ++x) {
+            const uint16_t* left = blended.data() + columns.first[x];
+            const uint16_t* right = blended.data() + columns.second[x];
+            const uint32_t wx = columns.weight[x];
+            for (int c = 0; c < channels; ++c) {
+                *out++ = static_cast<uint8_t>((left[c] * (256 - wx) + right[c] * wx + (1u << 15)) >> 16);
+            }
+        }
+    }
+}
+
+} // namespace
+
+void copyImage(const ImageView& src, uint8_t* dst) {
+    const size_t row_bytes = static_cast<size_t>(src.width) * src.channels;
+    if (src.stride == row_bytes) {
+        std::memcpy(dst, src.data, row_bytes * src.height);
+        return;
+    }
+    for (int y = 0; y < src.height; ++y) {
+        std::memcpy(dst + y * row_bytes, src.data + y * src.stride, row_bytes);
+    }
+}
+
+void rgbToGray(const ImageView& rgb, uint8_t* gray) {
+    const Kernels& k = kernels();
+    if (rgb.stride == static_cast<size_t>(rgb.width) * 3) {
+        k.rgb_to_gray_row(rgb.data, gray, static_cast<size_t>(rgb.width) * rgb.height);
+        return;
+    }
+    for (int y = 0; y < rgb.height; ++y) {
+        k.rgb_to_gray_row(rgb.data + y * rgb.stride, gray + static_cast<size_t>(y) * rgb.width, rgb.width);
+    }
+}
+
+void grayToRgb(const ImageView& gray, uint8_t* rgb) {
+    const Kernels& k = kernels();
+    if (gray.stride == static_cast<size_t>(gray.width)) {
+        k.gray_to_rgb_row(gray.data, rgb, static_cast<size_t>(gray.width) * gray.height);
+        return;
+    }
+    for (int y = 0; y < gray.height; ++y) {
+        k.gray_to_rgb_row(gray.data + y * gray.stride, rgb + static_cast<size_t>(y) * gray.width * 3, gray.width);
+    }
+}
+
+void downscaleImage(const ImageView& src, int dst_width, int dst_height, uint8_t* dst) {
+    if (dst_width == src.width && dst_height == src.height) {
+        copyImage(src, dst);
+    } else if (src.width % dst_width == 0 && src.height % dst_height == 0) {
+        boxDownscale(src, dst_width, dst_height, dst);
+    } else {
+        bilinearDownscale(src, dst_width, dst_height, dst);
+    }
+}
+
+const char* imageKernelName() {
+    return kernels().name;
+}
+
+} // namespace common
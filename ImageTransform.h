@@ -0,0 +1,52 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+namespace common {
+
+// 8-bit interleaved image in memory owned by someone else: 1 channel for gray,
+// 3 for RGB. Rows are stride bytes apart, so a crop is just a narrower view.
+struct ImageView {
+    const uint8_t* data = nullptr;
+    int width = 0;
+    int height = 0;
+    int channels = 1;
+    size_t stride = 0; // Bytes from one row to the next
+
+    static ImageView dense(const uint8_t* data, int width, int height, int channels) {
+        return {data, width, height, channels, static_cast<size_t>(width) * channels};
+    }
+
+    // The width x height region at (x, y); the caller keeps it inside the image
+    ImageView crop(int x, int y, int crop_width, int crop_height) const {
+        return {data + y * stride + static_cast<size_t>(x) * channels, crop_width, crop_height, channels, stride};
+    }
+
+    size_t denseSize() const { return static_cast<size_t>(width) * height * channels; }
+};
+
+// Transforms below write a dense image to dst and pick SIMD kernels for the
+// running CPU (AVX2, SSSE3 or SSE2 on x86-64) once, falling back to scalar
+// code elsewhere. Every kernel produces exactly the scalar result. The color
+// conversions and the row passes of both downscales (the box filter's row
+// sums and the bilinear vertical blend) are vectorized; the horizontal passes
+// gather scattered source columns and stay scalar.
+
+// Copies the view, e.g. a crop, into dense rows
+void copyImage(const ImageView& src, uint8_t* dst);
+
+// RGB to luma with BT.601 weights (77, 150, 29) / 256
+void rgbToGray(const ImageView& rgb, uint8_t* gray);
+
+// Gray replicated into three channels
+void grayToRgb(const ImageView& gray, uint8_t* rgb);
+
+// Shrinks src to dst_width x dst_height (each no larger than the source).
+// Sizes that divide evenly are area-averaged (box filter); other ratios are
+// interpolated bilinearly.
+void downscaleImage(const ImageView& src, int dst_width, int dst_height, uint8_t* dst);
+
+// Kernel set in use: "avx2", "ssse3", "sse2" or "scalar"
+const char* imageKernelName();
+
+} // namespace common
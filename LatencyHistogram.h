@@ -0,0 +1,140 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+namespace common {
+
+// Fixed-size log-linear latency histogram.
+//
+// Values (nanoseconds) are bucketed by power of two, each power split into
+// kSubBuckets linear sub-buckets, so any reported percentile is within ~3% of
+// the recorded value from 1 ns up to ~18 minutes. Recording is a few relaxed
+// atomic increments and never allocates, so one histogram can be shared by many
+// threads; snapshots taken while recording are approximate.
+class LatencyHistogram {
+public:
+    LatencyHistogram() { reset(); }
+
+    LatencyHistogram(const LatencyHistogram&) = delete;
+    LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+
+    void record(uint64_t nanos) {
+        counts_[bucketIndex(nanos)].fetch_add(1, std::memory_order_relaxed);
+        count_.fetch_add(1, std::memory_order_relaxed);
+        sum_.fetch_add(nanos, std::memory_order_relaxed);
+
+        uint64_t current = min_.load(std::memory_order_relaxed);
+        while (nanos < current && !min_.compare_exchange_weak(current, nanos, std::memory_order_relaxed)) {
+        }
+        current = max_.load(std::memory_order_relaxed);
+        while (nanos > current && !max_.compare_exchange_weak(current, nanos, std::memory_order_relaxed)) {
+        }
+    }
+
+    void merge(const LatencyHistogram& other) {
+        for (size_t i = 0; i < kBucketCount; ++i) {
+            uint64_t count = other.counts_[i].load(std::memory_order_relaxed);
+            if (count) {
+                counts_[i].fetch_add(count, std::memory_order_relaxed);
+            }
+        }
+        count_.fetch_add(other.count(), std::memory_order_relaxed);
+        sum_.fetch_add(other.sum_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        if (other.count()) {
+            uint64_t other_min = other.min();
+            uint64_t current = min_.load(std::memory_order_relaxed);
+            while (other_min < current && !min_.compare_exchange_weak(current, other_min, std::memory_order_relaxed)) {
+            }
+            uint64_t other_max = other.max();
+            current = max_.load(std::memory_order_relaxed);
+            while (other_max > current && !max_.compare_exchange_weak(current, other_max, std::memory_order_relaxed)) {
+            }
+        }
+    }
+
+    void reset() {
+        for (auto& count : counts_) {
+            count.store(0, std::memory_order_relaxed);
+        }
+        count_.store(0, std::memory_order_relaxed);
+        sum_.store(0, std::memory_order_relaxed);
+        min_.store(std::numeric_limits<uint64_t>::max(), std::memory_order_relaxed);
+        max_.store(0, std::memory_order_relaxed);
+    }
+
+    uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+    uint64_t min() const { return count() ? min_.load(std::memory_order_relaxed) : 0; }
+    uint64_t max() const { return max_.load(std::memory_order_relaxed); }
+
+    double mean() const {
+        uint64_t count = this->count();
+        return count ? static_cast<double>(sum_.load(std::memory_order_relaxed)) / count : 0.0;
+    }
+
+    // quantile in [0, 1], e.g. 0.99 for p99; 0 if nothing was recorded
+    uint64_t percentile(double quantile) const {
+        uint64_t count = this->count();
+        if (count == 0) {
+            return 0;
+        }
+        uint64_t rank = static_cast<uint64_t>(std::clamp(quantile, 0.0, 1.0) * (count - 1)) + 1;
+        uint64_t seen = 0;
+        for (size_t i = 0; i < kBucketCount; ++i) {
+            seen += counts_[i].load(std::memory_order_relaxed);
+            if (seen >= rank) {
+                return std::clamp(bucketValue(i), min(), max());
+            }
+        }
+        return max();
+    }
+
+private:
+    static constexpr int kSubBucketBits = 5;
+    static constexpr uint64_t kSubBuckets = 1u << kSubBucketBits;
+    static constexpr int kMaxExponent = 40; // 2^40 ns ~ 18 minutes
+    static constexpr size_t kBucketCount = kSubBuckets + (kMaxExponent - kSubBucketBits) * kSubBuckets;
+
+    static int highestBit(uint64_t value) {
+        int bit = 0;
+        while (value >>= 1) {
+            ++bit;
+        }
+        return bit;
+    }
+
+    static size_t bucketIndex(uint64_t value) {
+        if (value < kSubBuckets) {
+            return static_cast<size_t>(value);
+        }
+        int exponent = highestBit(value);
+        if (exponent >= kMaxExponent) {
+            return kBucketCount - 1;
+        }
+        int shift = exponent - kSubBucketBits;
+        uint64_t sub_bucket = (value >> shift) - kSubBuckets;
+        return kSubBuckets + shift * kSubBuckets + sub_bucket;
+    }
+
+    // Midpoint of the bucket's value range
+    static uint64_t bucketValue(size_t index) {
+        if (index < kSubBuckets) {
+            return index;
+        }
+        size_t shift = (index - kSubBuckets) / kSubBuckets;
+        uint64_t sub_bucket = (index - kSubBuckets) % kSubBuckets;
+        uint64_t low = (kSubBuckets + sub_bucket) << shift;
+        return low + ((uint64_t{1} << shift) >> 1);
+    }
+
+    std::array<std::atomic<uint64_t>, kBucketCount> counts_;
+    std::atomic<uint64_t> count_;
+    std::atomic<uint64_t> sum_;
+    std::atomic<uint64_t> min_;
+    std::atomic<uint64_t> max_;
+};
+
+} // namespace common
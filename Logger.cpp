@@ -0,0 +1,261 @@
+#include "Logger.h"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <streambuf>
+#include <thread>
+#include <vector>
+
+namespace common {
+
+namespace detail {
+
+std::atomic<int> g_log_level{static_cast<int>(LogLevel::Info)};
+
+namespace {
+
+constexpr size_t kSlotSize = 256;  // Bytes per line, including the newline
+constexpr size_t kRingSlots = 512; // Lines buffered per thread
+constexpr auto kDrainInterval = std::chrono::milliseconds(2);
+
+std::atomic<uint64_t> g_next_sequence{0};
+
+struct Slot {
+    uint64_t sequence; // Process-wide, so lines from different threads drain in order
+    LogLevel level;
+    uint32_t length;
+    char text[kSlotSize];
+};
+
+// Writes into a fixed buffer; once it is full further output fails, which sets
+// badbit on the stream and cuts the remaining formatting short.
+class SlotBuffer : public std::streambuf {
+public:
+    void reset(char* begin, size_t capacity) { setp(begin, begin + capacity); }
+    size_t written() const { return static_cast<size_t>(pptr() - pbase()); }
+};
+
+} // namespace
+
+struct ThreadLog {
+    // Single producer (the owning thread), single consumer (the drain thread)
+    std::array<Slot, kRingSlots> slots;
+    alignas(64) std::atomic<uint64_t> head{0};
+    alignas(64) std::atomic<uint64_t> tail{0};
+    std::atomic<uint64_t> dropped{0};
+    std::atomic<bool> orphaned{false};
+
+    SlotBuffer buffer;
+    std::ostream stream{&buffer};
+    std::ios::fmtflags default_flags = stream.flags();
+    std::streamsize default_precision = stream.precision();
+    Slot* current = nullptr;
+};
+
+namespace {
+
+class LogDrain {
+public:
+    static LogDrain& instance() {
+        // Leaked on purpose: lines may still be logged from static destructors
+        static LogDrain* drain = new LogDrain();
+        return *drain;
+    }
+
+    void add(std::shared_ptr<ThreadLog> log) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        logs_.push_back(std::move(log));
+    }
+
+    void flush() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        uint64_t request = ++flush_requested_;
+        cv_.notify_all();
+        done_cv_.wait(lock, [this, request]() { return flush_completed_ >= request; });
+    }
+
+private:
+    LogDrain() {
+        thread_ = std::thread([this]() { run(); });
+        thread_.detach();
+        std::atexit([]() { LogDrain::instance().flush(); });
+    }
+
+    void run() {
+        std::vector<std::shared_ptr<ThreadLog>> logs;
+        std::unique_lock<std::mutex> lock(mutex_);
+        for (;;) {
+            cv_.wait_for(lock, kDrainInterval, [this]() { return flush_requested_ > flush_completed_; });
+            uint64_t request = flush_requested_;
+            // A ring is only forgotten once its thread has exited and nothing is left in it
+            logs_.erase(std::remove_if(logs_.begin(), logs_.end(),
+                                       [](const std::shared_ptr<ThreadLog>& log) {
+                                           return log->orphaned.load(std::memory_order_acquire) &&
+                                                  log->head.load(std::memory_order_acquire) ==
+                                                      log->tail.load(std::memory_order_relaxed);
+                                       }),
+                        logs_.end());
+            logs = logs_;
+            lock.unlock();
+
+            drain(logs);
+            logs.clear();
+
+            lock.lock();
+            if (request > flush_completed_) {
+                flush_completed_ = request;
+                done_cv_.notify_all();
+            }
+        }
+    }
+
+    void drain(const std::vector<std::shared_ptr<ThreadLog>>& logs) {
+        pending_.clear();
+        heads_.clear();
+        for (const auto& log : logs) {
+            uint64_t head = log->head.load(std::memory_order_acquire);
+            for (uint64_t tail = log->tail.load(std::memory_order_relaxed); tail != head; ++tail) {
+                pending_.push_back(&log->slots[tail % kRingSlots]);
+            }
+            heads_.push_back(head);
+        }
+        std::sort(pending_.begin(), pending_.end(),
+                  [](const Slot* a, const Slot* b) { return a->sequence < b->sequence; });
+
+        bool wrote_out = false;
+        bool wrote_err = false;
+        for (const Slot* slot : pending_) {
+            bool is_error = slot->level >= LogLevel::Warn;
+            std::fwrite(slot->text, 1, slot->length, is_error ? stderr : stdout);
+            (is_error ? wrote_err : wrote_out) = true;
+        }
+        for (size_t i = 0; i < logs.size(); ++i) {
+            logs[i]->tail.store(heads_[i], std::memory_order_release);
+
+            uint64_t dropped = logs[i]->dropped.exchange(0, std::memory_order_relaxed);
+            if (dropped) {
+                std::fprintf(stderr, "[LOG] Dropped %llu lines, log buffer full\n",
+                             static_cast<unsigned long long>(dropped));
+                wrote_err = true;
+            }
+        }
+        if (wrote_out) {
+            std::fflush(stdout);
+        }
+        if (wrote_err) {
+            std::fflush(stderr);
+        }
+    }
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::condition_variable done_cv_;
+    std::vector<std::shared_ptr<ThreadLog>> logs_;
+    uint64_t flush_requested_ = 0;
+    uint64_t flush_completed_ = 0;
+    std::thread thread_;
+
+    // Drain thread only
+    std::vector<const Slot*> pending_;
+    std::vector<uint64_t> heads_;
+};
+
+// Owns the calling thread's ring; the drain thread keeps it alive until empty
+struct ThreadLogHolder {
+    std::shared_ptr<ThreadLog> log = std::make_shared<ThreadLog>();
+
+    ThreadLogHolder() { LogDrain::instance().add(log); }
+    ~ThreadLogHolder() { log->orphaned.store(true, std::memory_order_release); }
+};
+
+ThreadLog& threadLog() {
+    thread_local ThreadLogHolder holder;
+    return *holder.log;
+}
+
+// Swallows a line that could not get a slot
+class NullBuffer : public std::streambuf {
+protected:
+    int_type overflow(int_type) override { return traits_type::eof(); }
+};
+
+std::ostream& nullStream() {
+    thread_local NullBuffer buffer;
+    thread_local std::ostream stream(&buffer);
+    stream.clear();
+    return stream;
+}
+
+} // namespace
+
+} // namespace detail
+
+void setLogLevel(LogLevel level) {
+    detail::g_log_level.store(static_cast<int>(level), std::memory_order_relaxed);
+}
+
+LogLevel logLevel() {
+    return static_cast<LogLevel>(detail::g_log_level.load(std::memory_order_relaxed));
+}
+
+bool parseLogLevel(const std::string& name, LogLevel* level) {
+    static const std::pair<const char*, LogLevel> kLevels[] = {
+        {"debug", LogLevel::Debug}, {"info", LogLevel::Info}, {"warn", LogLevel::Warn},
+        {"error", LogLevel::Error}, {"off", LogLevel::Off},
+    };
+    for (const auto& entry : kLevels) {
+        if (name == entry.first) {
+            *level = entry.second;
+            return true;
+        }
+    }
+    return false;
+}
+
+void flushLogs() {
+    detail::LogDrain::instance().flush();
+}
+
+LogLine::LogLine(LogLevel level) : thread_log_(&detail::threadLog()), level_(level) {
+    detail::ThreadLog& log = *thread_log_;
+    uint64_t head = log.head.load(std::memory_order_relaxed);
+    if (log.current || head - log.tail.load(std::memory_order_acquire) >= detail::kRingSlots) {
+        // Ring full, or logging from inside another line's formatting
+        log.dropped.fetch_add(1, std::memory_order_relaxed);
+        thread_log_ = nullptr;
+        return;
+    }
+    log.current = &log.slots[head % detail::kRingSlots];
+    // Leave room for the newline appended on publish
+    log.buffer.reset(log.current->text, detail::kSlotSize - 1);
+    log.stream.clear();
+    log.stream.flags(log.default_flags);
+    log.stream.precision(log.default_precision);
+    log.stream.width(0);
+    log.stream.fill(' ');
+}
+
+LogLine::~LogLine() {
+    if (!thread_log_) {
+        return;
+    }
+    detail::ThreadLog& log = *thread_log_;
+    size_t length = log.buffer.written();
+    log.current->text[length++] = '\n';
+    log.current->length = static_cast<uint32_t>(length);
+    log.current->level = level_;
+    log.current->sequence = detail::g_next_sequence.fetch_add(1, std::memory_order_relaxed);
+    log.current = nullptr;
+    log.head.store(log.head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+std::ostream& LogLine::stream() {
+    return thread_log_ ? thread_log_->stream : detail::nullStream();
+}
+
+} // namespace common
@@ -0,0 +1,100 @@
+#pragma once
+#include <atomic>
+#include <ostream>
+#include <string>
+
+namespace common {
+
+enum class LogLevel : int {
+    Debug = 0,
+    Info = 1,
+    Warn = 2,
+    Error = 3,
+    Off = 4
+};
+
+namespace detail {
+extern std::atomic<int> g_log_level;
+struct ThreadLog;
+}
+
+// Runtime filter; messages below the level are skipped before any formatting
+void setLogLevel(LogLevel level);
+LogLevel logLevel();
+
+// Accepts debug, info, warn, error and off
+bool parseLogLevel(const std::string& name, LogLevel* level);
+
+inline bool logEnabled(LogLevel level) {
+    return static_cast<int>(level) >= detail::g_log_level.load(std::memory_order_relaxed);
+}
+
+// Blocks until every line logged so far has been written out
+void flushLogs();
+
+// One log line, formatted in place into a slot of the calling thread's ring
+// buffer and published when it goes out of scope.
+//
+// Each thread owns a lock-free single-producer ring; a background thread drains
+// all rings, in logging order, to stdout (Debug/Info) or stderr (Warn/Error).
+// Logging never takes a lock, allocates or makes a syscall on the hot path. If a
+// ring is full the line is dropped and counted rather than blocking the caller.
+// Lines longer than a slot are truncated.
+class LogLine {
+public:
+    explicit LogLine(LogLevel level);
+    ~LogLine();
+
+    LogLine(const LogLine&) = delete;
+    LogLine& operator=(const LogLine&) = delete;
+
+    std::ostream& stream();
+
+private:
+    detail::ThreadLog* thread_log_;
+    LogLevel level_;
+};
+
+} // namespace common
+
+// Levels below AGENT_LOG_COMPILED_LEVEL are compiled out entirely. Release
+// builds drop Debug unless told otherwise.
+#ifndef AGENT_LOG_COMPILED_LEVEL
+#ifdef NDEBUG
+#define AGENT_LOG_COMPILED_LEVEL 1
+#else
+#define AGENT_LOG_COMPILED_LEVEL 0
+#endif
+#endif
+
+#define AGENT_LOG(level, message)                                  \
+    do {                                                           \
+        if (common::logEnabled(level)) {                           \
+            common::LogLine agent_log_line_(level);                \
+            agent_log_line_.stream() << message;                   \
+        }                                                          \
+    } while (0)
+
+#define AGENT_LOG_DISABLED(message) \
+    do {                            \
+    } while (0)
+
+#if AGENT_LOG_COMPILED_LEVEL <= 0
+#define AGENT_LOG_DEBUG(message) AGENT_LOG(common::LogLevel::Debug, message)
+#else
+#define AGENT_LOG_DEBUG(message) AGENT_LOG_DISABLED(message)
+#endif
+
+#if AGENT_LOG_COMPILED_LEVEL <= 1
+#define AGENT_LOG_INFO(message) AGENT_LOG(common::LogLevel::Info, message)
+#else
+#define AGENT_LOG_INFO(message) AGENT_LOG_DISABLED(message)
+#endif
+
+#if AGENT_LOG_COMPILED_LEVEL <= 2
+#define AGENT_LOG_WARN(message) AGENT_LOG(common::LogLevel::Warn, message)
+#else
+#define AGENT_LOG_WARN(message) AGENT_LOG_DISABLED(message)
+#endif
+
+#define AGENT_LOG_ERROR(message) AGENT_LOG(common::LogLevel::Error, message)
@@ -0,0 +1,154 @@
+#include "Metrics.h"
+#include "Logger.h"
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+namespace common {
+
+namespace {
+
+LatencySummary summarize(const LatencyHistogram& histogram) {
+    LatencySummary summary;
+    summary.count = histogram.count();
+    summary.min_us = histogram.min() / 1000.0;
+    summary.mean_us = histogram.mean() / 1000.0;
+    summary.p50_us = histogram.percentile(0.50) / 1000.0;
+    summary.p90_us = histogram.percentile(0.90) / 1000.0;
+    summary.p99_us = histogram.percentile(0.99) / 1000.0;
+    summary.p999_us = histogram.percentile(0.999) / 1000.0;
+    summary.max_us = histogram.max() / 1000.0;
+    return summary;
+}
+
+void writeLatencyJson(std::ostream& out, const LatencySummary& summary) {
+    out << "{\"count\": " << summary.count << ", \"min_us\": " << summary.min_us
+        << ", \"mean_us\": " << summary.mean_us << ", \"p50_us\": " << summary.p50_us
+        << ", \"p90_us\": " << summary.p90_us << ", \"p99_us\": " << summary.p99_us
+        << ", \"p999_us\": " << summary.p999_us << ", \"max_us\": " << summary.max_us << "}";
+}
+
+} // namespace
+
+std::string MetricsSnapshot::toJson() const {
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(3);
+    out << "{\n  \"uptime_ms\": " << uptime_ms << ",\n  \"methods\": [";
+    const char* separator = "\n";
+    for (const auto& method : methods) {
+        out << separator << "    {\"method\": \"" << method.name << "\", \"calls_started\": " << method.calls_started
+            << ", \"calls_ok\": " << method.calls_ok << ", \"calls_failed\": " << method.calls_failed
+            << ", \"bytes_received\": " << method.bytes_received << ", \"bytes_sent\": " << method.bytes_sent
+            << ",\n     \"listener_latency\": ";
+        writeLatencyJson(out, method.listener_latency);
+        out << ",\n     \"total_latency\": ";
+        writeLatencyJson(out, method.total_latency);
+        out << "}";
+        separator = ",\n";
+    }
+    out << "\n  ],\n  \"gauges\": {";
+    separator = "";
+    for (const auto& gauge : gauges) {
+        out << separator << "\"" << gauge.first << "\": " << gauge.second;
+        separator = ", ";
+    }
+    out << "}\n}\n";
+    return out.str();
+}
+
+MetricsRegistry::MetricsRegistry() : created_at_(std::chrono::steady_clock::now()) {}
+
+MetricsRegistry::~MetricsRegistry() {
+    stopPeriodicDump();
+}
+
+MethodMetrics& MetricsRegistry::method(const std::string& name) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& entry = methods_[name];
+    if (!entry) {
+        entry = std::make_unique<MethodMetrics>();
+    }
+    return *entry;
+}
+
+Gauge& MetricsRegistry::gauge(const std::string& name) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& entry = gauges_[name];
+    if (!entry) {
+        entry = std::make_unique<Gauge>();
+    }
+    return *entry;
+}
+
+MetricsSnapshot MetricsRegistry::snapshot() const {
+    MetricsSnapshot snapshot;
+    snapshot.uptime_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - created_at_).count();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& entry : methods_) {
+        const MethodMetrics& metrics = *entry.second;
+        MetricsSnapshot::Method method;
+        method.name = entry.first;
+        method.calls_started = metrics.calls_started_.load(std::memory_order_relaxed);
+        method.calls_ok = metrics.calls_ok_.load(std::memory_order_relaxed);
+        method.calls_failed = metrics.calls_failed_.load(std::memory_order_relaxed);
+        method.bytes_received = metrics.bytes_received_.load(std::memory_order_relaxed);
+        method.bytes_sent = metrics.bytes_sent_.load(std::memory_order_relaxed);
+        method.listener_latency = summarize(metrics.listener_latency_);
+        method.total_latency = summarize(metrics.total_latency_);
+        snapshot.methods.push_back(std::move(method));
+    }
+    for (const auto& entry : gauges_) {
+        snapshot.gauges.emplace_back(entry.first, entry.second->value());
+    }
+    return snapshot;
+}
+
+void MetricsRegistry::startPeriodicDump(const std::string& path, std::chrono::milliseconds interval) {
+    stopPeriodicDump();
+
+    std::lock_guard<std::mutex> lock(dump_mutex_);
+    stop_dump_ = false;
+    dump_thread_ = std::thread([this, path, interval]() {
+        std::unique_lock<std::mutex> lock(dump_mutex_);
+        while (!dump_cv_.wait_for(lock, interval, [this]() { return stop_dump_; })) {
+            lock.unlock();
+            if (!writeDump(path)) {
+                AGENT_LOG_ERROR("[METRICS] Failed to write metrics dump to " << path);
+            }
+            lock.lock();
+        }
+    });
+    AGENT_LOG_INFO("[METRICS] Dumping metrics to " << path << " every " << interval.count() << " ms");
+}
+
+void MetricsRegistry::stopPeriodicDump() {
+    {
+        std::lock_guard<std::mutex> lock(dump_mutex_);
+        stop_dump_ = true;
+    }
+    dump_cv_.notify_all();
+    if (dump_thread_.joinable()) {
+        dump_thread_.join();
+    }
+}
+
+// Written to a temporary file and renamed, so readers never see a partial dump
+bool MetricsRegistry::writeDump(const std::string& path) const {
+    std::string temp_path = path + ".tmp";
+    {
+        std::ofstream out(temp_path, std::ios::trunc);
+        if (!out) {
+            return false;
+        }
+        out << snapshot().toJson();
+        if (!out) {
+            return false;
+        }
+    }
+    return std::rename(temp_path.c_str(), path.c_str()) == 0;
+}
+
+} // namespace common
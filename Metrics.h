@@ -0,0 +1,194 @@
+#pragma once
+#include "LatencyHistogram.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace common {
+
+// Level value such as a queue depth or the number of active reactors
+class Gauge {
+public:
+    void add(int64_t delta) { value_.fetch_add(delta, std::memory_order_relaxed); }
+    void set(int64_t value) { value_.store(value, std::memory_order_relaxed); }
+    int64_t value() const { return value_.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<int64_t> value_{0};
+};
+
+struct LatencySummary {
+    uint64_t count = 0;
+    double min_us = 0;
+    double mean_us = 0;
+    double p50_us = 0;
+    double p90_us = 0;
+    double p99_us = 0;
+    double p999_us = 0;
+    double max_us = 0;
+};
+
+// Counters and latencies for one RPC method. All recording is lock-free.
+//
+// total latency runs from the call being received until the reactor is done
+// (last write acknowledged), so for streams it is the stream's lifetime;
+// listener latency covers the time spent in, or waiting for, the listener.
+class MethodMetrics {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    void callStarted(size_t request_bytes) {
+        calls_started_.fetch_add(1, std::memory_order_relaxed);
+        messageReceived(request_bytes);
+    }
+    void messageReceived(size_t bytes) { bytes_received_.fetch_add(bytes, std::memory_order_relaxed); }
+    void messageSent(size_t bytes) { bytes_sent_.fetch_add(bytes, std::memory_order_relaxed); }
+    void listenerFinished(Clock::time_point listener_started) { listener_latency_.record(nanosSince(listener_started)); }
+    void callFinished(Clock::time_point received_at, bool ok) {
+        (ok ? calls_ok_ : calls_failed_).fetch_add(1, std::memory_order_relaxed);
+        total_latency_.record(nanosSince(received_at));
+    }
+
+private:
+    friend class MetricsRegistry;
+
+    static uint64_t nanosSince(Clock::time_point start) {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+    }
+
+    std::atomic<uint64_t> calls_started_{0};
+    std::atomic<uint64_t> calls_ok_{0};
+    std::atomic<uint64_t> calls_failed_{0};
+    std::atomic<uint64_t> bytes_received_{0};
+    std::atomic<uint64_t> bytes_sent_{0};
+    LatencyHistogram listener_latency_;
+    LatencyHistogram total_latency_;
+};
+
+struct MetricsSnapshot {
+    struct Method {
+        std::string name;
+        uint64_t calls_started = 0;
+        uint64_t calls_ok = 0;
+        uint64_t calls_failed = 0;
+        uint64_t bytes_received = 0;
+        uint64_t bytes_sent = 0;
+        LatencySummary listener_latency;
+        LatencySummary total_latency;
+    };
+
+    int64_t uptime_ms = 0;
+    std::vector<Method> methods;
+    std::vector<std::pair<std::string, int64_t>> gauges;
+
+    std::string toJson() const;
+};
+
+// Named methods and gauges of one agent.
+//
+// Registration takes a lock and is meant for startup: callers keep the returned
+// references, which stay valid for the registry's lifetime, so the hot path
+// only touches atomics.
+class MetricsRegistry {
+public:
+    MetricsRegistry();
+    ~MetricsRegistry();
+
+    MetricsRegistry(const MetricsRegistry&) = delete;
+    MetricsRegistry& operator=(const MetricsRegistry&) = delete;
+
+    MethodMetrics& method(const std::string& name);
+    Gauge& gauge(const std::string& name);
+
+    MetricsSnapshot snapshot() const;
+
+    // Rewrites path with a JSON snapshot every interval until the registry is
+    // destroyed. Calling it again replaces the previous dump.
+    void startPeriodicDump(const std::string& path, std::chrono::milliseconds interval);
+
+private:
+    void stopPeriodicDump();
+    bool writeDump(const std::string& path) const;
+
+    const std::chrono::steady_clock::time_point created_at_;
+
+    mutable std::mutex mutex_; // Guards registration only
+    std::map<std::string, std::unique_ptr<MethodMetrics>> methods_;
+    std::map<std::string, std::unique_ptr<Gauge>> gauges_;
+
+    std::mutex dump_mutex_;
+    std::condition_variable dump_cv_;
+    bool stop_dump_ = false;
+    std::thread dump_thread_;
+};
+
+// Copies a snapshot into a generated StatsReply; both services define the same
+// message shape in their own package.
+template <typename StatsReply>
+void fillStatsReply(const MetricsSnapshot& snapshot, StatsReply* reply) {
+    auto fillLatency = [](const LatencySummary& summary, auto* latency) {
+        latency->set_count(summary.count);
+        latency->set_min_us(summary.min_us);
+        latency->set_mean_us(summary.mean_us);
+        latency->set_p50_us(summary.p50_us);
+        latency->set_p90_us(summary.p90_us);
+        latency->set_p99_us(summary.p99_us);
+        latency->set_p999_us(summary.p999_us);
+        latency->set_max_us(summary.max_us);
+    };
+
+    reply->set_uptime_ms(snapshot.uptime_ms);
+    for (const auto& method : snapshot.methods) {
+        auto* stats = reply->add_methods();
+        stats->set_method(method.name);
+        stats->set_calls_started(method.calls_started);
+        stats->set_calls_ok(method.calls_ok);
+        stats->set_calls_failed(method.calls_failed);
+        stats->set_bytes_received(method.bytes_received);
+        stats->set_bytes_sent(method.bytes_sent);
+        fillLatency(method.listener_latency, stats->mutable_listener_latency());
+        fillLatency(method.total_latency, stats->mutable_total_latency());
+    }
+    for (const auto& gauge : snapshot.gauges) {
+        auto* value = reply->add_gauges();
+        value->set_name(gauge.first);
+        value->set_value(gauge.second);
+    }
+}
+
+// Human-readable table of a generated StatsReply, for the clients' --stats
+template <typename StatsReply>
+std::string formatStatsReply(const StatsReply& reply) {
+    std::ostringstream out;
+    out.setf(std::ios::fixed);
+    out.precision(1);
+    out << "Uptime: " << reply.uptime_ms() / 1000.0 << " s\n";
+    for (const auto& method : reply.methods()) {
+        out << method.method() << ": " << method.calls_started() << " started, " << method.calls_ok() << " ok, "
+            << method.calls_failed() << " failed, " << method.bytes_received() << " bytes in, "
+            << method.bytes_sent() << " bytes out\n";
+        auto printLatency = [&out](const char* label, const auto& latency) {
+            out << "  " << label << " us: n " << latency.count() << "  p50 " << latency.p50_us()
+                << "  p90 " << latency.p90_us() << "  p99 " << latency.p99_us() << "  p999 " << latency.p999_us()
+                << "  max " << latency.max_us() << "\n";
+        };
+        printLatency("listener", method.listener_latency());
+        printLatency("total   ", method.total_latency());
+    }
+    for (const auto& gauge : reply.gauges()) {
+        out << gauge.name() << " = " << gauge.value() << "\n";
+    }
+    return out.str();
+}
+
+} // namespace common
@@ -1,13 +1,29 @@
 #include "RayVisionServiceAgent.h"
+#include "ArenaAllocator.h"
+#include "Compression.h"
+#include "FrameCache.h"
+#include "FrameCodec.h"
+#include "ImageTransform.h"
+#include "Logger.h"
+#include "Metrics.h"
+#include "SharedFrameRing.h"
+#include <grpcpp/alarm.h>
 #include <grpcpp/grpcpp.h>
 #include <grpcpp/health_check_service_interface.h>
 #include "RayVision.grpc.pb.h"
-#include <iostream>
+#include <algorithm>
+#include <climits>
+#include <future>
 #include <memory>
 #include <thread>
 #include <atomic>
 #include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <map>
 #include <set>
+#include <stdexcept>
+#include <vector>
 #include <unistd.h>
 
 using grpc::Server;
@@ -27,14 +43,362 @@ using rayvisiongrpc::ColorSpace;
 
 namespace rayvision {
 
+namespace {
+
+// Assembles a serialized protobuf message in a ByteBuffer without copying frame
+// bytes. Small fields are encoded into a scratch string; frame bytes become
+// slices that reference the pooled buffer and keep it alive until gRPC has
+// written them. Callers write fields in order and size nested messages up front.
+class FrameMessageWriter {
+public:
+    // Encoded size of a length-delimited field with a payload of length bytes
+    static size_t lengthDelimitedSize(uint32_t field, size_t length) {
+        return google::protobuf::io::CodedOutputStream::VarintSize32(lengthDelimitedTag(field)) +
+               google::protobuf::io::CodedOutputStream::VarintSize64(length) + length;
+    }
+
+    // Encoded size of an int32 or enum field; proto3 omits zero
+    static size_t int32FieldSize(uint32_t field, int32_t value) {
+        if (value == 0) {
+            return 0;
+        }
+        return google::protobuf::io::CodedOutputStream::VarintSize32(field << 3) +
+               google::protobuf::io::CodedOutputStream::VarintSize32SignExtended(value);
+    }
+
+    // Encoded size of an int64 field; proto3 omits zero
+    static size_t int64FieldSize(uint32_t field, int64_t value) {
+        if (value == 0) {
+            return 0;
+        }
+        return google::protobuf::io::CodedOutputStream::VarintSize32(field << 3) +
+               google::protobuf::io::CodedOutputStream::VarintSize64(static_cast<uint64_t>(value));
+    }
+
+    // Bytes about to be encoded into scratch, so it is allocated once
+    void reserve(size_t size) { scratch_.reserve(size); }
+
+    void appendInt32Field(uint32_t field, int32_t value) {
+        if (value == 0) {
+            return;
+        }
+        appendVarint(field << 3);
+        // Negative values are sign-extended to ten bytes, as protobuf does
+        appendVarint(static_cast<uint64_t>(static_cast<int64_t>(value)));
+    }
+
+    void appendInt64Field(uint32_t field, int64_t value) {
+        if (value == 0) {
+            return;
+        }
+        appendVarint(field << 3);
+        appendVarint(static_cast<uint64_t>(value));
+    }
+
+    // A bytes field copied into the encoded message
+    void appendBytes(uint32_t field, const void* data, size_t length) {
+        appendLengthDelimitedHeader(field, length);
+        scratch_.append(static_cast<const char*>(data), length);
+    }
+
+    // Tag and length of a length-delimited field whose payload follows
+    void appendLengthDelimitedHeader(uint32_t field, size_t length) {
+        appendVarint(lengthDelimitedTag(field));
+        appendVarint(length);
+    }
+
+    // The message's own fields, e.g. a header message holding only the scalars
+    void appendMessage(const google::protobuf::MessageLite& message) {
+        message.AppendToString(&scratch_);
+    }
+
+    void appendFrame(uint32_t field, const FrameBufferPtr& buffer, size_t offset, size_t length) {
+        appendLengthDelimitedHeader(field, length);
+        if (length == 0) {
+            return;
+        }
+        flushScratch();
+        auto* reference = new FrameBufferPtr(buffer);
+        slices_.emplace_back(buffer->data() + offset, length,
+                             [](void* user_data) { delete static_cast<FrameBufferPtr*>(user_data); }, reference);
+    }
+
+    void finish(grpc::ByteBuffer* payload) {
+        flushScratch();
+        grpc::ByteBuffer(slices_.data(), slices_.size()).Swap(payload);
+        slices_.clear();
+    }
+
+private:
+    static uint32_t lengthDelimitedTag(uint32_t field) { return (field << 3) | 2; }
+
+    void appendVarint(uint64_t value) {
+        while (value >= 0x80) {
+            scratch_.push_back(static_cast<char>(value | 0x80));
+            value >>= 7;
+        }
+        scratch_.push_back(static_cast<char>(value));
+    }
+
+    // A few header bytes are copied into the slice; a larger run of encoded
+    // fields is handed to gRPC as it is
+    void flushScratch() {
+        if (scratch_.empty()) {
+            return;
+        }
+        if (scratch_.size() < kCopyLimit) {
+            slices_.emplace_back(scratch_.data(), scratch_.size());
+            scratch_.clear();
+            return;
+        }
+        auto* encoded = new std::string(std::move(scratch_));
+        scratch_.clear();
+        slices_.emplace_back(encoded->data(), encoded->size(),
+                             [](void* user_data) { delete static_cast<std::string*>(user_data); }, encoded);
+    }
+
+    static constexpr size_t kCopyLimit = 1024;
+
+    std::string scratch_;
+    std::vector<grpc::Slice> slices_;
+};
+
+size_t frameSize(const FrameBufferPtr& buffer) {
+    return buffer ? buffer->size() : 0;
+}
+
+int64_t microsSinceEpoch() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::system_clock::now().time_since_epoch())
+        .count();
+}
+
+// Listeners that do not timestamp their frames get the time the agent received them
+void stampCaptureTime(rayvision::ImageData& frame) {
+    if (!frame.capture_time_us) {
+        frame.capture_time_us = microsSinceEpoch();
+    }
+}
+
+// Encoded size of what appendImage writes for frame
+size_t imageMessageSize(const rayvision::ImageData& frame) {
+    using Writer = FrameMessageWriter;
+    using ImageFields = rayvisiongrpc::ImageData;
+
+    size_t buffer_size = frameSize(frame.buffer);
+    return Writer::int32FieldSize(ImageFields::kWidthFieldNumber, frame.width) +
+           Writer::int32FieldSize(ImageFields::kHeightFieldNumber, frame.height) +
+           Writer::int32FieldSize(ImageFields::kColorspaceFieldNumber, frame.colorspace) +
+           (buffer_size ? Writer::lengthDelimitedSize(ImageFields::kBufferFieldNumber, buffer_size) : 0) +
+           Writer::int64FieldSize(ImageFields::kCaptureTimeUsFieldNumber, frame.capture_time_us);
+}
+
+// Appends the rayvisiongrpc::ImageData fields of a whole frame, in field-number
+// order; the buffer is a slice of the frame
+void appendImage(FrameMessageWriter& writer, const rayvision::ImageData& frame) {
+    using ImageFields = rayvisiongrpc::ImageData;
+
+    writer.appendInt32Field(ImageFields::kWidthFieldNumber, frame.width);
+    writer.appendInt32Field(ImageFields::kHeightFieldNumber, frame.height);
+    writer.appendInt32Field(ImageFields::kColorspaceFieldNumber, frame.colorspace);
+    size_t buffer_size = frameSize(frame.buffer);
+    if (buffer_size) {
+        writer.appendFrame(ImageFields::kBufferFieldNumber, frame.buffer, 0, buffer_size);
+    }
+    writer.appendInt64Field(ImageFields::kCaptureTimeUsFieldNumber, frame.capture_time_us);
+}
+
+// Masks smaller than this are copied into the encoded result: a slice reference
+// costs more than the copy
+constexpr size_t kInlineMaskLimit = 32 * 1024;
+
+// Upper bound on the encoded size of a segment apart from its mask bytes
+constexpr size_t kMaxSegmentOverhead = 128;
+
+struct SegmentFields {
+    int32_t left;
+    int32_t top;
+    int32_t right;
+    int32_t bottom;
+    int32_t width;
+    int32_t height;
+    int32_t colorspace;
+};
+
+// Appends one rayvisiongrpc::SegmentData to the SegmentationResult being
+// written. Nested message sizes are computed from the fields directly, so every
+// byte is written exactly once and no intermediate message is built. The output
+// matches what protobuf itself would serialize.
+void appendSegment(FrameMessageWriter& writer, const SegmentFields& fields, const FrameBufferPtr& buffer,
+                   size_t mask_offset, size_t mask_length) {
+    using Writer = FrameMessageWriter;
+    using ImageFields = rayvisiongrpc::ImageData;
+    using SegmentData = rayvisiongrpc::SegmentData;
+
+    size_t image_size = Writer::int32FieldSize(ImageFields::kWidthFieldNumber, fields.width) +
+                        Writer::int32FieldSize(ImageFields::kHeightFieldNumber, fields.height) +
+                        Writer::int32FieldSize(ImageFields::kColorspaceFieldNumber, fields.colorspace);
+    if (mask_length) {
+        image_size += Writer::lengthDelimitedSize(ImageFields::kBufferFieldNumber, mask_length);
+    }
+    size_t segment_size = Writer::int32FieldSize(SegmentData::kLeftFieldNumber, fields.left) +
+                          Writer::int32FieldSize(SegmentData::kTopFieldNumber, fields.top) +
+                          Writer::int32FieldSize(SegmentData::kRightFieldNumber, fields.right) +
+                          Writer::int32FieldSize(SegmentData::kBottomFieldNumber, fields.bottom) +
+                          Writer::lengthDelimitedSize(SegmentData::kImageFieldNumber, image_size);
+
+    writer.appendLengthDelimitedHeader(rayvisiongrpc::SegmentationResult::kSegmentsFieldNumber, segment_size);
+    writer.appendInt32Field(SegmentData::kLeftFieldNumber, fields.left);
+    writer.appendInt32Field(SegmentData::kTopFieldNumber, fields.top);
+    writer.appendInt32Field(SegmentData::kRightFieldNumber, fields.right);
+    writer.appendInt32Field(SegmentData::kBottomFieldNumber, fields.bottom);
+    writer.appendLengthDelimitedHeader(SegmentData::kImageFieldNumber, image_size);
+    writer.appendInt32Field(ImageFields::kWidthFieldNumber, fields.width);
+    writer.appendInt32Field(ImageFields::kHeightFieldNumber, fields.height);
+    writer.appendInt32Field(ImageFields::kColorspaceFieldNumber, fields.colorspace);
+    if (mask_length == 0) {
+        return;
+    }
+    if (mask_length < kInlineMaskLimit) {
+        writer.appendBytes(ImageFields::kBufferFieldNumber, buffer->data() + mask_offset, mask_length);
+    } else {
+        writer.appendFrame(ImageFields::kBufferFieldNumber, buffer, mask_offset, mask_length);
+    }
+}
+
+// Bytes per pixel of a rayvisiongrpc::ColorSpace, 0 if unknown
+int channelsOf(int colorspace) {
+    switch (colorspace) {
+    case rayvisiongrpc::RGB:
+        return 3;
+    case rayvisiongrpc::GRAY:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+bool wantsTransform(const GetImageRequest& request) {
+    return request.has_roi() || request.target_width() || request.target_height() || request.has_colorspace();
+}
+
+// Crops, converts and downscales frame as the request asks. The colorspace
+// conversion runs on whichever side of the downscale has fewer pixels.
+grpc::Status transformFrame(const rayvision::ImageData& frame, const GetImageRequest& request, FrameBufferPool& pool,
+                            rayvision::ImageData* out) {
+    const int channels = channelsOf(frame.colorspace);
+    if (!channels || frame.width <= 0 || frame.height <= 0 ||
+        frameSize(frame.buffer) != static_cast<size_t>(frame.width) * frame.height * channels) {
+        return grpc::Status(grpc::StatusCode::FAILED_PRECONDITION,
+                            "Frame layout does not match its width, height and colorspace; it cannot be transformed");
+    }
+
+    // Region of interest, clipped to the frame
+    int left = 0, top = 0, right = frame.width, bottom = frame.height;
+    if (request.has_roi()) {
+        const auto& roi = request.roi();
+        left = std::max(roi.x(), 0);
+        top = std::max(roi.y(), 0);
+        right = static_cast<int>(std::min<int64_t>(static_cast<int64_t>(roi.x()) + roi.width(), frame.width));
+        bottom = static_cast<int>(std::min<int64_t>(static_cast<int64_t>(roi.y()) + roi.height(), frame.height));
+        if (roi.width() <= 0 || roi.height() <= 0 || right <= left || bottom <= top) {
+            return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, "Region of interest is empty or outside the frame");
+        }
+    }
+    const int region_width = right - left;
+    const int region_height = bottom - top;
+
+    // Target size; with only one side given the other keeps the aspect ratio
+    int target_width = request.target_width();
+    int target_height = request.target_height();
+    if (target_width < 0 || target_height < 0) {
+        return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, "Target size must not be negative");
+    }
+    if (!target_width && !target_height) {
+        target_width = region_width;
+        target_height = region_height;
+    } else if (!target_height) {
+        target_height = std::max<int>(1, static_cast<int>(int64_t{region_height} * target_width / region_width));
+    } else if (!target_width) {
+        target_width = std::max<int>(1, static_cast<int>(int64_t{region_width} * target_height / region_height));
+    }
+    if (target_width > region_width || target_height > region_height) {
+        return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT,
+                            "Target size is larger than the region; only downscaling is supported");
+    }
+
+    const int target_colorspace = request.has_colorspace() ? request.colorspace() : frame.colorspace;
+    const int target_channels = channelsOf(target_colorspace);
+    if (!target_channels) {
+        return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, "Unknown target colorspace");
+    }
+
+    auto view = common::ImageView::dense(reinterpret_cast<const uint8_t*>(frame.buffer->data()), frame.width,
+                                         frame.height, channels)
+                    .crop(left, top, region_width, region_height);
+    auto convert = [&](const common::ImageView& source) {
+        FrameBufferPtr converted = pool.acquire(static_cast<size_t>(source.width) * source.height * target_channels);
+        auto* pixels = reinterpret_cast<uint8_t*>(converted->data());
+        if (target_channels == 1) {
+            common::rgbToGray(source, pixels);
+        } else {
+            common::grayToRgb(source, pixels);
+        }
+        return converted;
+    };
+    auto downscale = [&](const common::ImageView& source) {
+        FrameBufferPtr scaled = pool.acquire(static_cast<size_t>(target_width) * target_height * source.channels);
+        common::downscaleImage(source, target_width, target_height, reinterpret_cast<uint8_t*>(scaled->data()));
+        return scaled;
+    };
+
+    FrameBufferPtr result;
+    if (target_channels == channels) {
+        result = downscale(view); // A plain copy for a crop
+    } else if (target_channels < channels) {
+        FrameBufferPtr converted = convert(view);
+        result = downscale(common::ImageView::dense(reinterpret_cast<const uint8_t*>(converted->data()),
+                                                    region_width, region_height, target_channels));
+    } else {
+        FrameBufferPtr scaled = downscale(view);
+        result = convert(common::ImageView::dense(reinterpret_cast<const uint8_t*>(scaled->data()), target_width,
+                                                  target_height, channels));
+    }
+
+    out->width = target_width;
+    out->height = target_height;
+    out->colorspace = target_colorspace;
+    out->buffer = std::move(result);
+    out->capture_time_us = frame.capture_time_us;
+    return grpc::Status::OK;
+}
+
+} // namespace
+
 class RayVisionServiceAgent::Impl {
 private:
-    // Forward declaration of nested class
+    // Forward declaration of nested classes
     class DoSegmentationReactor;
+    class SubscribeFramesReactor;
+
+    using FrameCache = common::FrameCache<int, rayvision::ImageData>;
+    using BatchCache = common::FrameCache<std::vector<int>, std::vector<rayvision::ImageData>>;
+
+    static constexpr size_t kMaxBatchCameras = 8;
+
+    static constexpr char kDefaultListenAddress[] = "unix:///tmp/rayvision_service.sock";
+    static constexpr char kDefaultFrameChannelPath[] = "/tmp/rayvision_service.shm.sock";
 
 public:
-    Impl(std::weak_ptr<IRayVisionServiceListener> listener)
-        : mListener(listener), mStopServer(false) {
+    Impl(std::weak_ptr<IRayVisionServiceListener> listener, const SegmentationStreamOptions& stream_options,
+         std::chrono::milliseconds frame_max_age, const common::ServerConfig& server_config)
+        : mListener(listener), mStopServer(false), mStreamOptions(stream_options), mServerConfig(server_config),
+          mListenAddresses(common::listenAddresses(server_config, kDefaultListenAddress)),
+          mFrameCache(frame_max_age),
+          mBatchCache(frame_max_age),
+          mFrameRing(std::make_unique<common::SharedFrameRing>(
+              common::frameChannelPath(server_config, kDefaultFrameChannelPath), kFrameRingSlots,
+              kFrameRingSlotSize)) {
         startServer();
     }
 
@@ -44,59 +408,299 @@ public:
 
     void sendSegmentationResult(const rayvision::SegmentationResult& segmentation_result) {
         // Process the result immediately using gRPC's thread pool
-        std::cout << "[RAYVISION] Processing segmentation result with "
-                  << segmentation_result.segments.size() << " segments" << std::endl;
+        AGENT_LOG_DEBUG("[RAYVISION] Processing segmentation result with "
+                        << segmentation_result.segments.size() << " segments");
 
-        // Send the result to any waiting clients
-        std::lock_guard<std::mutex> lock(mSegmentationReactorsMutex);
-        for (auto* reactor_ptr : mActiveSegmentationReactors) {
-            auto* reactor = static_cast<DoSegmentationReactor*>(reactor_ptr);
-            if (reactor && !reactor->IsFinished()) {
-                // Convert to gRPC response
-                rayvisiongrpc::SegmentationResult grpc_result;
-                for (const auto& segment_ptr : segmentation_result.segments) {
-                    if (segment_ptr) {
-                        auto* grpc_segment = grpc_result.add_segments();
-                        grpc_segment->set_left(segment_ptr->left);
-                        grpc_segment->set_top(segment_ptr->top);
-                        grpc_segment->set_right(segment_ptr->right);
-                        grpc_segment->set_bottom(segment_ptr->bottom);
-
-                        // Set the image data
-                        auto* grpc_image = grpc_segment->mutable_image();
-                        grpc_image->set_width(segment_ptr->image.width);
-                        grpc_image->set_height(segment_ptr->image.height);
-                        grpc_image->set_colorspace(static_cast<rayvisiongrpc::ColorSpace>(segment_ptr->image.colorspace));
-                        grpc_image->set_buffer(segment_ptr->image.buffer.data(), segment_ptr->image.buffer.size());
-                    }
-                }
+        grpc::ByteBuffer payload;
+        serializeSegmentationResult(segmentation_result, &payload);
+        broadcastSegmentationPayload(payload);
+    }
+
+    void sendSegmentationResult(const rayvision::FlatSegmentationResult& segmentation_result) {
+        if (!segmentation_result.isConsistent()) {
+            AGENT_LOG_ERROR("[RAYVISION] Dropping flat segmentation result with mismatched columns or masks "
+                            "outside its pixel buffer");
+            return;
+        }
+        AGENT_LOG_DEBUG("[RAYVISION] Processing flat segmentation result with "
+                        << segmentation_result.size() << " segments");
+
+        grpc::ByteBuffer payload;
+        serializeSegmentationResult(segmentation_result, &payload);
+        broadcastSegmentationPayload(payload);
+    }
+
+    // Encoded once, outside the lock; every reactor writes the same refcounted
+    // payload, whose large masks are the listener's own buffers
+    void broadcastSegmentationPayload(const grpc::ByteBuffer& payload) {
+        // Snapshot the subscribers so that a slow one cannot hold the registry lock
+        std::vector<std::shared_ptr<DoSegmentationReactor>> reactors;
+        {
+            std::lock_guard<std::mutex> lock(mSegmentationReactorsMutex);
+            reactors.reserve(mActiveSegmentationReactors.size());
+            for (auto* reactor : mActiveSegmentationReactors) {
+                reactors.push_back(reactor->shared_from_this());
+            }
+        }
+
+        // Serve every stream with room first, then wait for the full lossless ones.
+        // They share one deadline, so a result stalls the producer for at most
+        // block_timeout however many consumers are slow.
+        std::vector<DoSegmentationReactor*> full_reactors;
+        for (const auto& reactor : reactors) {
+            if (!reactor->TryEnqueue(payload)) {
+                full_reactors.push_back(reactor.get());
+            }
+        }
+        auto deadline = std::chrono::steady_clock::now() + mStreamOptions.block_timeout;
+        for (auto* reactor : full_reactors) {
+            reactor->EnqueueBlocking(payload, deadline);
+        }
+    }
+
+    void publishFrame(int camera_type, rayvision::ImageData image_data) {
+        stampCaptureTime(image_data);
+        auto frame = std::make_shared<const rayvision::ImageData>(std::move(image_data));
+        mFrameCache.put(camera_type, frame);
 
-                reactor->StartWrite(&grpc_result);
+        std::vector<std::shared_ptr<SubscribeFramesReactor>> subscribers;
+        {
+            std::lock_guard<std::mutex> lock(mFrameSubscribersMutex);
+            auto it = mFrameSubscribers.find(camera_type);
+            if (it == mFrameSubscribers.end()) {
+                return;
+            }
+            subscribers.reserve(it->second.size());
+            for (auto* reactor : it->second) {
+                subscribers.push_back(reactor->shared_from_this());
             }
         }
+
+        // Encoded once; every stream writes the same slices of the frame buffer
+        grpc::ByteBuffer payload;
+        serializeFrame(*frame, &payload);
+        for (const auto& reactor : subscribers) {
+            reactor->Offer(payload);
+        }
+    }
+
+    bool hasFrameSubscribers(int camera_type) const {
+        std::lock_guard<std::mutex> lock(mFrameSubscribersMutex);
+        return mFrameSubscribers.count(camera_type) != 0;
+    }
+
+    void registerFrameSubscriber(int camera_type, SubscribeFramesReactor* reactor) {
+        std::lock_guard<std::mutex> lock(mFrameSubscribersMutex);
+        mFrameSubscribers[camera_type].insert(reactor);
+    }
+
+    void unregisterFrameSubscriber(int camera_type, SubscribeFramesReactor* reactor) {
+        std::lock_guard<std::mutex> lock(mFrameSubscribersMutex);
+        auto it = mFrameSubscribers.find(camera_type);
+        if (it != mFrameSubscribers.end()) {
+            it->second.erase(reactor);
+            if (it->second.empty()) {
+                mFrameSubscribers.erase(it);
+            }
+        }
+    }
+
+    void enableMetricsDump(const std::string& path, std::chrono::milliseconds interval) {
+        mMetrics.registry.startPeriodicDump(path, interval);
     }
 
     void registerSegmentationReactor(DoSegmentationReactor* reactor) {
         std::lock_guard<std::mutex> lock(mSegmentationReactorsMutex);
-        mActiveSegmentationReactors.insert(static_cast<void*>(reactor));
+        mActiveSegmentationReactors.insert(reactor);
     }
 
     void unregisterSegmentationReactor(DoSegmentationReactor* reactor) {
         std::lock_guard<std::mutex> lock(mSegmentationReactorsMutex);
-        mActiveSegmentationReactors.erase(static_cast<void*>(reactor));
+        mActiveSegmentationReactors.erase(reactor);
     }
 
 private:
+    // Handles resolved once at startup, so recording never takes a lock
+    struct AgentMetrics {
+        common::MetricsRegistry registry;
+        common::MethodMetrics& get_image = registry.method("GetImage");
+        common::MethodMetrics& batch_get_image = registry.method("BatchGetImage");
+        common::MethodMetrics& get_image_chunked = registry.method("GetImageChunked");
+        common::MethodMetrics& segmentation = registry.method("doSegmentation");
+        common::Gauge& segmentation_streams = registry.gauge("segmentation_active_streams");
+        common::Gauge& segmentation_queued = registry.gauge("segmentation_queued_results");
+        common::Gauge& segmentation_dropped = registry.gauge("segmentation_dropped_results_total");
+        common::MethodMetrics& subscribe_frames = registry.method("SubscribeFrames");
+        common::Gauge& frame_subscribers = registry.gauge("frame_subscribers");
+        common::Gauge& frames_dropped = registry.gauge("frames_dropped_total");
+    };
+
+    // A whole frame as an ImageData message whose buffer is a slice of the frame
+    static void serializeFrame(const rayvision::ImageData& frame, grpc::ByteBuffer* payload) {
+        FrameMessageWriter writer;
+        appendImage(writer, frame);
+        writer.finish(payload);
+    }
+
+    // The frames of one BatchGetImage call; each buffer is a slice of its frame
+    static void serializeBatch(const std::vector<rayvision::ImageData>& frames, grpc::ByteBuffer* payload) {
+        FrameMessageWriter writer;
+        int64_t earliest = INT64_MAX;
+        int64_t latest = INT64_MIN;
+        for (const auto& frame : frames) {
+            writer.appendLengthDelimitedHeader(rayvisiongrpc::BatchGetImageReply::kImagesFieldNumber,
+                                               imageMessageSize(frame));
+            appendImage(writer, frame);
+            earliest = std::min(earliest, frame.capture_time_us);
+            latest = std::max(latest, frame.capture_time_us);
+        }
+        if (!frames.empty()) {
+            writer.appendInt64Field(rayvisiongrpc::BatchGetImageReply::kCaptureSpreadUsFieldNumber, latest - earliest);
+        }
+        writer.finish(payload);
+    }
+
+    static void serializeSegmentationResult(const rayvision::SegmentationResult& segmentation_result,
+                                            grpc::ByteBuffer* payload) {
+        FrameMessageWriter writer;
+        for (const auto& segment_ptr : segmentation_result.segments) {
+            if (!segment_ptr) {
+                continue;
+            }
+            const auto& image = segment_ptr->image;
+            appendSegment(writer,
+                          {segment_ptr->left, segment_ptr->top, segment_ptr->right, segment_ptr->bottom,
+                           image.width, image.height, image.colorspace},
+                          image.buffer, 0, frameSize(image.buffer));
+        }
+        writer.finish(payload);
+    }
+
+    // Walks the parallel arrays front to back; the scratch buffer is sized once.
+    // The result must be consistent.
+    static void serializeSegmentationResult(const rayvision::FlatSegmentationResult& segmentation_result,
+                                            grpc::ByteBuffer* payload) {
+        size_t segment_count = segmentation_result.size();
+        size_t inline_bytes = 0;
+        for (uint64_t length : segmentation_result.mask_length) {
+            if (length < kInlineMaskLimit) {
+                inline_bytes += length;
+            }
+        }
+
+        FrameMessageWriter writer;
+        writer.reserve(segment_count * kMaxSegmentOverhead + inline_bytes);
+        for (size_t i = 0; i < segment_count; ++i) {
+            appendSegment(writer,
+                          {segmentation_result.left[i], segmentation_result.top[i], segmentation_result.right[i],
+                           segmentation_result.bottom[i], segmentation_result.width[i], segmentation_result.height[i],
+                           segmentation_result.colorspace[i]},
+                          segmentation_result.pixels, segmentation_result.mask_offset[i],
+                          segmentation_result.mask_length[i]);
+        }
+        writer.finish(payload);
+    }
+
+    // How one GetImage frame goes out to a frame codec client
+    struct EncodedFrame {
+        uint64_t frame_id = 0;
+        uint64_t reference_frame_id = 0; // 0 unless encoding is FRAME_XOR_DEFLATE
+        rayvisiongrpc::FrameEncoding encoding = rayvisiongrpc::FRAME_RAW;
+        FrameBufferPtr buffer; // Null for FRAME_RAW: send the frame itself
+    };
+
+    // Per camera: the frames recently sent to codec clients, any of which a
+    // client may name as its reference, and the last encoding, which every
+    // client polling in step with the camera shares
+    struct CodecFrames {
+        std::deque<std::pair<uint64_t, FrameCache::FramePtr>> recent; // Oldest first
+        EncodedFrame last_encoded;
+        bool has_last_encoded = false;
+    };
+
+    static constexpr size_t kCodecHistory = 4;
+
+    // Deflates the frame, as a delta when the client still holds a frame we
+    // remember. Frames that do not compress go out raw.
+    EncodedFrame encodeFrame(int camera_type, const FrameCache::FramePtr& frame, uint64_t reference_frame_id) {
+        EncodedFrame encoded;
+        FrameCache::FramePtr reference;
+        {
+            std::lock_guard<std::mutex> lock(mCodecMutex);
+            auto& camera = mCodecFrames[camera_type];
+            for (const auto& [id, recent_frame] : camera.recent) {
+                if (recent_frame == frame) {
+                    encoded.frame_id = id;
+                }
+                if (reference_frame_id && id == reference_frame_id) {
+                    reference = recent_frame;
+                }
+            }
+            if (!encoded.frame_id) {
+                encoded.frame_id = mNextFrameId++;
+                camera.recent.emplace_back(encoded.frame_id, frame);
+                if (camera.recent.size() > kCodecHistory) {
+                    camera.recent.pop_front();
+                }
+            }
+            if (reference && frameSize(reference->buffer) != frameSize(frame->buffer)) {
+                reference.reset(); // Resolution changed: key frame
+            }
+            if (reference) {
+                encoded.reference_frame_id = reference_frame_id;
+            }
+            if (camera.has_last_encoded && camera.last_encoded.frame_id == encoded.frame_id &&
+                camera.last_encoded.reference_frame_id == encoded.reference_frame_id) {
+                return camera.last_encoded;
+            }
+        }
+
+        size_t size = frameSize(frame->buffer);
+        FrameBufferPtr buffer = mCodecPool.acquire(size);
+        size_t encoded_size =
+            common::encodeFrame(frame->buffer->data(), size, reference ? reference->buffer->data() : nullptr,
+                                buffer->data());
+        if (encoded_size) {
+            buffer->resize(encoded_size);
+            encoded.buffer = std::move(buffer);
+            encoded.encoding = reference ? rayvisiongrpc::FRAME_XOR_DEFLATE : rayvisiongrpc::FRAME_DEFLATE;
+        } else {
+            encoded.reference_frame_id = 0;
+        }
+
+        std::lock_guard<std::mutex> lock(mCodecMutex);
+        auto& camera = mCodecFrames[camera_type];
+        camera.last_encoded = encoded;
+        camera.has_last_encoded = true;
+        return encoded;
+    }
+
+    static constexpr uint32_t kFrameRingSlots = 8;
+    static constexpr uint64_t kFrameRingSlotSize = 16 * 1024 * 1024;
+
+    // Copies the frame into the shared-memory ring; false means the caller must
+    // send the bytes inline instead.
+    bool writeSharedFrame(const FrameBuffer& frame, rayvisiongrpc::SharedFrameHandle* grpc_handle) {
+        common::SharedFrameHandle handle;
+        if (!mFrameRing->write(frame.data(), frame.size(), &handle)) {
+            return false;
+        }
+        grpc_handle->set_slot(handle.slot);
+        grpc_handle->set_sequence(handle.sequence);
+        grpc_handle->set_offset(handle.offset);
+        grpc_handle->set_length(handle.length);
+        grpc_handle->set_channel_path(mFrameRing->channelPath());
+        return true;
+    }
+
     void startServer() {
         mServerThread = std::thread([this]() {
-            std::string server_address("unix:///tmp/rayvision_service.sock"); // Unix socket path
-
             // Create service implementation
             auto service = std::make_unique<RayVisionServiceImpl>(this);
 
             // Build server
             ServerBuilder builder;
-            builder.AddListeningPort(server_address, grpc::InsecureServerCredentials());
+            common::applyServerConfig(mServerConfig, mListenAddresses, &builder);
             builder.RegisterService(service.get());
 
             // Add health check service
@@ -107,7 +711,14 @@ private:
                 std::lock_guard<std::mutex> lock(mServerMutex);
                 mServer = builder.BuildAndStart();
             }
-            std::cout << "[RAYVISION] RayVisionServiceAgent server listening on " << server_address << std::endl;
+            if (!mServer) {
+                AGENT_LOG_ERROR("[RAYVISION] RayVisionServiceAgent failed to listen on "
+                                << common::joinAddresses(mListenAddresses));
+                return;
+            }
+            std::string settings = common::describeServerConfig(mServerConfig);
+            AGENT_LOG_INFO("[RAYVISION] RayVisionServiceAgent server listening on " << common::joinAddresses(mListenAddresses)
+                           << (settings.empty() ? "" : " (" + settings + ")"));
 
             // Wait for server to shutdown
             mServer->Wait();
@@ -117,16 +728,34 @@ private:
     void stopServer() {
         mStopServer = true;
 
-        // Clean up Unix socket
-        if (unlink("/tmp/rayvision_service.sock") == 0) {
-            std::cout << "[RAYVISION] Unix socket cleaned up" << std::endl;
+        // Clean up Unix sockets
+        for (const auto& address : mListenAddresses) {
+            std::string socket_path = common::unixSocketPath(address);
+            if (!socket_path.empty() && unlink(socket_path.c_str()) == 0) {
+                AGENT_LOG_INFO("[RAYVISION] Unix socket " << socket_path << " cleaned up");
+            }
+        }
+
+        // Frame streams only end when their client cancels; end them here so
+        // that Shutdown does not wait for every subscriber to go away
+        std::vector<std::shared_ptr<SubscribeFramesReactor>> subscribers;
+        {
+            std::lock_guard<std::mutex> lock(mFrameSubscribersMutex);
+            for (const auto& camera : mFrameSubscribers) {
+                for (auto* reactor : camera.second) {
+                    subscribers.push_back(reactor->shared_from_this());
+                }
+            }
+        }
+        for (const auto& reactor : subscribers) {
+            reactor->Close(grpc::Status(grpc::StatusCode::CANCELLED, "Server shutting down"));
         }
 
         // Shutdown the server
         {
             std::lock_guard<std::mutex> lock(mServerMutex);
             if (mServer) {
-                std::cout << "[RAYVISION] Shutting down server..." << std::endl;
+                AGENT_LOG_INFO("[RAYVISION] Shutting down server...");
                 mServer->Shutdown();
             }
         }
@@ -143,80 +772,393 @@ private:
     }
 
     // gRPC Service Implementation
+
+    // Raw method: the reply references the frame buffer instead of copying it
+    // into an ImageData message
     class GetImageReactor : public grpc::ServerUnaryReactor {
     public:
-        GetImageReactor(Impl* agent_impl, const GetImageRequest* request, rayvisiongrpc::ImageData* response)
-            : agent_impl_(agent_impl), request_(request), response_(response) {
+        GetImageReactor(Impl* agent_impl, const grpc::ByteBuffer* request, grpc::ByteBuffer* response)
+            : agent_impl_(agent_impl), response_(response), received_at_(std::chrono::steady_clock::now()) {
+            agent_impl_->mMetrics.get_image.callStarted(request->Length());
+            grpc::ByteBuffer request_copy(*request);
+            if (!grpc::SerializationTraits<GetImageRequest>::Deserialize(&request_copy, &request_).ok()) {
+                Finish(grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, "Malformed GetImageRequest"));
+                return;
+            }
+            AGENT_LOG_DEBUG("[RAYVISION] GetImage request received for camera type: " << request_.type());
             // Start processing in background
             StartProcessing();
         }
 
         void StartProcessing() {
-            // Process the request asynchronously
+            auto listener = agent_impl_->mListener.lock();
+            if (!listener) {
+                Finish(grpc::Status(grpc::StatusCode::INTERNAL, "Listener not available"));
+                return;
+            }
+
+            // Concurrent requests for the same camera share one listener call
+            int camera_type = request_.type();
+            auto& metrics = agent_impl_->mMetrics.get_image;
+            agent_impl_->mFrameCache.get(
+                camera_type,
+                [&listener, &metrics, camera_type]() {
+                    auto listener_started = std::chrono::steady_clock::now();
+                    auto image_data = listener->onGetImage(camera_type);
+                    metrics.listenerFinished(listener_started);
+                    stampCaptureTime(image_data);
+                    return image_data;
+                },
+                [this](const FrameCache::FramePtr& frame, std::exception_ptr error) { OnFrame(frame, error); });
+        }
+
+        void OnFrame(const FrameCache::FramePtr& frame, std::exception_ptr error) {
             try {
-                auto listener = agent_impl_->mListener.lock();
-                if (!listener) {
-                    response_->set_width(0);
-                    response_->set_height(0);
-                    response_->set_colorspace(rayvisiongrpc::ColorSpace::RGB);
-                    response_->set_buffer("");
-                    Finish(grpc::Status(grpc::StatusCode::INTERNAL, "Listener not available"));
-                    return;
+                if (error) {
+                    std::rethrow_exception(error);
                 }
 
-                // Call listener to get image data
-                auto image_data = listener->onGetImage(request_->type());
+                // A cropped, scaled or converted frame is this caller's own copy
+                FrameCache::FramePtr image_data = frame;
+                const bool transformed = wantsTransform(request_);
+                if (transformed) {
+                    auto transformed_frame = std::make_shared<rayvision::ImageData>();
+                    grpc::Status status =
+                        transformFrame(*frame, request_, agent_impl_->mTransformPool, transformed_frame.get());
+                    if (!status.ok()) {
+                        Finish(status);
+                        return;
+                    }
+                    image_data = std::move(transformed_frame);
+                }
 
                 // Convert to gRPC response
-                response_->set_width(image_data.width);
-                response_->set_height(image_data.height);
-                response_->set_colorspace(static_cast<rayvisiongrpc::ColorSpace>(image_data.colorspace));
-                response_->set_buffer(image_data.buffer.data(), image_data.buffer.size());
+                rayvisiongrpc::ImageData image_fields;
+                image_fields.set_width(image_data->width);
+                image_fields.set_height(image_data->height);
+                image_fields.set_colorspace(static_cast<rayvisiongrpc::ColorSpace>(image_data->colorspace));
 
-                std::cout << "[RAYVISION] GetImage response prepared (size: " << response_->buffer().size() << " bytes)" << std::endl;
+                FrameMessageWriter writer;
+                size_t buffer_size = frameSize(image_data->buffer);
+                if (request_.use_shared_memory() && image_data->buffer &&
+                    agent_impl_->writeSharedFrame(*image_data->buffer, image_fields.mutable_shared_frame())) {
+                    image_fields.set_capture_time_us(image_data->capture_time_us);
+                    writer.appendMessage(image_fields);
+                    AGENT_LOG_DEBUG("[RAYVISION] GetImage frame placed in shared memory (size: "
+                                    << image_fields.shared_frame().length() << " bytes)");
+                } else if (request_.accept_frame_codec() && buffer_size && !transformed) {
+                    // Transformed frames are per call, so only whole frames are kept as references
+                    image_fields.clear_shared_frame();
+                    writer.appendMessage(image_fields);
+                    auto encoded = agent_impl_->encodeFrame(request_.type(), image_data, request_.reference_frame_id());
+                    const auto& payload = encoded.buffer ? encoded.buffer : image_data->buffer;
+                    writer.appendFrame(rayvisiongrpc::ImageData::kBufferFieldNumber, payload, 0, payload->size());
+
+                    // Fields after the buffer, in field-number order
+                    rayvisiongrpc::ImageData codec_fields;
+                    codec_fields.set_frame_id(encoded.frame_id);
+                    codec_fields.set_encoding(encoded.encoding);
+                    codec_fields.set_reference_frame_id(encoded.reference_frame_id);
+                    codec_fields.set_raw_size(buffer_size);
+                    codec_fields.set_capture_time_us(image_data->capture_time_us);
+                    writer.appendMessage(codec_fields);
+                    AGENT_LOG_DEBUG("[RAYVISION] GetImage frame " << encoded.frame_id << " coded as "
+                                    << rayvisiongrpc::FrameEncoding_Name(encoded.encoding) << " ("
+                                    << payload->size() << " of " << buffer_size << " bytes)");
+                } else {
+                    image_fields.clear_shared_frame();
+                    writer.appendMessage(image_fields);
+                    if (buffer_size) {
+                        writer.appendFrame(rayvisiongrpc::ImageData::kBufferFieldNumber, image_data->buffer, 0,
+                                           buffer_size);
+                    }
+                    writer.appendInt64Field(rayvisiongrpc::ImageData::kCaptureTimeUsFieldNumber,
+                                            image_data->capture_time_us);
+                    AGENT_LOG_DEBUG("[RAYVISION] GetImage response prepared (size: " << buffer_size << " bytes)");
+                }
+                writer.finish(response_);
+                agent_impl_->mMetrics.get_image.messageSent(response_->Length());
+                ok_ = true;
                 Finish(grpc::Status::OK);
             } catch (const std::exception& e) {
-                std::cerr << "[RAYVISION] GetImage error: " << e.what() << std::endl;
-                response_->set_width(0);
-                response_->set_height(0);
-                response_->set_colorspace(rayvisiongrpc::ColorSpace::RGB);
-                response_->set_buffer("");
+                AGENT_LOG_ERROR("[RAYVISION] GetImage error: " << e.what());
                 Finish(grpc::Status(grpc::StatusCode::INTERNAL, "Failed to get image: " + std::string(e.what())));
             }
         }
 
         void OnDone() override {
             // Cleanup when the reactor is done
+            agent_impl_->mMetrics.get_image.callFinished(received_at_, ok_);
             delete this;
         }
 
     private:
         Impl* agent_impl_;
-        const GetImageRequest* request_;
-        rayvisiongrpc::ImageData* response_;
+        GetImageRequest request_;
+        grpc::ByteBuffer* response_;
+        const std::chrono::steady_clock::time_point received_at_;
+        bool ok_ = false;
     };
 
-    class DoSegmentationReactor : public grpc::ServerWriteReactor<rayvisiongrpc::SegmentationResult> {
+    // Raw method like GetImage: every frame in the reply references its buffer.
+    // The cameras are captured by one listener call, and concurrent calls for
+    // the same cameras share it.
+    class BatchGetImageReactor : public grpc::ServerUnaryReactor {
     public:
-        DoSegmentationReactor(Impl* agent_impl, const rayvisiongrpc::Empty* request)
-            : agent_impl_(agent_impl), request_(request), finished_(false) {
+        BatchGetImageReactor(Impl* agent_impl, const grpc::ByteBuffer* request, grpc::ByteBuffer* response)
+            : agent_impl_(agent_impl), response_(response), received_at_(std::chrono::steady_clock::now()) {
+            agent_impl_->mMetrics.batch_get_image.callStarted(request->Length());
+            rayvisiongrpc::BatchGetImageRequest batch_request;
+            grpc::ByteBuffer request_copy(*request);
+            if (!grpc::SerializationTraits<rayvisiongrpc::BatchGetImageRequest>::Deserialize(&request_copy,
+                                                                                            &batch_request)
+                     .ok()) {
+                Finish(grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, "Malformed BatchGetImageRequest"));
+                return;
+            }
+
+            std::set<int> seen;
+            for (int camera_type : batch_request.types()) {
+                if (!seen.insert(camera_type).second) {
+                    Finish(grpc::Status(grpc::StatusCode::INVALID_ARGUMENT,
+                                        "Camera type " + std::to_string(camera_type) + " is requested twice"));
+                    return;
+                }
+                camera_types_.push_back(camera_type);
+            }
+            if (camera_types_.empty() || camera_types_.size() > kMaxBatchCameras) {
+                Finish(grpc::Status(grpc::StatusCode::INVALID_ARGUMENT,
+                                    "BatchGetImage takes 1 to " + std::to_string(kMaxBatchCameras) + " cameras"));
+                return;
+            }
+            AGENT_LOG_DEBUG("[RAYVISION] BatchGetImage request received for " << camera_types_.size() << " cameras");
+            StartProcessing();
+        }
+
+        void StartProcessing() {
+            auto listener = agent_impl_->mListener.lock();
+            if (!listener) {
+                Finish(grpc::Status(grpc::StatusCode::INTERNAL, "Listener not available"));
+                return;
+            }
+
+            auto* agent_impl = agent_impl_;
+            agent_impl_->mBatchCache.get(
+                camera_types_,
+                [&listener, agent_impl, this]() {
+                    auto listener_started = std::chrono::steady_clock::now();
+                    auto frames = listener->onGetImages(camera_types_);
+                    agent_impl->mMetrics.batch_get_image.listenerFinished(listener_started);
+                    if (frames.size() != camera_types_.size()) {
+                        throw std::runtime_error("listener returned " + std::to_string(frames.size()) +
+                                                 " frames for " + std::to_string(camera_types_.size()) +
+                                                 " cameras");
+                    }
+                    // Fresh frames: GetImage calls within the frame age reuse them
+                    for (size_t i = 0; i < frames.size(); ++i) {
+                        stampCaptureTime(frames[i]);
+                        agent_impl->mFrameCache.put(camera_types_[i],
+                                                    std::make_shared<const rayvision::ImageData>(frames[i]));
+                    }
+                    return frames;
+                },
+                [this](const BatchCache::FramePtr& frames, std::exception_ptr error) { OnFrames(frames, error); });
+        }
+
+        void OnFrames(const BatchCache::FramePtr& frames, std::exception_ptr error) {
+            try {
+                if (error) {
+                    std::rethrow_exception(error);
+                }
+                serializeBatch(*frames, response_);
+                agent_impl_->mMetrics.batch_get_image.messageSent(response_->Length());
+                ok_ = true;
+                Finish(grpc::Status::OK);
+            } catch (const std::exception& e) {
+                AGENT_LOG_ERROR("[RAYVISION] BatchGetImage error: " << e.what());
+                Finish(grpc::Status(grpc::StatusCode::INTERNAL, "Failed to get images: " + std::string(e.what())));
+            }
+        }
+
+        void OnDone() override {
+            agent_impl_->mMetrics.batch_get_image.callFinished(received_at_, ok_);
+            delete this;
+        }
+
+    private:
+        Impl* agent_impl_;
+        std::vector<int> camera_types_; // In request order
+        grpc::ByteBuffer* response_;
+        const std::chrono::steady_clock::time_point received_at_;
+        bool ok_ = false;
+    };
+
+    // Raw writer: every data chunk is a slice of the frame buffer, so no chunk is
+    // copied into an ImageChunk message
+    class GetImageChunkedReactor : public grpc::ServerWriteReactor<grpc::ByteBuffer> {
+    public:
+        GetImageChunkedReactor(Impl* agent_impl, const grpc::ByteBuffer* request)
+            : agent_impl_(agent_impl), offset_(0), chunk_size_(kDefaultChunkSize),
+              received_at_(std::chrono::steady_clock::now()) {
+            agent_impl_->mMetrics.get_image_chunked.callStarted(request->Length());
+            grpc::ByteBuffer request_copy(*request);
+            if (!grpc::SerializationTraits<rayvisiongrpc::GetImageChunkedRequest>::Deserialize(&request_copy,
+                                                                                              &request_).ok()) {
+                Finish(grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, "Malformed GetImageChunkedRequest"));
+                return;
+            }
+            chunk_size_ = negotiateChunkSize(request_.chunk_size());
+            AGENT_LOG_DEBUG("[RAYVISION] GetImageChunked request received for camera type: " << request_.type()
+                            << ", chunk size: " << request_.chunk_size());
+            StartProcessing();
+        }
+
+        void StartProcessing() {
+            auto listener = agent_impl_->mListener.lock();
+            if (!listener) {
+                Finish(grpc::Status(grpc::StatusCode::INTERNAL, "Listener not available"));
+                return;
+            }
+
+            int camera_type = request_.type();
+            auto& metrics = agent_impl_->mMetrics.get_image_chunked;
+            agent_impl_->mFrameCache.get(
+                camera_type,
+                [&listener, &metrics, camera_type]() {
+                    auto listener_started = std::chrono::steady_clock::now();
+                    auto image_data = listener->onGetImage(camera_type);
+                    metrics.listenerFinished(listener_started);
+                    stampCaptureTime(image_data);
+                    return image_data;
+                },
+                [this](const FrameCache::FramePtr& frame, std::exception_ptr error) { OnFrame(frame, error); });
+        }
+
+        void OnFrame(const FrameCache::FramePtr& frame, std::exception_ptr error) {
+            try {
+                if (error) {
+                    std::rethrow_exception(error);
+                }
+
+                // The shared frame stays with the reactor; chunks reference it in place
+                image_data_ = frame;
+                total_size_ = frameSize(image_data_->buffer);
+
+                rayvisiongrpc::ImageChunk header_chunk;
+                auto* header = header_chunk.mutable_header();
+                header->set_width(image_data_->width);
+                header->set_height(image_data_->height);
+                header->set_colorspace(static_cast<rayvisiongrpc::ColorSpace>(image_data_->colorspace));
+                header->set_total_size(total_size_);
+                header->set_chunk_size(chunk_size_);
+                bool own_buffer = false;
+                grpc::SerializationTraits<rayvisiongrpc::ImageChunk>::Serialize(header_chunk, &chunk_, &own_buffer);
+
+                AGENT_LOG_DEBUG("[RAYVISION] GetImageChunked streaming " << total_size_
+                                << " bytes in chunks of " << chunk_size_ << " bytes");
+                agent_impl_->mMetrics.get_image_chunked.messageSent(chunk_.Length());
+                StartWrite(&chunk_);
+            } catch (const std::exception& e) {
+                AGENT_LOG_ERROR("[RAYVISION] GetImageChunked error: " << e.what());
+                Finish(grpc::Status(grpc::StatusCode::INTERNAL, "Failed to get image: " + std::string(e.what())));
+            }
+        }
+
+        void OnWriteDone(bool ok) override {
+            if (!ok) {
+                Finish(grpc::Status(grpc::StatusCode::INTERNAL, "Failed to write image chunk"));
+                return;
+            }
+
+            if (offset_ >= total_size_) {
+                ok_ = true;
+                Finish(grpc::Status::OK);
+                return;
+            }
+
+            size_t length = std::min<size_t>(chunk_size_, total_size_ - offset_);
+            FrameMessageWriter writer;
+            writer.appendFrame(rayvisiongrpc::ImageChunk::kDataFieldNumber, image_data_->buffer, offset_, length);
+            writer.finish(&chunk_);
+            offset_ += length;
+            agent_impl_->mMetrics.get_image_chunked.messageSent(chunk_.Length());
+            StartWrite(&chunk_);
+        }
+
+        void OnDone() override {
+            agent_impl_->mMetrics.get_image_chunked.callFinished(received_at_, ok_);
+            delete this;
+        }
+
+    private:
+        static constexpr uint32_t kDefaultChunkSize = 64 * 1024;
+        static constexpr uint32_t kMinChunkSize = 4 * 1024;
+        static constexpr uint32_t kMaxChunkSize = 1024 * 1024;
+
+        static uint32_t negotiateChunkSize(uint32_t requested) {
+            if (requested == 0) {
+                return kDefaultChunkSize;
+            }
+            return std::clamp(requested, kMinChunkSize, kMaxChunkSize);
+        }
+
+        Impl* agent_impl_;
+        rayvisiongrpc::GetImageChunkedRequest request_;
+        FrameCache::FramePtr image_data_;
+        grpc::ByteBuffer chunk_; // Written message; replaced once its write is done
+        size_t total_size_ = 0;
+        size_t offset_;
+        uint32_t chunk_size_;
+        const std::chrono::steady_clock::time_point received_at_;
+        bool ok_ = false;
+    };
+
+    // Raw (ByteBuffer) writer so a pre-serialized result can be shared by all
+    // reactors. Results go through a bounded queue drained from OnWriteDone; the
+    // agent's SegmentationStreamOptions decide what happens when it is full.
+    // Owned by shared_ptr so sendSegmentationResult can use it outside the
+    // registry lock; OnDone drops the self reference.
+    class DoSegmentationReactor : public grpc::ServerWriteReactor<grpc::ByteBuffer>,
+                                  public std::enable_shared_from_this<DoSegmentationReactor> {
+    public:
+        DoSegmentationReactor(Impl* agent_impl, const rayvisiongrpc::SegmentationRequest& request)
+            : agent_impl_(agent_impl),
+              options_(agent_impl->mStreamOptions),
+              max_results_(request.max_results() == 0 ? 1 : request.max_results()),
+              continuous_(request.continuous()),
+              received_at_(std::chrono::steady_clock::now()) {
+            // DropOldest needs a slot behind the write in flight for the newest result
+            options_.max_queued_results = std::max<size_t>(
+                options_.max_queued_results, options_.overflow_policy == OverflowPolicy::DropOldest ? 2 : 1);
+            agent_impl_->mMetrics.segmentation.callStarted(request.ByteSizeLong());
+            agent_impl_->mMetrics.segmentation_streams.add(1);
+        }
+
+        void Start() {
+            self_ = shared_from_this();
+
             // Register this reactor with the agent
             agent_impl_->registerSegmentationReactor(this);
 
-            // Start processing in background
             StartProcessing();
         }
 
+        // Ends the call without registering it, e.g. for a malformed request
+        void Reject(const grpc::Status& status) {
+            self_ = shared_from_this();
+            FinishWith(status);
+        }
+
         void StartProcessing() {
             // Check if server is shutting down
             if (agent_impl_->mStopServer) {
-                Finish(grpc::Status(grpc::StatusCode::CANCELLED, "Server shutting down"));
+                FinishWith(grpc::Status(grpc::StatusCode::CANCELLED, "Server shutting down"));
                 return;
             }
 
             auto listener = agent_impl_->mListener.lock();
             if (!listener) {
-                Finish(grpc::Status(grpc::StatusCode::INTERNAL, "Listener not available"));
+                FinishWith(grpc::Status(grpc::StatusCode::INTERNAL, "Listener not available"));
                 return;
             }
 
@@ -225,83 +1167,553 @@ private:
                 // The listener should process this asynchronously and call sendSegmentationResult when ready
                 listener->onDoSegmentation();
 
-                std::cout << "[RAYVISION] Segmentation request notified to listener" << std::endl;
+                AGENT_LOG_DEBUG("[RAYVISION] Segmentation request notified to listener");
 
                 // Don't finish here - wait for sendSegmentationResult to be called
                 // The reactor will stay active until the result is ready
 
             } catch (const std::exception& e) {
-                std::cerr << "[RAYVISION] Segmentation error: " << e.what() << std::endl;
-                Finish(grpc::Status(grpc::StatusCode::INTERNAL, "Segmentation failed: " + std::string(e.what())));
+                AGENT_LOG_ERROR("[RAYVISION] Segmentation error: " << e.what());
+                FinishWith(grpc::Status(grpc::StatusCode::INTERNAL, "Segmentation failed: " + std::string(e.what())));
+            }
+        }
+
+        // Queues a result without waiting. Returns false only when the queue is full
+        // under the Block policy; the caller then uses EnqueueBlocking.
+        bool TryEnqueue(const grpc::ByteBuffer& payload) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!acceptingLocked()) {
+                return true;
+            }
+            if (queue_.size() >= options_.max_queued_results) {
+                switch (options_.overflow_policy) {
+                case OverflowPolicy::DropOldest:
+                    dropOldestLocked();
+                    break;
+                case OverflowPolicy::Block:
+                    return false;
+                case OverflowPolicy::Disconnect:
+                    AGENT_LOG_WARN("[RAYVISION] Disconnecting slow segmentation consumer");
+                    finishLocked(grpc::Status(grpc::StatusCode::RESOURCE_EXHAUSTED, "Segmentation consumer too slow"));
+                    return true;
+                }
+            }
+            pushLocked(payload);
+            return true;
+        }
+
+        void EnqueueBlocking(const grpc::ByteBuffer& payload, std::chrono::steady_clock::time_point deadline) {
+            std::unique_lock<std::mutex> lock(mutex_);
+            bool has_room = space_cv_.wait_until(lock, deadline, [this]() {
+                return !acceptingLocked() || queue_.size() < options_.max_queued_results;
+            });
+            if (!acceptingLocked()) {
+                return;
+            }
+            if (!has_room) {
+                AGENT_LOG_WARN("[RAYVISION] Segmentation consumer blocked for too long, disconnecting");
+                finishLocked(grpc::Status(grpc::StatusCode::RESOURCE_EXHAUSTED, "Segmentation consumer too slow"));
+                return;
+            }
+            pushLocked(payload);
+        }
+
+        void OnWriteDone(bool ok) override {
+            std::lock_guard<std::mutex> lock(mutex_);
+            queue_.pop_front();
+            agent_impl_->mMetrics.segmentation_queued.add(-1);
+            space_cv_.notify_all();
+            if (finished_) {
+                return;
+            }
+            if (!ok) {
+                finishLocked(grpc::Status(grpc::StatusCode::INTERNAL, "Failed to write segmentation result"));
+                return;
+            }
+
+            AGENT_LOG_DEBUG("[RAYVISION] Segmentation result sent successfully");
+            if (!queue_.empty()) {
+                StartWrite(&queue_.front());
+            } else if (!continuous_ && results_accepted_ >= max_results_) {
+                finishLocked(grpc::Status::OK);
             }
         }
 
+        void OnCancel() override {
+            FinishWith(grpc::Status::CANCELLED);
+        }
+
         void OnDone() override {
-            // Cleanup when the reactor is done
+            // Cleanup when the reactor is done; the last shared reference deletes it
             agent_impl_->unregisterSegmentationReactor(this);
-            delete this;
+            auto& metrics = agent_impl_->mMetrics;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                metrics.segmentation_queued.add(-static_cast<int64_t>(queue_.size()));
+            }
+            metrics.segmentation_streams.add(-1);
+            metrics.segmentation.callFinished(received_at_, ok_);
+            self_.reset();
         }
 
-        void OnWriteDone(bool ok) override {
-            if (ok) {
-                std::cout << "[RAYVISION] Segmentation result sent successfully" << std::endl;
+    private:
+        bool acceptingLocked() const {
+            return !finished_ && (continuous_ || results_accepted_ < max_results_);
+        }
+
+        // Front of the queue is the write in flight, so drop the next one; the
+        // queue holds at least two. A dropped result was never delivered, so it
+        // no longer counts toward max_results.
+        void dropOldestLocked() {
+            queue_.erase(queue_.begin() + 1);
+            results_accepted_--;
+            agent_impl_->mMetrics.segmentation_queued.add(-1);
+            dropped_results_++;
+            agent_impl_->mMetrics.segmentation_dropped.add(1);
+            AGENT_LOG_DEBUG("[RAYVISION] Dropped stale segmentation result for slow consumer (total dropped: "
+                            << dropped_results_ << ")");
+        }
+
+        void pushLocked(const grpc::ByteBuffer& payload) {
+            auto& metrics = agent_impl_->mMetrics;
+            if (results_accepted_ == 0) {
+                // The listener has no per-call handle, so its latency is the wait for the first result
+                metrics.segmentation.listenerFinished(received_at_);
+            }
+            metrics.segmentation.messageSent(payload.Length());
+            metrics.segmentation_queued.add(1);
+            results_accepted_++;
+            queue_.push_back(payload);
+            if (queue_.size() == 1) {
+                StartWrite(&queue_.front());
+            }
+        }
+
+        void FinishWith(const grpc::Status& status) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            finishLocked(status);
+        }
+
+        void finishLocked(const grpc::Status& status) {
+            if (!finished_) {
                 finished_ = true;
-                Finish(grpc::Status::OK);
-            } else {
-                Finish(grpc::Status(grpc::StatusCode::INTERNAL, "Failed to write segmentation result"));
+                ok_ = status.ok();
+                space_cv_.notify_all();
+                Finish(status);
+            }
+        }
+
+        Impl* agent_impl_;
+        SegmentationStreamOptions options_;
+        const uint32_t max_results_;
+        const bool continuous_;
+        std::shared_ptr<DoSegmentationReactor> self_; // Keeps the reactor alive until OnDone
+
+        std::mutex mutex_;
+        std::condition_variable space_cv_;
+        std::deque<grpc::ByteBuffer> queue_; // Front is the write in flight
+        uint32_t results_accepted_ = 0;
+        uint64_t dropped_results_ = 0;
+        const std::chrono::steady_clock::time_point received_at_;
+        bool finished_ = false;
+        bool ok_ = false;
+    };
+
+    // Pushes one camera's frames as the listener publishes them. Each stream
+    // sends at most max_fps frames per second: a frame that arrives early waits
+    // for an alarm, and newer frames replace it under DROP_TO_LATEST. While a
+    // write is in flight, later frames wait the same way, so a slow reader gets
+    // the freshest frames rather than a growing backlog.
+    class SubscribeFramesReactor : public grpc::ServerWriteReactor<grpc::ByteBuffer>,
+                                   public std::enable_shared_from_this<SubscribeFramesReactor> {
+    public:
+        SubscribeFramesReactor(Impl* agent_impl, const grpc::ByteBuffer* request)
+            : agent_impl_(agent_impl), received_at_(std::chrono::steady_clock::now()) {
+            agent_impl_->mMetrics.subscribe_frames.callStarted(request->Length());
+            agent_impl_->mMetrics.frame_subscribers.add(1);
+            grpc::ByteBuffer request_copy(*request);
+            valid_ = grpc::SerializationTraits<rayvisiongrpc::SubscribeFramesRequest>::Deserialize(&request_copy,
+                                                                                                  &request_)
+                         .ok();
+            if (validFrameRate(request_.max_fps()) && request_.max_fps() > 0) {
+                interval_ = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                    std::chrono::duration<double>(1.0 / request_.max_fps()));
+            }
+            max_pending_ = request_.drop_policy() == rayvisiongrpc::DROP_OLDEST ? kMaxPendingFrames : 1;
+        }
+
+        void Start() {
+            self_ = shared_from_this();
+            if (!valid_) {
+                FinishWith(grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, "Malformed SubscribeFramesRequest"));
+                return;
+            }
+            if (!validFrameRate(request_.max_fps())) {
+                FinishWith(grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, "max_fps must be 0 or between 0.01 and 1000"));
+                return;
+            }
+            AGENT_LOG_INFO("[RAYVISION] SubscribeFrames request received (camera type: " << request_.type()
+                           << ", max fps: " << request_.max_fps() << ", drop policy: "
+                           << rayvisiongrpc::FrameDropPolicy_Name(request_.drop_policy()) << ")");
+            agent_impl_->registerFrameSubscriber(request_.type(), this);
+            if (agent_impl_->mStopServer) {
+                FinishWith(grpc::Status(grpc::StatusCode::CANCELLED, "Server shutting down"));
+            }
+        }
+
+        // A newly published frame; the oldest unsent one goes when too many wait
+        void Offer(const grpc::ByteBuffer& payload) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (finished_) {
+                return;
+            }
+            if (pending_.size() >= max_pending_) {
+                pending_.pop_front();
+                dropped_frames_++;
+                agent_impl_->mMetrics.frames_dropped.add(1);
+                AGENT_LOG_DEBUG("[RAYVISION] Dropped stale frame for slow subscriber (total dropped: "
+                                << dropped_frames_ << ")");
+            }
+            pending_.push_back(payload);
+            sendNextLocked();
+        }
+
+        void OnWriteDone(bool ok) override {
+            std::lock_guard<std::mutex> lock(mutex_);
+            write_in_flight_ = false;
+            if (finished_) {
+                return;
+            }
+            if (!ok) {
+                finishLocked(grpc::Status(grpc::StatusCode::INTERNAL, "Failed to write frame"));
+                return;
             }
+            sendNextLocked();
+        }
+
+        // Ends the stream, e.g. when the server shuts down
+        void Close(const grpc::Status& status) {
+            FinishWith(status);
+        }
+
+        void OnCancel() override {
+            FinishWith(grpc::Status::CANCELLED);
         }
 
-        bool IsFinished() const { return finished_; }
+        void OnDone() override {
+            // The alarm callback only holds a weak reference; the last shared one deletes the reactor
+            agent_impl_->unregisterFrameSubscriber(request_.type(), this);
+            std::unique_ptr<grpc::Alarm> alarm;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                alarm = std::move(alarm_);
+            }
+            alarm.reset(); // Cancels a pending alarm, outside the lock its callback takes
+            agent_impl_->mMetrics.frame_subscribers.add(-1);
+            agent_impl_->mMetrics.subscribe_frames.callFinished(received_at_, ok_);
+            self_.reset();
+        }
 
     private:
+        static constexpr size_t kMaxPendingFrames = 4;
+        // Bounds on max_fps, so the frame interval stays representable
+        static constexpr float kMinFrameRate = 0.01f;
+        static constexpr float kMaxFrameRate = 1000.0f;
+
+        // Zero means no limit; NaN fails both comparisons
+        static bool validFrameRate(float max_fps) {
+            return max_fps == 0 || (max_fps >= kMinFrameRate && max_fps <= kMaxFrameRate);
+        }
+
+        // Writes the oldest pending frame now, or arms the alarm for when this
+        // stream's rate allows the next one
+        void sendNextLocked() {
+            if (write_in_flight_ || alarm_armed_ || pending_.empty()) {
+                return;
+            }
+            auto now = std::chrono::steady_clock::now();
+            if (now < next_write_at_) {
+                alarm_armed_ = true;
+                // A fresh alarm each time: this may run inside the previous one's callback
+                alarm_ = std::make_unique<grpc::Alarm>();
+                std::weak_ptr<SubscribeFramesReactor> weak_self = weak_from_this();
+                alarm_->Set(std::chrono::system_clock::now() + (next_write_at_ - now), [weak_self](bool) {
+                    if (auto self = weak_self.lock()) {
+                        self->OnAlarm();
+                    }
+                });
+                return;
+            }
+
+            write_buffer_ = std::move(pending_.front());
+            pending_.pop_front();
+            next_write_at_ = now + interval_;
+            write_in_flight_ = true;
+            agent_impl_->mMetrics.subscribe_frames.messageSent(write_buffer_.Length());
+            StartWrite(&write_buffer_);
+        }
+
+        void OnAlarm() {
+            std::lock_guard<std::mutex> lock(mutex_);
+            alarm_armed_ = false;
+            if (!finished_) {
+                sendNextLocked();
+            }
+        }
+
+        void FinishWith(const grpc::Status& status) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            finishLocked(status);
+        }
+
+        void finishLocked(const grpc::Status& status) {
+            if (!finished_) {
+                finished_ = true;
+                ok_ = status.ok();
+                pending_.clear();
+                Finish(status);
+            }
+        }
+
         Impl* agent_impl_;
-        const rayvisiongrpc::Empty* request_;
-        bool finished_;
+        rayvisiongrpc::SubscribeFramesRequest request_;
+        bool valid_ = false;
+        std::chrono::steady_clock::duration interval_{0}; // Zero: no rate limit
+        size_t max_pending_ = 1;
+        const std::chrono::steady_clock::time_point received_at_;
+        std::shared_ptr<SubscribeFramesReactor> self_; // Keeps the reactor alive until OnDone
+
+        std::mutex mutex_;
+        std::deque<grpc::ByteBuffer> pending_; // Oldest first
+        grpc::ByteBuffer write_buffer_;        // The write in flight
+        std::unique_ptr<grpc::Alarm> alarm_;
+        std::chrono::steady_clock::time_point next_write_at_;
+        uint64_t dropped_frames_ = 0;
+        bool write_in_flight_ = false;
+        bool alarm_armed_ = false;
+        bool finished_ = false;
+        bool ok_ = false;
     };
 
-    class RayVisionServiceImpl final : public RayVisionGrpc::CallbackService {
-    public:
-        RayVisionServiceImpl(Impl* agent_impl) : agent_impl_(agent_impl) {}
+    // GetImage, BatchGetImage, GetImageChunked, doSegmentation and
+    // SubscribeFrames are raw methods so that their replies can reference frame
+    // buffers instead of copying them
+    using RayVisionServiceBase = RayVisionGrpc::WithRawCallbackMethod_GetImage<
+        RayVisionGrpc::WithRawCallbackMethod_BatchGetImage<
+            RayVisionGrpc::WithRawCallbackMethod_GetImageChunked<
+                RayVisionGrpc::WithRawCallbackMethod_doSegmentation<
+                    RayVisionGrpc::WithRawCallbackMethod_SubscribeFrames<RayVisionGrpc::CallbackService>>>>>;
 
-                ServerUnaryReactor* GetImage(CallbackServerContext* context, const GetImageRequest* request,
-                       rayvisiongrpc::ImageData* response) override {
-            std::cout << "[RAYVISION] GetImage request received for camera type: " << request->type() << std::endl;
+    class RayVisionServiceImpl final : public RayVisionServiceBase {
+    public:
+        RayVisionServiceImpl(Impl* agent_impl) : agent_impl_(agent_impl) {
+            // Stats requests and replies are built on pooled arenas
+            SetMessageAllocatorFor_GetStats(&stats_allocator_);
+        }
 
+        ServerUnaryReactor* GetImage(CallbackServerContext* context, const grpc::ByteBuffer* request,
+                                     grpc::ByteBuffer* response) override {
+            common::applyRequestedCompression(context);
             return new GetImageReactor(agent_impl_, request, response);
         }
 
-                ServerWriteReactor<rayvisiongrpc::SegmentationResult>* doSegmentation(CallbackServerContext* context, const rayvisiongrpc::Empty* request) override {
-            std::cout << "[RAYVISION] doSegmentation request received" << std::endl;
+        ServerUnaryReactor* BatchGetImage(CallbackServerContext* context, const grpc::ByteBuffer* request,
+                                          grpc::ByteBuffer* response) override {
+            common::applyRequestedCompression(context);
+            return new BatchGetImageReactor(agent_impl_, request, response);
+        }
+
+        ServerWriteReactor<grpc::ByteBuffer>* GetImageChunked(CallbackServerContext* context,
+                                                             const grpc::ByteBuffer* request) override {
+            common::applyRequestedCompression(context);
+            return new GetImageChunkedReactor(agent_impl_, request);
+        }
+
+        ServerWriteReactor<grpc::ByteBuffer>* doSegmentation(CallbackServerContext* context,
+                                                             const grpc::ByteBuffer* request) override {
+            common::applyRequestedCompression(context);
+            rayvisiongrpc::SegmentationRequest segmentation_request;
+            grpc::ByteBuffer request_copy(*request);
+            bool valid = grpc::SerializationTraits<rayvisiongrpc::SegmentationRequest>::Deserialize(
+                             &request_copy, &segmentation_request)
+                             .ok();
+            auto reactor = std::make_shared<DoSegmentationReactor>(agent_impl_, segmentation_request);
+            if (!valid) {
+                reactor->Reject(grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, "Malformed SegmentationRequest"));
+                return reactor.get();
+            }
+            AGENT_LOG_INFO("[RAYVISION] doSegmentation request received (max results: "
+                           << segmentation_request.max_results() << ", continuous: "
+                           << segmentation_request.continuous() << ")");
 
-            return new DoSegmentationReactor(agent_impl_, request);
+            reactor->Start();
+            return reactor.get();
+        }
+
+        ServerWriteReactor<grpc::ByteBuffer>* SubscribeFrames(CallbackServerContext* context,
+                                                              const grpc::ByteBuffer* request) override {
+            common::applyRequestedCompression(context);
+            auto reactor = std::make_shared<SubscribeFramesReactor>(agent_impl_, request);
+            reactor->Start();
+            return reactor.get();
+        }
+
+        ServerUnaryReactor* GetStats(CallbackServerContext* context, const rayvisiongrpc::StatsRequest* /*request*/,
+                                     rayvisiongrpc::StatsReply* response) override {
+            common::applyRequestedCompression(context);
+            common::fillStatsReply(agent_impl_->mMetrics.registry.snapshot(), response);
+
+            auto* reactor = context->DefaultReactor();
+            reactor->Finish(Status::OK);
+            return reactor;
         }
 
     private:
         Impl* agent_impl_;
+        common::ArenaMessageAllocator<rayvisiongrpc::StatsRequest, rayvisiongrpc::StatsReply> stats_allocator_;
     };
 
+    AgentMetrics mMetrics; // First member: outlives every reactor that records into it
     std::weak_ptr<IRayVisionServiceListener> mListener;
     std::thread mServerThread;
     std::atomic<bool> mStopServer;
+    const SegmentationStreamOptions mStreamOptions;
+    const common::ServerConfig mServerConfig;
+    const std::vector<std::string> mListenAddresses;
+    FrameCache mFrameCache;
+    BatchCache mBatchCache; // By camera list, in request order
+    std::unique_ptr<common::SharedFrameRing> mFrameRing; // Opt-in shared-memory transport for GetImage
+    std::mutex mCodecMutex; // Protects mCodecFrames and mNextFrameId
+    std::map<int, CodecFrames> mCodecFrames; // By camera type
+    uint64_t mNextFrameId = 1;
+    FrameBufferPool mCodecPool; // Encoded frames
+    FrameBufferPool mTransformPool; // Cropped, scaled and converted GetImage frames
     std::unique_ptr<Server> mServer; // Store server reference for shutdown
     std::mutex mServerMutex; // Protect server access
     std::mutex mSegmentationReactorsMutex; // Protect active segmentation reactors
-            std::set<void*> mActiveSegmentationReactors; // Track active segmentation requests
+    std::set<DoSegmentationReactor*> mActiveSegmentationReactors; // Track active segmentation requests
+    mutable std::mutex mFrameSubscribersMutex; // Protects mFrameSubscribers
+    std::map<int, std::set<SubscribeFramesReactor*>> mFrameSubscribers; // By camera type; no empty sets
 };
 
+FlatSegmentationResult::FlatSegmentationResult(FrameBufferPool& pool, size_t max_segments, size_t max_pixel_bytes)
+    : pixels(pool.acquire(max_pixel_bytes)) {
+    pixels->resize(0);
+    for (auto* column : {&left, &top, &right, &bottom, &width, &height, &colorspace}) {
+        column->reserve(max_segments);
+    }
+    mask_offset.reserve(max_segments);
+    mask_length.reserve(max_segments);
+}
+
+std::byte* FlatSegmentationResult::addSegment(int32_t segment_left, int32_t segment_top, int32_t segment_right,
+                                              int32_t segment_bottom, int32_t mask_width, int32_t mask_height,
+                                              int32_t mask_colorspace, size_t mask_size) {
+    size_t offset = pixels ? pixels->size() : 0;
+    if (mask_size && (!pixels || offset + mask_size > pixels->capacity())) {
+        throw std::length_error("FlatSegmentationResult pixel buffer is full");
+    }
+    if (pixels) {
+        pixels->resize(offset + mask_size);
+    }
+    left.push_back(segment_left);
+    top.push_back(segment_top);
+    right.push_back(segment_right);
+    bottom.push_back(segment_bottom);
+    width.push_back(mask_width);
+    height.push_back(mask_height);
+    colorspace.push_back(mask_colorspace);
+    mask_offset.push_back(offset);
+    mask_length.push_back(mask_size);
+    return pixels ? pixels->data() + offset : nullptr;
+}
+
+bool FlatSegmentationResult::isConsistent() const {
+    size_t count = left.size();
+    for (const auto* column : {&top, &right, &bottom, &width, &height, &colorspace}) {
+        if (column->size() != count) {
+            return false;
+        }
+    }
+    if (mask_offset.size() != count || mask_length.size() != count) {
+        return false;
+    }
+    size_t pixel_bytes = pixels ? pixels->size() : 0;
+    for (size_t i = 0; i < count; ++i) {
+        if (mask_length[i] && (mask_offset[i] > pixel_bytes || mask_length[i] > pixel_bytes - mask_offset[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::vector<ImageData> RayVisionServiceAgent::IRayVisionServiceListener::onGetImages(
+    const std::vector<int>& cameraTypes) {
+    // All but the first camera on their own threads; each frame is stamped as
+    // its capture returns, so the capture spread reflects the real skew
+    auto capture = [this](int camera_type) {
+        ImageData frame = onGetImage(camera_type);
+        stampCaptureTime(frame);
+        return frame;
+    };
+    std::vector<std::future<ImageData>> others;
+    for (size_t i = 1; i < cameraTypes.size(); ++i) {
+        others.push_back(std::async(std::launch::async, capture, cameraTypes[i]));
+    }
+
+    std::vector<ImageData> frames;
+    frames.reserve(cameraTypes.size());
+    if (!cameraTypes.empty()) {
+        frames.push_back(capture(cameraTypes.front()));
+    }
+    for (auto& other : others) {
+        frames.push_back(other.get());
+    }
+    return frames;
+}
+
 // Public interface implementation
-RayVisionServiceAgent::RayVisionServiceAgent(std::weak_ptr<IRayVisionServiceListener> listener)
-    : mImpl(std::make_unique<Impl>(listener)) {
-    std::cout << "[RAYVISION] RayVisionServiceAgent created" << std::endl;
+RayVisionServiceAgent::RayVisionServiceAgent(std::weak_ptr<IRayVisionServiceListener> listener,
+                                             const SegmentationStreamOptions& stream_options,
+                                             std::chrono::milliseconds frame_max_age,
+                                             const common::ServerConfig& server_config)
+    : mImpl(std::make_unique<Impl>(listener, stream_options, frame_max_age, server_config)) {
+    AGENT_LOG_INFO("[RAYVISION] RayVisionServiceAgent created");
 }
 
 RayVisionServiceAgent::~RayVisionServiceAgent() {
-    std::cout << "[RAYVISION] RayVisionServiceAgent destroyed" << std::endl;
+    AGENT_LOG_INFO("[RAYVISION] RayVisionServiceAgent destroyed");
 }
 
 void RayVisionServiceAgent::sendSegmentationResult(const rayvision::SegmentationResult& segmentation_result) {
     mImpl->sendSegmentationResult(segmentation_result);
 }
 
+void RayVisionServiceAgent::sendSegmentationResult(rayvision::SegmentationResult&& segmentation_result) {
+    // The streams hold their own references; ours go when the result does
+    rayvision::SegmentationResult result = std::move(segmentation_result);
+    mImpl->sendSegmentationResult(result);
+}
+
+void RayVisionServiceAgent::sendSegmentationResult(const rayvision::FlatSegmentationResult& segmentation_result) {
+    mImpl->sendSegmentationResult(segmentation_result);
+}
+
+void RayVisionServiceAgent::sendSegmentationResult(rayvision::FlatSegmentationResult&& segmentation_result) {
+    rayvision::FlatSegmentationResult result = std::move(segmentation_result);
+    mImpl->sendSegmentationResult(result);
+}
+
+void RayVisionServiceAgent::publishFrame(int cameraType, ImageData image_data) {
+    mImpl->publishFrame(cameraType, std::move(image_data));
+}
+
+bool RayVisionServiceAgent::hasFrameSubscribers(int cameraType) const {
+    return mImpl->hasFrameSubscribers(cameraType);
+}
+
+void RayVisionServiceAgent::enableMetricsDump(const std::string& path, std::chrono::milliseconds interval) {
+    mImpl->enableMetricsDump(path, interval);
+}
+
 } // namespace rayvision
\ No newline at end of file
@@ -1,15 +1,28 @@
 #pragma once
+#include "FrameBufferPool.h"
+#include "ServerConfig.h"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
 #include <memory>
 #include <string>
 #include <vector>
 
 namespace rayvision {
 
+// Pooled, refcounted frame memory. Listeners fill a buffer from their own pool
+// and hand it to the agent; gRPC writes reference it directly and the buffer
+// returns to the pool once the last write using it has completed.
+using FrameBuffer = common::FrameBuffer;
+using FrameBufferPtr = common::FrameBufferPtr;
+using FrameBufferPool = common::FrameBufferPool;
+
 struct ImageData {
     int width;
     int height;
-    int colorspace; // 1 = RGB, 2 = GRAY
-    std::vector<std::byte> buffer;
+    int colorspace; // rayvisiongrpc::ColorSpace: 0 = RGB, 1 = GRAY
+    FrameBufferPtr buffer; // Null for an empty image; not modified once handed to the agent
+    int64_t capture_time_us = 0; // Microseconds since the Unix epoch; 0 = stamped by the agent on receipt
 };
 
 struct SegmentData {
@@ -24,6 +37,57 @@ struct SegmentationResult {
     std::vector<std::unique_ptr<SegmentData>> segments;
 };
 
+// Segmentation result in one contiguous layout, for outputs with many masks:
+// bounding boxes and mask geometry as parallel arrays, and every mask back to
+// back in a single pooled pixel buffer. Building one costs a fixed handful of
+// allocations however many segments it holds, and encoding walks the arrays
+// in order.
+struct FlatSegmentationResult {
+    // One entry per segment
+    std::vector<int32_t> left;
+    std::vector<int32_t> top;
+    std::vector<int32_t> right;
+    std::vector<int32_t> bottom;
+    std::vector<int32_t> width;
+    std::vector<int32_t> height;
+    std::vector<int32_t> colorspace;
+    std::vector<uint64_t> mask_offset; // Into pixels
+    std::vector<uint64_t> mask_length;
+
+    FrameBufferPtr pixels; // All masks; size() is the bytes in use
+
+    FlatSegmentationResult() = default;
+
+    // Room for max_segments segments and max_pixel_bytes of mask data
+    FlatSegmentationResult(FrameBufferPool& pool, size_t max_segments, size_t max_pixel_bytes);
+
+    size_t size() const { return left.size(); }
+
+    // Appends a segment and returns its mask_size bytes for the caller to fill.
+    // Throws std::length_error when pixels has no room left.
+    std::byte* addSegment(int32_t segment_left, int32_t segment_top, int32_t segment_right, int32_t segment_bottom,
+                          int32_t mask_width, int32_t mask_height, int32_t mask_colorspace, size_t mask_size);
+
+    const std::byte* mask(size_t index) const { return pixels->data() + mask_offset[index]; }
+
+    // Whether every column has size() entries and every mask lies within
+    // pixels; results filled in by hand are checked before they are encoded
+    bool isConsistent() const;
+};
+
+// What a doSegmentation stream does when its outbound queue is full
+enum class OverflowPolicy {
+    DropOldest, // Discard the oldest queued result (live perception data)
+    Block,      // Make sendSegmentationResult wait for room (lossless consumers)
+    Disconnect  // End the slow stream with RESOURCE_EXHAUSTED
+};
+
+struct SegmentationStreamOptions {
+    size_t max_queued_results = 4; // Per stream, including the write in flight; at least 2 for DropOldest
+    OverflowPolicy overflow_policy = OverflowPolicy::DropOldest;
+    std::chrono::milliseconds block_timeout{2000}; // Block policy: disconnect after waiting this long
+};
+
 class RayVisionServiceAgent {
 public:
     class IRayVisionServiceListener {
@@ -31,12 +95,43 @@ public:
         virtual ~IRayVisionServiceListener() = default;
         virtual ImageData onGetImage(int cameraType) = 0; // 1 = HEAD, 2 = BODY, 3 = IR
         virtual void onDoSegmentation() = 0; // Notify segmentation request
+
+        // Captures several cameras for one BatchGetImage call, one frame per
+        // entry of cameraTypes and in the same order. The default runs
+        // onGetImage for all of them in parallel; override it when the cameras
+        // can be triggered together.
+        virtual std::vector<ImageData> onGetImages(const std::vector<int>& cameraTypes);
     };
 
-    RayVisionServiceAgent(std::weak_ptr<IRayVisionServiceListener> listener);
+    // GetImage calls reuse a camera's frame for up to frame_max_age (one frame at
+    // 30 Hz by default); zero only coalesces calls that overlap a capture. The
+    // server listens on unix:///tmp/rayvision_service.sock unless server_config
+    // names another address.
+    RayVisionServiceAgent(std::weak_ptr<IRayVisionServiceListener> listener,
+                          const SegmentationStreamOptions& stream_options = SegmentationStreamOptions(),
+                          std::chrono::milliseconds frame_max_age = std::chrono::milliseconds(33),
+                          const common::ServerConfig& server_config = common::ServerConfig());
     ~RayVisionServiceAgent();
 
+    // Streams the result to every doSegmentation subscriber. Segment buffers are
+    // referenced, never copied; the rvalue overload hands them over so that they
+    // go back to the pool as soon as the last stream has written them.
     void sendSegmentationResult(const SegmentationResult& segmentation_result);
+    void sendSegmentationResult(SegmentationResult&& segmentation_result);
+    void sendSegmentationResult(const FlatSegmentationResult& segmentation_result);
+    void sendSegmentationResult(FlatSegmentationResult&& segmentation_result);
+
+    // Pushes a new frame of cameraType to its SubscribeFrames streams and serves
+    // it to GetImage calls until it is older than frame_max_age. The buffer is
+    // referenced, never copied.
+    void publishFrame(int cameraType, ImageData image_data);
+
+    // Whether any SubscribeFrames stream is watching cameraType, so that the
+    // listener can skip capturing frames nobody will receive
+    bool hasFrameSubscribers(int cameraType) const;
+
+    // Periodically writes the metrics served by GetStats to path as JSON
+    void enableMetricsDump(const std::string& path, std::chrono::milliseconds interval);
 
 private:
     struct Impl;
@@ -0,0 +1,466 @@
+#include "ServerConfig.h"
+#include <grpcpp/grpcpp.h>
+#include <grpcpp/resource_quota.h>
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+namespace common {
+
+namespace {
+
+enum class ValueKind { String, List, Integer, Bytes, Boolean };
+
+struct Setting {
+    const char* key;
+    ValueKind kind;
+    std::string ServerConfig::*string_field;
+    std::vector<std::string> ServerConfig::*list_field;
+    int64_t ServerConfig::*integer_field;
+    bool ServerConfig::*boolean_field;
+    const char* help;
+};
+
+constexpr Setting stringSetting(const char* key, std::string ServerConfig::*field, const char* help) {
+    return {key, ValueKind::String, field, nullptr, nullptr, nullptr, help};
+}
+
+// Comma-separated in files, environment and flags
+constexpr Setting listSetting(const char* key, std::vector<std::string> ServerConfig::*field, const char* help) {
+    return {key, ValueKind::List, nullptr, field, nullptr, nullptr, help};
+}
+
+constexpr Setting integerSetting(const char* key, ValueKind kind, int64_t ServerConfig::*field, const char* help) {
+    return {key, kind, nullptr, nullptr, field, nullptr, help};
+}
+
+constexpr Setting booleanSetting(const char* key, bool ServerConfig::*field, const char* help) {
+    return {key, ValueKind::Boolean, nullptr, nullptr, nullptr, field, help};
+}
+
+const Setting kSettings[] = {
+    listSetting("listen_address", &ServerConfig::listen_addresses,
+                "Addresses to serve on, e.g. unix:///tmp/a.sock,0.0.0.0:50051"),
+    stringSetting("frame_channel_path", &ServerConfig::frame_channel_path, "Shared-memory frame side channel"),
+    integerSetting("workers", ValueKind::Integer, &ServerConfig::workers,
+                   "Worker processes sharing the TCP ports (0: none)"),
+    booleanSetting("reuse_port", &ServerConfig::reuse_port, "Allow other processes on the same TCP port"),
+    integerSetting("num_cqs", ValueKind::Integer, &ServerConfig::num_cqs, "Sync server completion queues"),
+    integerSetting("min_pollers", ValueKind::Integer, &ServerConfig::min_pollers, "Sync server minimum pollers"),
+    integerSetting("max_pollers", ValueKind::Integer, &ServerConfig::max_pollers, "Sync server maximum pollers"),
+    integerSetting("cq_timeout_ms", ValueKind::Integer, &ServerConfig::cq_timeout_ms, "Sync server poll timeout"),
+    integerSetting("max_threads", ValueKind::Integer, &ServerConfig::max_threads, "Resource quota thread cap"),
+    integerSetting("memory_quota_bytes", ValueKind::Bytes, &ServerConfig::memory_quota_bytes,
+                   "Resource quota memory cap"),
+    integerSetting("max_receive_message_bytes", ValueKind::Bytes, &ServerConfig::max_receive_message_bytes,
+                   "Largest request message, -1 for unlimited"),
+    integerSetting("max_send_message_bytes", ValueKind::Bytes, &ServerConfig::max_send_message_bytes,
+                   "Largest response message"),
+    integerSetting("max_concurrent_streams", ValueKind::Integer, &ServerConfig::max_concurrent_streams,
+                   "Concurrent calls per connection"),
+    integerSetting("keepalive_time_ms", ValueKind::Integer, &ServerConfig::keepalive_time_ms,
+                   "Keepalive ping interval"),
+    integerSetting("keepalive_timeout_ms", ValueKind::Integer, &ServerConfig::keepalive_timeout_ms,
+                   "Keepalive ping timeout"),
+    booleanSetting("keepalive_permit_without_calls", &ServerConfig::keepalive_permit_without_calls,
+                   "Keepalive pings on connections without calls"),
+    integerSetting("http2_min_ping_interval_ms", ValueKind::Integer, &ServerConfig::http2_min_ping_interval_ms,
+                   "Shortest client ping interval without calls"),
+    integerSetting("http2_max_ping_strikes", ValueKind::Integer, &ServerConfig::http2_max_ping_strikes,
+                   "Bad client pings before closing the connection"),
+    booleanSetting("http2_bdp_probe", &ServerConfig::http2_bdp_probe, "Size flow-control windows by BDP probing"),
+    integerSetting("http2_stream_window_bytes", ValueKind::Bytes, &ServerConfig::http2_stream_window_bytes,
+                   "Initial per-stream receive window"),
+    integerSetting("http2_max_frame_bytes", ValueKind::Bytes, &ServerConfig::http2_max_frame_bytes,
+                   "Largest HTTP/2 frame accepted"),
+    integerSetting("http2_write_buffer_bytes", ValueKind::Bytes, &ServerConfig::http2_write_buffer_bytes,
+                   "Per-stream write buffer"),
+};
+
+const Setting* findSetting(const std::string& key) {
+    for (const auto& setting : kSettings) {
+        if (key == setting.key) {
+            return &setting;
+        }
+    }
+    return nullptr;
+}
+
+std::string trim(const std::string& text) {
+    size_t begin = text.find_first_not_of(" \t\r");
+    if (begin == std::string::npos) {
+        return "";
+    }
+    size_t end = text.find_last_not_of(" \t\r");
+    return text.substr(begin, end - begin + 1);
+}
+
+std::vector<std::string> splitList(const std::string& text) {
+    std::vector<std::string> items;
+    size_t start = 0;
+    while (start <= text.size()) {
+        size_t end = text.find(',', start);
+        if (end == std::string::npos) {
+            end = text.size();
+        }
+        std::string item = trim(text.substr(start, end - start));
+        if (!item.empty()) {
+            items.push_back(std::move(item));
+        }
+        start = end + 1;
+    }
+    return items;
+}
+
+bool parseInteger(const std::string& text, bool allow_suffix, int64_t* value) {
+    if (text.empty()) {
+        return false;
+    }
+    errno = 0;
+    char* end = nullptr;
+    long long parsed = std::strtoll(text.c_str(), &end, 10);
+    if (end == text.c_str() || errno == ERANGE) {
+        return false;
+    }
+    int64_t scale = 1;
+    if (allow_suffix && *end != '\0' && end[1] == '\0') {
+        switch (std::toupper(static_cast<unsigned char>(*end))) {
+        case 'K': scale = int64_t(1) << 10; ++end; break;
+        case 'M': scale = int64_t(1) << 20; ++end; break;
+        case 'G': scale = int64_t(1) << 30; ++end; break;
+        default: break;
+        }
+    }
+    if (*end != '\0' || parsed > INT64_MAX / scale || parsed < INT64_MIN / scale) {
+        return false;
+    }
+    *value = parsed * scale;
+    return true;
+}
+
+bool parseBoolean(const std::string& text, bool* value) {
+    if (text == "true" || text == "1" || text == "yes" || text == "on") {
+        *value = true;
+    } else if (text == "false" || text == "0" || text == "no" || text == "off") {
+        *value = false;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+std::string flagName(const char* key) {
+    std::string flag = std::string("--") + key;
+    std::replace(flag.begin(), flag.end(), '_', '-');
+    return flag;
+}
+
+std::string environmentName(const std::string& prefix, const char* key) {
+    std::string name = prefix + key;
+    std::transform(name.begin(), name.end(), name.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::toupper(c)); });
+    return name;
+}
+
+// Channel arguments are ints; larger values are clamped
+int channelArgument(int64_t value) {
+    return static_cast<int>(std::min<int64_t>(value, INT32_MAX));
+}
+
+// "/tmp/a.sock" -> "/tmp/a.<index>.sock"; other names get the suffix appended
+std::string workerPath(const std::string& path, int index) {
+    std::string suffix = "." + std::to_string(index);
+    if (path.size() > 5 && path.compare(path.size() - 5, 5, ".sock") == 0) {
+        return path.substr(0, path.size() - 5) + suffix + ".sock";
+    }
+    return path + suffix;
+}
+
+} // namespace
+
+bool setServerConfigValue(const std::string& key, const std::string& value, ServerConfig* config,
+                          std::string* error) {
+    const Setting* setting = findSetting(key);
+    if (!setting) {
+        *error = "Unknown server setting '" + key + "'";
+        return false;
+    }
+    bool ok = true;
+    switch (setting->kind) {
+    case ValueKind::String:
+        config->*setting->string_field = value;
+        break;
+    case ValueKind::List:
+        config->*setting->list_field = splitList(value);
+        break;
+    case ValueKind::Integer:
+    case ValueKind::Bytes:
+        ok = parseInteger(value, setting->kind == ValueKind::Bytes, &(config->*setting->integer_field));
+        break;
+    case ValueKind::Boolean:
+        ok = parseBoolean(value, &(config->*setting->boolean_field));
+        break;
+    }
+    if (!ok) {
+        *error = "Bad value '" + value + "' for server setting '" + key + "'";
+    }
+    return ok;
+}
+
+bool loadServerConfigFile(const std::string& path, ServerConfig* config, std::string* error) {
+    std::ifstream in(path);
+    if (!in) {
+        *error = "Cannot read server config " + path;
+        return false;
+    }
+    std::string line;
+    for (int number = 1; std::getline(in, line); ++number) {
+        line = trim(line.substr(0, line.find('#')));
+        if (line.empty()) {
+            continue;
+        }
+        size_t equals = line.find('=');
+        if (equals == std::string::npos) {
+            *error = path + ":" + std::to_string(number) + ": expected key = value";
+            return false;
+        }
+        if (!setServerConfigValue(trim(line.substr(0, equals)), trim(line.substr(equals + 1)), config, error)) {
+            *error = path + ":" + std::to_string(number) + ": " + *error;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool loadServerConfig(int argc, char** argv, const std::string& env_prefix, ServerConfig* config,
+                      std::string* error) {
+    std::string config_path;
+    if (const char* path = std::getenv((env_prefix + "CONFIG").c_str())) {
+        config_path = path;
+    }
+    for (int i = 1; i + 1 < argc; ++i) {
+        if (std::string(argv[i]) == "--config") {
+            config_path = argv[++i];
+        }
+    }
+    if (!config_path.empty() && !loadServerConfigFile(config_path, config, error)) {
+        return false;
+    }
+
+    for (const auto& setting : kSettings) {
+        std::string name = environmentName(env_prefix, setting.key);
+        if (const char* value = std::getenv(name.c_str())) {
+            if (!setServerConfigValue(setting.key, value, config, error)) {
+                *error = name + ": " + *error;
+                return false;
+            }
+        }
+    }
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--config" || !isServerConfigFlag(arg)) {
+            continue;
+        }
+        if (i + 1 >= argc) {
+            *error = arg + " needs a value";
+            return false;
+        }
+        std::string key = arg.substr(2);
+        std::replace(key.begin(), key.end(), '-', '_');
+        if (!setServerConfigValue(key, argv[++i], config, error)) {
+            return false;
+        }
+    }
+
+    if (config->workers < 0) {
+        *error = "workers must not be negative";
+        return false;
+    }
+    if (config->workers > 0) {
+        bool shared = false;
+        for (const auto& address : config->listen_addresses) {
+            shared = shared || (unixSocketPath(address).empty() && address.compare(0, 14, "unix-abstract:") != 0);
+        }
+        if (!shared) {
+            *error = "workers needs a TCP listen_address for the workers to share";
+            return false;
+        }
+    }
+    return true;
+}
+
+bool isServerConfigFlag(const std::string& arg) {
+    if (arg == "--config") {
+        return true;
+    }
+    for (const auto& setting : kSettings) {
+        if (arg == flagName(setting.key)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+std::string serverConfigUsage() {
+    std::ostringstream usage;
+    usage << "  --config PATH                    Server settings file (key = value lines)\n";
+    for (const auto& setting : kSettings) {
+        std::string flag = flagName(setting.key) + (setting.kind == ValueKind::Boolean ? " BOOL" : " VALUE");
+        usage << "  " << flag << std::string(flag.size() < 33 ? 33 - flag.size() : 1, ' ') << setting.help << "\n";
+    }
+    return usage.str();
+}
+
+std::string describeServerConfig(const ServerConfig& config) {
+    const ServerConfig defaults;
+    std::ostringstream description;
+    const char* separator = "";
+    for (const auto& setting : kSettings) {
+        std::ostringstream value;
+        switch (setting.kind) {
+        case ValueKind::String:
+            if (config.*setting.string_field == defaults.*setting.string_field) {
+                continue;
+            }
+            value << config.*setting.string_field;
+            break;
+        case ValueKind::List: {
+            if (config.*setting.list_field == defaults.*setting.list_field) {
+                continue;
+            }
+            const char* comma = "";
+            for (const auto& item : config.*setting.list_field) {
+                value << comma << item;
+                comma = ",";
+            }
+            break;
+        }
+        case ValueKind::Integer:
+        case ValueKind::Bytes:
+            if (config.*setting.integer_field == defaults.*setting.integer_field) {
+                continue;
+            }
+            value << config.*setting.integer_field;
+            break;
+        case ValueKind::Boolean:
+            if (config.*setting.boolean_field == defaults.*setting.boolean_field) {
+                continue;
+            }
+            value << (config.*setting.boolean_field ? "true" : "false");
+            break;
+        }
+        description << separator << setting.key << "=" << value.str();
+        separator = " ";
+    }
+    return description.str();
+}
+
+void applyServerConfig(const ServerConfig& config, const std::vector<std::string>& listen_addresses,
+                       grpc::ServerBuilder* builder) {
+    for (const auto& address : listen_addresses) {
+        builder->AddListeningPort(address, grpc::InsecureServerCredentials());
+    }
+
+    using SyncOption = grpc::ServerBuilder::SyncServerOption;
+    if (config.num_cqs > 0) {
+        builder->SetSyncServerOption(SyncOption::NUM_CQS, channelArgument(config.num_cqs));
+    }
+    if (config.min_pollers > 0) {
+        builder->SetSyncServerOption(SyncOption::MIN_POLLERS, channelArgument(config.min_pollers));
+    }
+    if (config.max_pollers > 0) {
+        builder->SetSyncServerOption(SyncOption::MAX_POLLERS, channelArgument(config.max_pollers));
+    }
+    if (config.cq_timeout_ms > 0) {
+        builder->SetSyncServerOption(SyncOption::CQ_TIMEOUT_MSEC, channelArgument(config.cq_timeout_ms));
+    }
+
+    if (config.max_threads > 0 || config.memory_quota_bytes > 0) {
+        grpc::ResourceQuota quota("server");
+        if (config.max_threads > 0) {
+            quota.SetMaxThreads(channelArgument(config.max_threads));
+        }
+        if (config.memory_quota_bytes > 0) {
+            quota.Resize(static_cast<size_t>(config.memory_quota_bytes));
+        }
+        builder->SetResourceQuota(quota);
+    }
+
+    if (config.max_receive_message_bytes != 0) {
+        builder->SetMaxReceiveMessageSize(config.max_receive_message_bytes < 0
+                                              ? -1 : channelArgument(config.max_receive_message_bytes));
+    }
+    if (config.max_send_message_bytes != 0) {
+        builder->SetMaxSendMessageSize(config.max_send_message_bytes < 0
+                                           ? -1 : channelArgument(config.max_send_message_bytes));
+    }
+
+    auto setPositive = [builder](const char* argument, int64_t value) {
+        if (value > 0) {
+            builder->AddChannelArgument(argument, channelArgument(value));
+        }
+    };
+    setPositive(GRPC_ARG_MAX_CONCURRENT_STREAMS, config.max_concurrent_streams);
+    setPositive(GRPC_ARG_KEEPALIVE_TIME_MS, config.keepalive_time_ms);
+    setPositive(GRPC_ARG_KEEPALIVE_TIMEOUT_MS, config.keepalive_timeout_ms);
+    setPositive(GRPC_ARG_HTTP2_MIN_RECV_PING_INTERVAL_WITHOUT_DATA_MS, config.http2_min_ping_interval_ms);
+    setPositive(GRPC_ARG_HTTP2_MAX_PING_STRIKES, config.http2_max_ping_strikes);
+    setPositive(GRPC_ARG_HTTP2_STREAM_LOOKAHEAD_BYTES, config.http2_stream_window_bytes);
+    setPositive(GRPC_ARG_HTTP2_MAX_FRAME_SIZE, config.http2_max_frame_bytes);
+    setPositive(GRPC_ARG_HTTP2_WRITE_BUFFER_SIZE, config.http2_write_buffer_bytes);
+    if (config.keepalive_permit_without_calls) {
+        builder->AddChannelArgument(GRPC_ARG_KEEPALIVE_PERMIT_WITHOUT_CALLS, 1);
+    }
+    if (!config.http2_bdp_probe) {
+        builder->AddChannelArgument(GRPC_ARG_HTTP2_BDP_PROBE, 0);
+    }
+    // gRPC sets SO_REUSEPORT by default, which lets a second server on the
+    // same port silently take half of the connections
+    builder->AddChannelArgument(GRPC_ARG_ALLOW_REUSEPORT, config.reuse_port || config.worker_index >= 0 ? 1 : 0);
+}
+
+std::vector<std::string> listenAddresses(const ServerConfig& config, const std::string& default_address) {
+    std::vector<std::string> addresses = config.listen_addresses;
+    if (addresses.empty()) {
+        addresses.push_back(default_address);
+    }
+    if (config.worker_index >= 0) {
+        for (auto& address : addresses) {
+            if (address.compare(0, 14, "unix-abstract:") == 0) {
+                address = workerPath(address, config.worker_index);
+            } else if (!unixSocketPath(address).empty()) {
+                address = "unix:" + workerPath(unixSocketPath(address), config.worker_index);
+            }
+        }
+    }
+    return addresses;
+}
+
+std::string joinAddresses(const std::vector<std::string>& addresses) {
+    std::string joined;
+    for (const auto& address : addresses) {
+        joined += (joined.empty() ? "" : ", ") + address;
+    }
+    return joined;
+}
+
+std::string frameChannelPath(const ServerConfig& config, const std::string& default_path) {
+    std::string path = config.frame_channel_path.empty() ? default_path : config.frame_channel_path;
+    return config.worker_index >= 0 ? workerPath(path, config.worker_index) : path;
+}
+
+std::string unixSocketPath(const std::string& address) {
+    if (address.compare(0, 7, "unix://") == 0) {
+        return address.substr(7);
+    }
+    if (address.compare(0, 5, "unix:") == 0) {
+        return address.substr(5);
+    }
+    return "";
+}
+
+} // namespace common
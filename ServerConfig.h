@@ -0,0 +1,99 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace grpc {
+class ServerBuilder;
+}
+
+namespace common {
+
+// Runtime settings of an agent's gRPC server, so that a deployment can be
+// tuned to its hardware without recompiling. Numeric settings left at 0 keep
+// gRPC's own default.
+struct ServerConfig {
+    // Addresses served by the one server: "unix:PATH", "unix-abstract:NAME"
+    // or "HOST:PORT". Empty: the agent's default Unix socket.
+    std::vector<std::string> listen_addresses;
+    std::string frame_channel_path; // Shared-memory side channel; empty: the agent's default
+
+    // Sharded mode: this many worker processes serve the TCP addresses through
+    // SO_REUSEPORT, the kernel spreading connections across them. 0 runs the
+    // server in this process.
+    int64_t workers = 0;
+    bool reuse_port = false; // Let other processes bind the same TCP port; on in workers
+    int worker_index = -1;   // Set in a worker process; not a setting
+
+    // Sync server polling. Both agents serve their RPCs through the callback
+    // API, so these only size the threads behind the health check service.
+    int64_t num_cqs = 0;
+    int64_t min_pollers = 0;
+    int64_t max_pollers = 0;
+    int64_t cq_timeout_ms = 0;
+
+    // Resource quota shared by the server's connections
+    int64_t max_threads = 0;        // Threads the sync server may create
+    int64_t memory_quota_bytes = 0; // Memory for connection and call buffers
+
+    int64_t max_receive_message_bytes = 0; // gRPC default 4 MB; -1 for unlimited
+    int64_t max_send_message_bytes = 0;    // gRPC default unlimited
+    int64_t max_concurrent_streams = 0;    // Per connection
+
+    int64_t keepalive_time_ms = 0;      // Ping an idle connection this often
+    int64_t keepalive_timeout_ms = 0;   // Drop it when a ping goes unanswered this long
+    bool keepalive_permit_without_calls = false; // Also ping connections without calls
+    int64_t http2_min_ping_interval_ms = 0; // Shortest client ping interval tolerated without calls
+    int64_t http2_max_ping_strikes = 0;     // Too-frequent client pings before the connection is closed
+
+    // HTTP/2 flow control
+    bool http2_bdp_probe = true;            // Grow windows to the measured bandwidth-delay product
+    int64_t http2_stream_window_bytes = 0;  // Initial per-stream receive window
+    int64_t http2_max_frame_bytes = 0;      // Largest frame accepted from a peer
+    int64_t http2_write_buffer_bytes = 0;   // Data buffered per stream before writes wait
+};
+
+// Settings are named by snake_case keys matching the fields above. They are
+// read, each source overriding the one before:
+// - a file of "key = value" lines ('#' starts a comment), named by --config
+//   or <env_prefix>CONFIG
+// - environment variables <env_prefix><KEY>, e.g. IMAGE_SERVER_MAX_THREADS
+// - flags --<key-with-dashes> VALUE, e.g. --max-threads 8
+// Byte sizes accept a K, M or G suffix. Returns false with a message in
+// *error on an unknown key or a bad value. Flags that are not settings are
+// left for the caller.
+bool loadServerConfig(int argc, char** argv, const std::string& env_prefix, ServerConfig* config,
+                      std::string* error);
+
+bool loadServerConfigFile(const std::string& path, ServerConfig* config, std::string* error);
+bool setServerConfigValue(const std::string& key, const std::string& value, ServerConfig* config,
+                          std::string* error);
+
+// Whether arg is --config or a setting flag; either takes the next argument
+bool isServerConfigFlag(const std::string& arg);
+
+// Usage lines for the setting flags
+std::string serverConfigUsage();
+
+// "key=value" for every setting that differs from the default
+std::string describeServerConfig(const ServerConfig& config);
+
+// The addresses to listen on, default_address if none is configured. Unix
+// sockets cannot be shared, so in a worker each gets a ".<worker_index>"
+// suffix ("/tmp/a.sock" becomes "/tmp/a.1.sock"); TCP addresses are kept.
+std::vector<std::string> listenAddresses(const ServerConfig& config, const std::string& default_address);
+
+// "a, b, c", for logs
+std::string joinAddresses(const std::vector<std::string>& addresses);
+
+// The shared-memory side channel path, suffixed per worker as above
+std::string frameChannelPath(const ServerConfig& config, const std::string& default_path);
+
+// Listening ports, resource quota, message limits and channel arguments
+void applyServerConfig(const ServerConfig& config, const std::vector<std::string>& listen_addresses,
+                       grpc::ServerBuilder* builder);
+
+// File path of a "unix:" address, or empty for any other kind
+std::string unixSocketPath(const std::string& address);
+
+} // namespace common
@@ -0,0 +1,408 @@
+#include "SharedFrameRing.h"
+#include "Logger.h"
+#include <cerrno>
+#include <cstring>
+#include <new>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace common {
+
+namespace {
+
+constexpr uint32_t kRingMagic = 0x52494e47; // "RING"
+constexpr size_t kPageSize = 4096;
+
+#ifdef MSG_NOSIGNAL
+constexpr int kSendFlags = MSG_NOSIGNAL;
+#else
+constexpr int kSendFlags = 0;
+#endif
+
+// Layout at the start of the mapping; slot headers follow, slot data starts at
+// data_offset and is page aligned.
+struct RingHeader {
+    uint32_t magic;
+    uint32_t slot_count;
+    uint64_t slot_size;
+    uint64_t data_offset;
+    std::atomic<uint64_t> latest_sequence; // Newest complete frame, 0 before the first
+};
+
+// sequence is odd while the slot is being written and holds the (even) frame
+// sequence once the write is complete.
+struct SlotHeader {
+    std::atomic<uint64_t> sequence;
+    uint64_t length;
+};
+
+size_t roundUpToPage(size_t size) {
+    return (size + kPageSize - 1) & ~(kPageSize - 1);
+}
+
+SlotHeader* slotHeaders(std::byte* base) {
+    return reinterpret_cast<SlotHeader*>(base + sizeof(RingHeader));
+}
+
+const SlotHeader* slotHeaders(const std::byte* base) {
+    return reinterpret_cast<const SlotHeader*>(base + sizeof(RingHeader));
+}
+
+// Returns the writer's fd and sets *readonly_fd to a read-only descriptor of
+// the same memory, which is all that readers are ever given
+int createSharedMemoryFd(size_t size, int* readonly_fd) {
+    *readonly_fd = -1;
+#ifdef __linux__
+    int fd = memfd_create("frame_ring", MFD_CLOEXEC);
+    if (fd >= 0) {
+        std::string path = "/proc/self/fd/" + std::to_string(fd);
+        *readonly_fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    }
+#else
+    std::string name = "/frame_ring_" + std::to_string(getpid());
+    int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd >= 0) {
+        *readonly_fd = shm_open(name.c_str(), O_RDONLY, 0);
+        shm_unlink(name.c_str());
+    }
+#endif
+    if (fd >= 0 && *readonly_fd >= 0 && ftruncate(fd, static_cast<off_t>(size)) == 0) {
+        return fd;
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+    if (*readonly_fd >= 0) {
+        close(*readonly_fd);
+        *readonly_fd = -1;
+    }
+    return -1;
+}
+
+// Only processes of the ring owner's user may receive the ring
+bool isSameUser(int client_fd) {
+#if defined(__linux__)
+    ucred credentials{};
+    socklen_t length = sizeof(credentials);
+    return getsockopt(client_fd, SOL_SOCKET, SO_PEERCRED, &credentials, &length) == 0 &&
+           credentials.uid == geteuid();
+#else
+    uid_t uid;
+    gid_t gid;
+    return getpeereid(client_fd, &uid, &gid) == 0 && uid == geteuid();
+#endif
+}
+
+bool fillSocketAddress(const std::string& path, sockaddr_un* addr) {
+    std::memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr->sun_path)) {
+        return false;
+    }
+    std::memcpy(addr->sun_path, path.c_str(), path.size());
+    return true;
+}
+
+} // namespace
+
+SharedFrameRing::SharedFrameRing(std::string channel_path, uint32_t slot_count, uint64_t slot_size)
+    : channel_path_(std::move(channel_path)),
+      slot_count_(slot_count),
+      slot_size_(roundUpToPage(slot_size)),
+      slot_mutexes_(new std::mutex[slot_count]) {
+    size_t data_offset = roundUpToPage(sizeof(RingHeader) + slot_count_ * sizeof(SlotHeader));
+    mapping_size_ = data_offset + slot_count_ * slot_size_;
+
+    memfd_ = createSharedMemoryFd(mapping_size_, &readonly_fd_);
+    if (memfd_ < 0) {
+        AGENT_LOG_ERROR("[SHM] Failed to create shared memory: " << std::strerror(errno));
+        return;
+    }
+
+    void* mapping = mmap(nullptr, mapping_size_, PROT_READ | PROT_WRITE, MAP_SHARED, memfd_, 0);
+    if (mapping == MAP_FAILED) {
+        AGENT_LOG_ERROR("[SHM] Failed to map shared memory: " << std::strerror(errno));
+        close(memfd_);
+        close(readonly_fd_);
+        memfd_ = -1;
+        readonly_fd_ = -1;
+        return;
+    }
+    base_ = static_cast<std::byte*>(mapping);
+
+    auto* header = reinterpret_cast<RingHeader*>(base_);
+    header->magic = kRingMagic;
+    header->slot_count = slot_count_;
+    header->slot_size = slot_size_;
+    header->data_offset = data_offset;
+    new (&header->latest_sequence) std::atomic<uint64_t>(0);
+    for (uint32_t i = 0; i < slot_count_; ++i) {
+        new (&slotHeaders(base_)[i]) SlotHeader{{0}, 0};
+    }
+
+    // Side channel that hands out the ring fd
+    sockaddr_un addr;
+    if (!fillSocketAddress(channel_path_, &addr)) {
+        AGENT_LOG_ERROR("[SHM] Channel path too long: " << channel_path_);
+        return;
+    }
+    unlink(channel_path_.c_str());
+    channel_fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (channel_fd_ < 0 ||
+        bind(channel_fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+        chmod(channel_path_.c_str(), 0600) != 0 || listen(channel_fd_, 16) != 0) {
+        AGENT_LOG_ERROR("[SHM] Failed to open channel " << channel_path_ << ": " << std::strerror(errno));
+        if (channel_fd_ >= 0) {
+            close(channel_fd_);
+            channel_fd_ = -1;
+        }
+        return;
+    }
+
+    channel_thread_ = std::thread([this]() { serveChannel(); });
+    AGENT_LOG_INFO("[SHM] Frame ring ready (" << slot_count_ << " slots x " << slot_size_
+                   << " bytes), fd channel on " << channel_path_);
+}
+
+SharedFrameRing::~SharedFrameRing() {
+    stop_channel_ = true;
+    if (channel_thread_.joinable()) {
+        channel_thread_.join();
+    }
+    if (channel_fd_ >= 0) {
+        close(channel_fd_);
+        unlink(channel_path_.c_str());
+    }
+    if (base_) {
+        munmap(base_, mapping_size_);
+    }
+    if (memfd_ >= 0) {
+        close(memfd_);
+    }
+    if (readonly_fd_ >= 0) {
+        close(readonly_fd_);
+    }
+}
+
+bool SharedFrameRing::write(const void* data, size_t length, SharedFrameHandle* handle) {
+    if (!base_ || channel_fd_ < 0 || length > slot_size_) {
+        return false;
+    }
+
+    // Sequences are even so that an odd value can mark a slot under construction
+    uint64_t sequence = (next_sequence_.fetch_add(1, std::memory_order_relaxed) + 1) * 2;
+    uint32_t slot = static_cast<uint32_t>((sequence / 2) % slot_count_);
+    uint64_t offset = reinterpret_cast<const RingHeader*>(base_)->data_offset + slot * slot_size_;
+    SlotHeader& slot_header = slotHeaders(base_)[slot];
+
+    std::lock_guard<std::mutex> lock(slot_mutexes_[slot]);
+    slot_header.sequence.store(sequence - 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(base_ + offset, data, length);
+    slot_header.length = length;
+    slot_header.sequence.store(sequence, std::memory_order_release);
+
+    // Writers can finish out of order; latest only moves forward
+    auto& latest = reinterpret_cast<RingHeader*>(base_)->latest_sequence;
+    uint64_t newest = latest.load(std::memory_order_relaxed);
+    while (newest < sequence &&
+           !latest.compare_exchange_weak(newest, sequence, std::memory_order_release, std::memory_order_relaxed)) {
+    }
+
+    handle->slot = slot;
+    handle->sequence = sequence;
+    handle->offset = offset;
+    handle->length = length;
+    return true;
+}
+
+void SharedFrameRing::serveChannel() {
+    while (!stop_channel_) {
+        pollfd pfd{channel_fd_, POLLIN, 0};
+        if (poll(&pfd, 1, 200) <= 0) {
+            continue;
+        }
+
+        int client_fd = accept(channel_fd_, nullptr, nullptr);
+        if (client_fd < 0) {
+            continue;
+        }
+        if (!isSameUser(client_fd)) {
+            AGENT_LOG_WARN("[SHM] Refused the ring to a process of another user");
+            close(client_fd);
+            continue;
+        }
+
+        // One byte of payload carries the SCM_RIGHTS control message
+        char payload = 'R';
+        iovec iov{&payload, sizeof(payload)};
+        alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+        msghdr msg{};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        std::memcpy(CMSG_DATA(cmsg), &readonly_fd_, sizeof(int));
+
+        if (sendmsg(client_fd, &msg, kSendFlags) < 0) {
+            AGENT_LOG_ERROR("[SHM] Failed to pass ring fd: " << std::strerror(errno));
+        }
+        close(client_fd);
+    }
+}
+
+SharedFrameReader::SharedFrameReader(std::string channel_path)
+    : channel_path_(std::move(channel_path)) {}
+
+SharedFrameReader::~SharedFrameReader() {
+    if (base_) {
+        munmap(const_cast<std::byte*>(base_), mapping_size_);
+    }
+}
+
+bool SharedFrameReader::connect() {
+    if (base_) {
+        return true;
+    }
+
+    sockaddr_un addr;
+    if (!fillSocketAddress(channel_path_, &addr)) {
+        return false;
+    }
+
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock < 0) {
+        return false;
+    }
+    if (::connect(sock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+        close(sock);
+        return false;
+    }
+
+    char payload = 0;
+    iovec iov{&payload, sizeof(payload)};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    ssize_t received = recvmsg(sock, &msg, 0);
+    close(sock);
+
+    cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    if (received <= 0 || !cmsg || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+        return false;
+    }
+
+    int fd = -1;
+    std::memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(RingHeader)) {
+        close(fd);
+        return false;
+    }
+
+    // The fd is read-only, so the mapping cannot be made writable either
+    void* mapping = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        return false;
+    }
+
+    // The geometry is read once and checked against the mapping; later reads
+    // never trust the shared header again
+    const auto* header = static_cast<const RingHeader*>(mapping);
+    uint64_t mapping_size = static_cast<uint64_t>(st.st_size);
+    uint32_t slot_count = header->slot_count;
+    uint64_t slot_size = header->slot_size;
+    uint64_t data_offset = header->data_offset;
+    bool valid = header->magic == kRingMagic && slot_count > 0 && slot_size > 0 &&
+                 data_offset >= sizeof(RingHeader) + uint64_t(slot_count) * sizeof(SlotHeader) &&
+                 data_offset <= mapping_size && slot_size <= (mapping_size - data_offset) / slot_count;
+    if (!valid) {
+        munmap(mapping, st.st_size);
+        return false;
+    }
+
+    base_ = static_cast<const std::byte*>(mapping);
+    mapping_size_ = st.st_size;
+    slot_count_ = slot_count;
+    slot_size_ = slot_size;
+    data_offset_ = data_offset;
+    return true;
+}
+
+const std::byte* SharedFrameReader::data(const SharedFrameHandle& handle) const {
+    if (!base_) {
+        return nullptr;
+    }
+
+    if (handle.slot >= slot_count_ || handle.offset != data_offset_ + handle.slot * slot_size_ ||
+        handle.length > slot_size_) {
+        return nullptr;
+    }
+
+    const SlotHeader& slot_header = slotHeaders(base_)[handle.slot];
+    if (slot_header.sequence.load(std::memory_order_acquire) != handle.sequence) {
+        return nullptr;
+    }
+    return base_ + handle.offset;
+}
+
+bool SharedFrameReader::isCurrent(const SharedFrameHandle& handle) const {
+    if (!base_ || handle.slot >= slot_count_) {
+        return false;
+    }
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    const SlotHeader& slot_header = slotHeaders(base_)[handle.slot];
+    return slot_header.sequence.load(std::memory_order_relaxed) == handle.sequence;
+}
+
+bool SharedFrameReader::latest(SharedFrameHandle* handle) const {
+    if (!base_) {
+        return false;
+    }
+    const auto* header = reinterpret_cast<const RingHeader*>(base_);
+    uint64_t sequence = header->latest_sequence.load(std::memory_order_acquire);
+    return sequence != 0 && find(sequence, handle);
+}
+
+bool SharedFrameReader::previous(const SharedFrameHandle& handle, SharedFrameHandle* older) const {
+    return base_ && handle.sequence > 2 && find(handle.sequence - 2, older);
+}
+
+bool SharedFrameReader::find(uint64_t sequence, SharedFrameHandle* handle) const {
+    uint32_t slot = static_cast<uint32_t>((sequence / 2) % slot_count_);
+    const SlotHeader& slot_header = slotHeaders(base_)[slot];
+    if (slot_header.sequence.load(std::memory_order_acquire) != sequence) {
+        return false;
+    }
+    uint64_t length = slot_header.length;
+    uint64_t offset = data_offset_ + slot * slot_size_;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot_header.sequence.load(std::memory_order_relaxed) != sequence || length > slot_size_) {
+        return false;
+    }
+
+    handle->slot = slot;
+    handle->sequence = sequence;
+    handle->offset = offset;
+    handle->length = length;
+    return true;
+}
+
+} // namespace common
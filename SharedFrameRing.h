@@ -0,0 +1,104 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace common {
+
+// Location of one frame inside a SharedFrameRing, as carried in RPC replies.
+struct SharedFrameHandle {
+    uint32_t slot = 0;
+    uint64_t sequence = 0;
+    uint64_t offset = 0;
+    uint64_t length = 0;
+};
+
+// Server side of the shared-memory frame transport.
+//
+// Frames are written into a memfd-backed ring of fixed-size slots. Each slot is
+// guarded by a sequence number (seqlock style), so readers in other processes can
+// read a frame in place and detect if the ring wrapped around underneath them.
+// A read-only fd of the ring is handed out once per client over SCM_RIGHTS on a
+// side-channel Unix socket at channelPath(), which only the owner's user can
+// use.
+class SharedFrameRing {
+public:
+    SharedFrameRing(std::string channel_path, uint32_t slot_count, uint64_t slot_size);
+    ~SharedFrameRing();
+
+    SharedFrameRing(const SharedFrameRing&) = delete;
+    SharedFrameRing& operator=(const SharedFrameRing&) = delete;
+
+    bool isValid() const { return base_ != nullptr; }
+    const std::string& channelPath() const { return channel_path_; }
+    uint64_t slotSize() const { return slot_size_; }
+
+    // Copies a frame into the next slot. Returns false if the ring is unusable or
+    // the frame does not fit in a slot; callers then fall back to inline bytes.
+    bool write(const void* data, size_t length, SharedFrameHandle* handle);
+
+private:
+    void serveChannel();
+
+    std::string channel_path_;
+    uint32_t slot_count_;
+    uint64_t slot_size_;
+    size_t mapping_size_ = 0;
+    int memfd_ = -1;
+    int readonly_fd_ = -1; // Handed to readers
+    int channel_fd_ = -1;
+    std::byte* base_ = nullptr;
+
+    std::atomic<uint64_t> next_sequence_{0};
+    std::unique_ptr<std::mutex[]> slot_mutexes_; // Serialize writers that wrap onto the same slot
+    std::atomic<bool> stop_channel_{false};
+    std::thread channel_thread_;
+};
+
+// Client side of the shared-memory frame transport. Connects to the ring's side
+// channel once, receives the fd and maps the ring read-only.
+class SharedFrameReader {
+public:
+    explicit SharedFrameReader(std::string channel_path);
+    ~SharedFrameReader();
+
+    SharedFrameReader(const SharedFrameReader&) = delete;
+    SharedFrameReader& operator=(const SharedFrameReader&) = delete;
+
+    bool connect();
+    bool isConnected() const { return base_ != nullptr; }
+    const std::string& channelPath() const { return channel_path_; }
+
+    // Returns the frame bytes in place, or nullptr if the slot no longer holds the
+    // frame named by the handle.
+    const std::byte* data(const SharedFrameHandle& handle) const;
+
+    // Call after consuming the bytes returned by data(): false means the writer
+    // reused the slot while it was being read and the bytes must be discarded.
+    bool isCurrent(const SharedFrameHandle& handle) const;
+
+    // Newest complete frame in the ring, for readers that poll it as a frame
+    // source rather than receive handles. False if nothing was written yet.
+    bool latest(SharedFrameHandle* handle) const;
+
+    // The frame written just before handle, while the ring still holds it
+    bool previous(const SharedFrameHandle& handle, SharedFrameHandle* older) const;
+
+private:
+    bool find(uint64_t sequence, SharedFrameHandle* handle) const;
+
+    std::string channel_path_;
+    size_t mapping_size_ = 0;
+    const std::byte* base_ = nullptr;
+
+    // Ring geometry, validated against the mapping at connect()
+    uint32_t slot_count_ = 0;
+    uint64_t slot_size_ = 0;
+    uint64_t data_offset_ = 0;
+};
+
+} // namespace common
@@ -0,0 +1,200 @@
+#pragma once
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace common {
+
+// Index of topic filters for publish/subscribe, MQTT style. Topics are levels
+// separated by '/', e.g. "camera/head/exposure". In a filter, '+' stands for
+// exactly one level and '#', which must be the last level, for any number of
+// trailing levels including none: "segmentation/+/completed" and "camera/#"
+// both match their examples, and "camera/#" also matches "camera".
+//
+// Each filter is a path of trie nodes, one per level, so matching a topic
+// visits the nodes along its levels (plus the wildcard branches) and costs the
+// depth of the topic, not the number of filters or subscribers. A node keeps
+// its subscribers as an immutable, shared list: match hands out references to
+// those lists, which stay valid after the caller releases its lock.
+//
+// Not thread-safe; callers serialize access.
+template <typename Subscriber>
+class TopicTrie {
+public:
+    using Subscribers = std::vector<Subscriber>;
+    using SubscribersPtr = std::shared_ptr<const Subscribers>;
+
+    // Non-empty, with '+' and '#' only as whole levels and '#' only last
+    static bool isValidFilter(std::string_view filter) {
+        if (filter.empty()) {
+            return false;
+        }
+        size_t start = 0;
+        while (true) {
+            size_t end = filter.find('/', start);
+            std::string_view level = filter.substr(start, end == std::string_view::npos ? end : end - start);
+            if (level.size() > 1 && level.find_first_of("+#") != std::string_view::npos) {
+                return false;
+            }
+            if (level == "#" && end != std::string_view::npos) {
+                return false;
+            }
+            if (end == std::string_view::npos) {
+                return true;
+            }
+            start = end + 1;
+        }
+    }
+
+    // A topic names one thing to publish on: non-empty and without wildcards
+    static bool isValidTopic(std::string_view topic) {
+        return !topic.empty() && topic.find_first_of("+#") == std::string_view::npos;
+    }
+
+    // Adds subscriber under filter, which must be valid; a subscriber already
+    // there is not added twice
+    void add(std::string_view filter, const Subscriber& subscriber) {
+        Node* node = &root_;
+        forEachLevel(filter, [&node](std::string_view level) {
+            auto it = node->children.find(level);
+            if (it == node->children.end()) {
+                it = node->children.emplace(std::string(level), std::make_unique<Node>()).first;
+            }
+            node = it->second.get();
+        });
+
+        auto updated = node->subscribers ? std::make_shared<Subscribers>(*node->subscribers)
+                                         : std::make_shared<Subscribers>();
+        for (const auto& existing : *updated) {
+            if (existing == subscriber) {
+                return;
+            }
+        }
+        if (updated->empty()) {
+            filters_++;
+        }
+        updated->push_back(subscriber);
+        node->subscribers = std::move(updated);
+    }
+
+    // Removes subscriber from filter and prunes the nodes left empty
+    void remove(std::string_view filter, const Subscriber& subscriber) {
+        std::vector<std::pair<Node*, typename Children::iterator>> path; // Parent and edge to each level
+        Node* node = &root_;
+        bool found = true;
+        forEachLevel(filter, [&](std::string_view level) {
+            if (!found) {
+                return;
+            }
+            auto it = node->children.find(level);
+            if (it == node->children.end()) {
+                found = false;
+                return;
+            }
+            path.emplace_back(node, it);
+            node = it->second.get();
+        });
+        if (!found || !node->subscribers) {
+            return;
+        }
+
+        auto updated = std::make_shared<Subscribers>();
+        updated->reserve(node->subscribers->size());
+        for (const auto& existing : *node->subscribers) {
+            if (!(existing == subscriber)) {
+                updated->push_back(existing);
+            }
+        }
+        if (updated->size() == node->subscribers->size()) {
+            return;
+        }
+        if (!updated->empty()) {
+            node->subscribers = std::move(updated);
+            return;
+        }
+
+        node->subscribers.reset();
+        filters_--;
+        for (auto step = path.rbegin(); step != path.rend(); ++step) {
+            Node* child = step->second->second.get();
+            if (child->subscribers || !child->children.empty()) {
+                break;
+            }
+            step->first->children.erase(step->second);
+        }
+    }
+
+    // Appends the subscriber list of every filter that matches topic. A
+    // subscriber registered under several matching filters appears in each
+    // of their lists.
+    void match(std::string_view topic, std::vector<SubscribersPtr>* matches) const {
+        std::vector<const Node*> current{&root_};
+        std::vector<const Node*> next;
+        forEachLevel(topic, [&](std::string_view level) {
+            next.clear();
+            for (const Node* node : current) {
+                appendMultiLevel(*node, matches);
+                if (const Node* child = findChild(*node, level)) {
+                    next.push_back(child);
+                }
+                if (const Node* child = findChild(*node, "+")) {
+                    next.push_back(child);
+                }
+            }
+            current.swap(next);
+        });
+        for (const Node* node : current) {
+            appendMultiLevel(*node, matches); // '#' also matches the parent level
+            if (node->subscribers) {
+                matches->push_back(node->subscribers);
+            }
+        }
+    }
+
+    // Filters with at least one subscriber
+    size_t filterCount() const { return filters_; }
+
+private:
+    struct Node;
+    using Children = std::map<std::string, std::unique_ptr<Node>, std::less<>>; // Looked up by string_view
+
+    struct Node {
+        Children children;
+        SubscribersPtr subscribers; // Null when no filter ends here
+    };
+
+    template <typename Visit>
+    static void forEachLevel(std::string_view path, Visit&& visit) {
+        size_t start = 0;
+        while (true) {
+            size_t end = path.find('/', start);
+            if (end == std::string_view::npos) {
+                visit(path.substr(start));
+                return;
+            }
+            visit(path.substr(start, end - start));
+            start = end + 1;
+        }
+    }
+
+    static const Node* findChild(const Node& node, std::string_view level) {
+        auto it = node.children.find(level);
+        return it == node.children.end() ? nullptr : it->second.get();
+    }
+
+    static void appendMultiLevel(const Node& node, std::vector<SubscribersPtr>* matches) {
+        const Node* child = findChild(node, "#");
+        if (child && child->subscribers) {
+            matches->push_back(child->subscribers);
+        }
+    }
+
+    Node root_;
+    size_t filters_ = 0;
+};
+
+} // namespace common
@@ -0,0 +1,70 @@
+#include "WorkerPool.h"
+#include "Logger.h"
+#include <algorithm>
+
+namespace common {
+
+WorkerPool::WorkerPool(size_t thread_count, size_t max_queued_jobs)
+    : max_queued_jobs_(max_queued_jobs) {
+    thread_count = std::max<size_t>(thread_count, 1);
+    workers_.reserve(thread_count);
+    for (size_t i = 0; i < thread_count; ++i) {
+        workers_.emplace_back([this]() { workerLoop(); });
+    }
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+        if (!queue_.empty()) {
+            AGENT_LOG_INFO("[POOL] Discarding " << queue_.size() << " queued jobs");
+            queue_.clear();
+        }
+    }
+    job_available_.notify_all();
+    for (auto& worker : workers_) {
+        worker.join();
+    }
+}
+
+bool WorkerPool::trySubmit(Job job, int priority) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stopping_ || queue_.size() >= max_queued_jobs_) {
+            return false;
+        }
+        queue_.emplace(QueueKey(priority, next_sequence_++), std::move(job));
+    }
+    job_available_.notify_one();
+    return true;
+}
+
+size_t WorkerPool::queuedJobs() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return queue_.size();
+}
+
+void WorkerPool::workerLoop() {
+    while (true) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            job_available_.wait(lock, [this]() { return stopping_ || !queue_.empty(); });
+            if (stopping_) {
+                return;
+            }
+            auto next = queue_.begin();
+            job = std::move(next->second);
+            queue_.erase(next);
+        }
+
+        try {
+            job();
+        } catch (const std::exception& e) {
+            AGENT_LOG_ERROR("[POOL] Job failed: " << e.what());
+        }
+    }
+}
+
+} // namespace common
@@ -0,0 +1,59 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace common {
+
+// Fixed set of worker threads fed from a bounded priority queue.
+//
+// trySubmit never blocks: once max_queued_jobs are waiting it rejects the job,
+// so callers can shed load (e.g. answer RESOURCE_EXHAUSTED) instead of piling up
+// threads or latency. Higher priorities run first; equal priorities run in
+// submission order. Jobs still queued at destruction are discarded; running
+// jobs are allowed to finish.
+class WorkerPool {
+public:
+    using Job = std::function<void()>;
+
+    WorkerPool(size_t thread_count, size_t max_queued_jobs);
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    // Returns false if the queue is full or the pool is shutting down
+    bool trySubmit(Job job, int priority = 0);
+
+    size_t queuedJobs() const;
+
+private:
+    void workerLoop();
+
+    // Priority and submission sequence
+    using QueueKey = std::pair<int, uint64_t>;
+
+    // Descending priority, then submission order. Compares instead of negating
+    // the priority, which would overflow for INT_MIN.
+    struct QueueOrder {
+        bool operator()(const QueueKey& a, const QueueKey& b) const {
+            return a.first != b.first ? a.first > b.first : a.second < b.second;
+        }
+    };
+
+    const size_t max_queued_jobs_;
+    mutable std::mutex mutex_;
+    std::condition_variable job_available_;
+    std::map<QueueKey, Job, QueueOrder> queue_;
+    uint64_t next_sequence_ = 0;
+    bool stopping_ = false;
+    std::vector<std::thread> workers_;
+};
+
+} // namespace common
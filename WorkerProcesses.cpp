@@ -0,0 +1,174 @@
+#include "WorkerProcesses.h"
+#include "Logger.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/prctl.h>
+#endif
+
+extern char** environ;
+
+namespace common {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr auto kPollInterval = std::chrono::milliseconds(100);
+constexpr auto kInitialBackoff = std::chrono::seconds(1);
+constexpr auto kMaxBackoff = std::chrono::seconds(30);
+constexpr auto kHealthyRun = std::chrono::seconds(10); // Resets the backoff
+constexpr auto kStopTimeout = std::chrono::seconds(10);
+
+struct Worker {
+    pid_t pid = 0;
+    Clock::time_point started_at;
+    Clock::time_point restart_at;
+    Clock::duration backoff = kInitialBackoff;
+};
+
+pid_t spawnWorker(const std::vector<std::string>& args, int index) {
+    std::vector<std::string> worker_args = args;
+    worker_args.push_back(kWorkerIndexFlag);
+    worker_args.push_back(std::to_string(index));
+    std::vector<char*> argv;
+    for (auto& arg : worker_args) {
+        argv.push_back(arg.data());
+    }
+    argv.push_back(nullptr);
+
+    pid_t pid = 0;
+#ifdef __linux__
+    int result = posix_spawn(&pid, "/proc/self/exe", nullptr, nullptr, argv.data(), environ);
+#else
+    int result = posix_spawnp(&pid, argv[0], nullptr, nullptr, argv.data(), environ);
+#endif
+    if (result != 0) {
+        AGENT_LOG_ERROR("[SUPERVISOR] Failed to start worker " << index << ": " << std::strerror(result));
+        return 0;
+    }
+    AGENT_LOG_INFO("[SUPERVISOR] Started worker " << index << " (pid " << pid << ")");
+    return pid;
+}
+
+std::string describeExit(int status) {
+    if (WIFEXITED(status)) {
+        return "exited with status " + std::to_string(WEXITSTATUS(status));
+    }
+    if (WIFSIGNALED(status)) {
+        return std::string("killed by signal ") + std::to_string(WTERMSIG(status));
+    }
+    return "stopped";
+}
+
+// Index of the worker with pid, or -1
+int findWorker(const std::vector<Worker>& workers, pid_t pid) {
+    for (size_t i = 0; i < workers.size(); ++i) {
+        if (workers[i].pid == pid) {
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
+}
+
+} // namespace
+
+int runWorkerProcesses(int argc, char** argv, int count, const std::atomic<bool>& stop_requested) {
+    std::vector<std::string> args(argv, argv + argc);
+    std::vector<Worker> workers(count);
+    int started = 0;
+    for (int i = 0; i < count; ++i) {
+        workers[i].pid = spawnWorker(args, i);
+        workers[i].started_at = Clock::now();
+        workers[i].restart_at = workers[i].started_at + kInitialBackoff; // If it failed to start
+        started += workers[i].pid != 0;
+    }
+    if (started == 0) {
+        return 1;
+    }
+
+    while (!stop_requested) {
+        int status = 0;
+        pid_t pid;
+        while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+            int index = findWorker(workers, pid);
+            if (index < 0) {
+                continue;
+            }
+            Worker& worker = workers[index];
+            auto now = Clock::now();
+            if (now - worker.started_at >= kHealthyRun) {
+                worker.backoff = kInitialBackoff;
+            }
+            worker.pid = 0;
+            worker.restart_at = now + worker.backoff;
+            AGENT_LOG_WARN("[SUPERVISOR] Worker " << index << " (pid " << pid << ") " << describeExit(status)
+                           << ", restarting in "
+                           << std::chrono::duration_cast<std::chrono::milliseconds>(worker.backoff).count() << " ms");
+            worker.backoff = std::min<Clock::duration>(worker.backoff * 2, kMaxBackoff);
+        }
+
+        auto now = Clock::now();
+        for (int i = 0; i < count; ++i) {
+            if (workers[i].pid == 0 && now >= workers[i].restart_at && !stop_requested) {
+                workers[i].pid = spawnWorker(args, i);
+                workers[i].started_at = now;
+                workers[i].restart_at = now + workers[i].backoff;
+            }
+        }
+        std::this_thread::sleep_for(kPollInterval);
+    }
+
+    for (const auto& worker : workers) {
+        if (worker.pid != 0) {
+            kill(worker.pid, SIGTERM);
+        }
+    }
+    auto deadline = Clock::now() + kStopTimeout;
+    while (std::any_of(workers.begin(), workers.end(), [](const Worker& worker) { return worker.pid != 0; })) {
+        int status = 0;
+        pid_t pid = waitpid(-1, &status, WNOHANG);
+        if (pid > 0) {
+            int index = findWorker(workers, pid);
+            if (index >= 0) {
+                AGENT_LOG_INFO("[SUPERVISOR] Worker " << index << " " << describeExit(status));
+                workers[index].pid = 0;
+            }
+            continue;
+        }
+        if (pid < 0 && errno == ECHILD) {
+            break;
+        }
+        if (Clock::now() >= deadline) {
+            for (auto& worker : workers) {
+                if (worker.pid != 0) {
+                    AGENT_LOG_WARN("[SUPERVISOR] Worker pid " << worker.pid << " did not stop, killing it");
+                    kill(worker.pid, SIGKILL);
+                }
+            }
+            deadline = Clock::now() + kStopTimeout;
+        }
+        std::this_thread::sleep_for(kPollInterval);
+    }
+    return 0;
+}
+
+void watchSupervisor() {
+#ifdef __linux__
+    prctl(PR_SET_PDEATHSIG, SIGTERM);
+    if (getppid() == 1) {
+        raise(SIGTERM); // The supervisor died before the request took effect
+    }
+#endif
+}
+
+} // namespace common
@@ -0,0 +1,24 @@
+#pragma once
+#include <atomic>
+
+namespace common {
+
+// Sharded mode: the supervisor runs count copies of this program as worker
+// processes that share the server's TCP ports (see ServerConfig::workers).
+//
+// Each worker is started from the program's own executable with the original
+// arguments plus "--worker-index <i>", so it begins as a clean process (no
+// threads, gRPC state or log buffers inherited through fork) and knows which
+// shard it is. A worker that exits while the supervisor runs is restarted,
+// with a backoff if it keeps failing. Once stop_requested is set the workers
+// get SIGTERM and are waited for. Returns 0, or 1 if no worker could be
+// started.
+int runWorkerProcesses(int argc, char** argv, int count, const std::atomic<bool>& stop_requested);
+
+constexpr char kWorkerIndexFlag[] = "--worker-index";
+
+// Call early in a worker: on Linux, asks for SIGTERM when the supervisor
+// dies, so that workers never outlive it
+void watchSupervisor();
+
+} // namespace common
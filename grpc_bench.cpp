@@ -0,0 +1,634 @@
+#include "image_service.grpc.pb.h"
+#include "RayVision.grpc.pb.h"
+#include "ChannelPool.h"
+#include "LatencyHistogram.h"
+#include <grpcpp/grpcpp.h>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Closed-loop load generator for ImageService and RayVision.
+//
+// Each of --concurrency workers issues one RPC at a time on one of --channels
+// channels (each with its own connection) for --duration seconds, after a
+// --warmup period that is not measured. Calls still running --grace seconds
+// after the end hit their deadline. Latencies go into per-worker histograms
+// that are merged for the report.
+
+using Clock = std::chrono::steady_clock;
+
+struct BenchOptions {
+    std::string service = "image"; // image | rayvision
+    std::string rpc = "getimage";  // image: getimage | segmentation | notifications | broadcast
+                                   // rayvision: getimage | batch | chunked | segmentation | subscribe
+    std::string target;
+    int channels = 1;
+    int concurrency = 4;
+    int duration_seconds = 10;
+    int warmup_seconds = 1;
+    size_t payload_size = 0; // Request padding bytes, where the request has room for it
+    int grace_seconds = 5; // Calls still running this long after the end are cut off
+    int batch_size = 1;    // image/broadcast: notifications per message, as the stream asks for
+    double linger_ms = 0;  // image/broadcast: how long the server may hold a partial batch
+    std::string json_path;
+};
+
+// Bytes moved by one RPC, as serialized protobuf
+struct CallBytes {
+    size_t sent = 0;
+    size_t received = 0;
+};
+
+// One worker's RPC loop body; implementations may keep per-worker state such as
+// an open stream.
+class Workload {
+public:
+    virtual ~Workload() = default;
+    virtual grpc::Status runOnce(CallBytes* bytes, std::chrono::system_clock::time_point deadline) = 0;
+};
+
+// --- ImageService workloads ---
+
+class ImageGetImageWorkload : public Workload {
+public:
+    ImageGetImageWorkload(std::shared_ptr<grpc::Channel> channel, const BenchOptions& options, int worker)
+        : stub_(imageservice::ImageService::NewStub(channel)) {
+        request_.set_image_id("bench-" + std::to_string(worker) + std::string(options.payload_size, 'x'));
+    }
+
+    grpc::Status runOnce(CallBytes* bytes, std::chrono::system_clock::time_point deadline) override {
+        grpc::ClientContext context;
+        context.set_deadline(deadline);
+        imageservice::ImageData response;
+        grpc::Status status = stub_->GetImage(&context, request_, &response);
+        bytes->sent = request_.ByteSizeLong();
+        bytes->received = response.ByteSizeLong();
+        return status;
+    }
+
+private:
+    std::unique_ptr<imageservice::ImageService::Stub> stub_;
+    imageservice::GetImageRequest request_;
+};
+
+class ImageSegmentationWorkload : public Workload {
+public:
+    ImageSegmentationWorkload(std::shared_ptr<grpc::Channel> channel, const BenchOptions& options, int worker)
+        : stub_(imageservice::ImageService::NewStub(channel)), worker_(worker) {
+        request_.set_segmentation_type("object");
+        if (options.payload_size > 0) {
+            (*request_.mutable_parameters())["payload"] = std::string(options.payload_size, 'x');
+        }
+    }
+
+    grpc::Status runOnce(CallBytes* bytes, std::chrono::system_clock::time_point deadline) override {
+        // Unique image IDs so the server does not coalesce the benchmark's own requests
+        request_.set_image_id("bench-" + std::to_string(worker_) + "-" + std::to_string(sequence_++));
+
+        grpc::ClientContext context;
+        context.set_deadline(deadline);
+        auto reader = stub_->doSegmentation(&context, request_);
+        bytes->sent = request_.ByteSizeLong();
+
+        imageservice::SegmentationResult response;
+        while (reader->Read(&response)) {
+            bytes->received += response.ByteSizeLong();
+        }
+        return reader->Finish();
+    }
+
+private:
+    std::unique_ptr<imageservice::ImageService::Stub> stub_;
+    imageservice::SegmentationRequest request_;
+    int worker_;
+    uint64_t sequence_ = 0;
+};
+
+// Ping-pong on one long-lived stream: each subscription request is answered
+// with a welcome notification.
+class ImageNotificationsWorkload : public Workload {
+public:
+    ImageNotificationsWorkload(std::shared_ptr<grpc::Channel> channel, const BenchOptions& options, int worker)
+        : stub_(imageservice::ImageService::NewStub(channel)) {
+        request_.set_client_id("bench-" + std::to_string(worker));
+        request_.set_client_name("grpc_bench");
+        request_.add_topics("system");
+        if (options.payload_size > 0) {
+            (*request_.mutable_preferences())["payload"] = std::string(options.payload_size, 'x');
+        }
+    }
+
+    ~ImageNotificationsWorkload() override {
+        closeStream();
+    }
+
+    grpc::Status runOnce(CallBytes* bytes, std::chrono::system_clock::time_point deadline) override {
+        if (!stream_) {
+            context_ = std::make_unique<grpc::ClientContext>();
+            context_->set_deadline(deadline);
+            stream_ = stub_->subscribeToNotifications(context_.get());
+        }
+
+        imageservice::ServerNotification notification;
+        if (!stream_->Write(request_) || !stream_->Read(&notification)) {
+            return closeStream();
+        }
+        bytes->sent = request_.ByteSizeLong();
+        bytes->received = notification.ByteSizeLong();
+        return grpc::Status::OK;
+    }
+
+private:
+    grpc::Status closeStream() {
+        if (!stream_) {
+            return grpc::Status::OK;
+        }
+        stream_->WritesDone();
+        imageservice::ServerNotification drain;
+        while (stream_->Read(&drain)) {
+        }
+        grpc::Status status = stream_->Finish();
+        stream_.reset();
+        context_.reset();
+        return status.ok() ? grpc::Status(grpc::StatusCode::UNAVAILABLE, "Notification stream closed") : status;
+    }
+
+    std::unique_ptr<imageservice::ImageService::Stub> stub_;
+    imageservice::SubscriptionRequest request_;
+    std::unique_ptr<grpc::ClientContext> context_;
+    std::unique_ptr<grpc::ClientReaderWriter<imageservice::SubscriptionRequest,
+                                             imageservice::ServerNotification>> stream_;
+};
+
+// One long-lived stream per worker subscribed to the server's "status"
+// heartbeat; each published notification is one operation, so latency is the
+// interval between deliveries. Run the server with --status-rate to set the
+// publish rate and --concurrency for the number of subscribers. With --batch,
+// the notifications of one batch count as separate operations, all but the
+// first taking no time.
+class ImageBroadcastWorkload : public Workload {
+public:
+    ImageBroadcastWorkload(std::shared_ptr<grpc::Channel> channel, const BenchOptions& options, int worker)
+        : stub_(imageservice::ImageService::NewStub(channel)) {
+        request_.set_client_id("bench-" + std::to_string(worker));
+        request_.set_client_name("grpc_bench");
+        request_.add_topics("status");
+        if (options.batch_size > 1) {
+            (*request_.mutable_preferences())["batch_max_size"] = std::to_string(options.batch_size);
+            (*request_.mutable_preferences())["batch_linger_ms"] = std::to_string(options.linger_ms);
+        }
+    }
+
+    ~ImageBroadcastWorkload() override {
+        closeStream();
+    }
+
+    grpc::Status runOnce(CallBytes* bytes, std::chrono::system_clock::time_point deadline) override {
+        imageservice::ServerNotification notification;
+        if (!stream_) {
+            context_ = std::make_unique<grpc::ClientContext>();
+            context_->set_deadline(deadline);
+            stream_ = stub_->subscribeToNotifications(context_.get());
+            // The welcome acknowledgment is not a published notification
+            if (!stream_->Write(request_) || !stream_->Read(&notification)) {
+                return closeStream();
+            }
+            bytes->sent = request_.ByteSizeLong();
+        }
+
+        if (batched_remaining_ > 0) {
+            batched_remaining_--;
+            return grpc::Status::OK;
+        }
+        if (!stream_->Read(&notification)) {
+            return closeStream();
+        }
+        bytes->received = notification.ByteSizeLong();
+        if (notification.has_batch() && notification.batch().notifications_size() > 0) {
+            batched_remaining_ = notification.batch().notifications_size() - 1;
+        }
+        return grpc::Status::OK;
+    }
+
+private:
+    grpc::Status closeStream() {
+        if (!stream_) {
+            return grpc::Status::OK;
+        }
+        context_->TryCancel();
+        grpc::Status status = stream_->Finish();
+        stream_.reset();
+        context_.reset();
+        batched_remaining_ = 0;
+        return status.ok() ? grpc::Status(grpc::StatusCode::UNAVAILABLE, "Notification stream closed") : status;
+    }
+
+    std::unique_ptr<imageservice::ImageService::Stub> stub_;
+    imageservice::SubscriptionRequest request_;
+    std::unique_ptr<grpc::ClientContext> context_;
+    std::unique_ptr<grpc::ClientReaderWriter<imageservice::SubscriptionRequest,
+                                             imageservice::ServerNotification>> stream_;
+    int batched_remaining_ = 0; // Notifications of the last batch not yet counted
+};
+
+// --- RayVision workloads ---
+
+class RayVisionGetImageWorkload : public Workload {
+public:
+    RayVisionGetImageWorkload(std::shared_ptr<grpc::Channel> channel, const BenchOptions&, int)
+        : stub_(rayvisiongrpc::RayVisionGrpc::NewStub(channel)) {
+        request_.set_type(rayvisiongrpc::HEAD);
+    }
+
+    grpc::Status runOnce(CallBytes* bytes, std::chrono::system_clock::time_point deadline) override {
+        grpc::ClientContext context;
+        context.set_deadline(deadline);
+        rayvisiongrpc::ImageData response;
+        grpc::Status status = stub_->GetImage(&context, request_, &response);
+        bytes->sent = request_.ByteSizeLong();
+        bytes->received = response.ByteSizeLong();
+        return status;
+    }
+
+private:
+    std::unique_ptr<rayvisiongrpc::RayVisionGrpc::Stub> stub_;
+    rayvisiongrpc::GetImageRequest request_;
+};
+
+// HEAD and BODY in one call, against two GetImage calls per operation
+class RayVisionBatchWorkload : public Workload {
+public:
+    RayVisionBatchWorkload(std::shared_ptr<grpc::Channel> channel, const BenchOptions&, int)
+        : stub_(rayvisiongrpc::RayVisionGrpc::NewStub(channel)) {
+        request_.add_types(rayvisiongrpc::HEAD);
+        request_.add_types(rayvisiongrpc::BODY);
+    }
+
+    grpc::Status runOnce(CallBytes* bytes, std::chrono::system_clock::time_point deadline) override {
+        grpc::ClientContext context;
+        context.set_deadline(deadline);
+        rayvisiongrpc::BatchGetImageReply response;
+        grpc::Status status = stub_->BatchGetImage(&context, request_, &response);
+        bytes->sent = request_.ByteSizeLong();
+        bytes->received = response.ByteSizeLong();
+        return status;
+    }
+
+private:
+    std::unique_ptr<rayvisiongrpc::RayVisionGrpc::Stub> stub_;
+    rayvisiongrpc::BatchGetImageRequest request_;
+};
+
+class RayVisionChunkedWorkload : public Workload {
+public:
+    RayVisionChunkedWorkload(std::shared_ptr<grpc::Channel> channel, const BenchOptions& options, int)
+        : stub_(rayvisiongrpc::RayVisionGrpc::NewStub(channel)) {
+        request_.set_type(rayvisiongrpc::HEAD);
+        request_.set_chunk_size(static_cast<uint32_t>(options.payload_size)); // 0 = server default
+    }
+
+    grpc::Status runOnce(CallBytes* bytes, std::chrono::system_clock::time_point deadline) override {
+        grpc::ClientContext context;
+        context.set_deadline(deadline);
+        auto reader = stub_->GetImageChunked(&context, request_);
+        bytes->sent = request_.ByteSizeLong();
+
+        rayvisiongrpc::ImageChunk chunk;
+        while (reader->Read(&chunk)) {
+            bytes->received += chunk.ByteSizeLong();
+        }
+        return reader->Finish();
+    }
+
+private:
+    std::unique_ptr<rayvisiongrpc::RayVisionGrpc::Stub> stub_;
+    rayvisiongrpc::GetImageChunkedRequest request_;
+};
+
+// One long-lived SubscribeFrames stream per worker; each frame is one
+// operation, so latency is the interval between pushed frames.
+class RayVisionSubscribeWorkload : public Workload {
+public:
+    RayVisionSubscribeWorkload(std::shared_ptr<grpc::Channel> channel, const BenchOptions&, int)
+        : stub_(rayvisiongrpc::RayVisionGrpc::NewStub(channel)) {
+        request_.set_type(static_cast<rayvisiongrpc::CameraType>(1)); // The simulated server publishes 1 and 2
+    }
+
+    ~RayVisionSubscribeWorkload() override {
+        closeStream();
+    }
+
+    grpc::Status runOnce(CallBytes* bytes, std::chrono::system_clock::time_point deadline) override {
+        if (!reader_) {
+            context_ = std::make_unique<grpc::ClientContext>();
+            context_->set_deadline(deadline);
+            reader_ = stub_->SubscribeFrames(context_.get(), request_);
+            bytes->sent = request_.ByteSizeLong();
+        }
+
+        rayvisiongrpc::ImageData frame;
+        if (!reader_->Read(&frame)) {
+            return closeStream();
+        }
+        bytes->received = frame.ByteSizeLong();
+        return grpc::Status::OK;
+    }
+
+private:
+    grpc::Status closeStream() {
+        if (!reader_) {
+            return grpc::Status::OK;
+        }
+        context_->TryCancel();
+        grpc::Status status = reader_->Finish();
+        reader_.reset();
+        context_.reset();
+        return status.ok() ? grpc::Status(grpc::StatusCode::UNAVAILABLE, "Frame stream closed") : status;
+    }
+
+    std::unique_ptr<rayvisiongrpc::RayVisionGrpc::Stub> stub_;
+    rayvisiongrpc::SubscribeFramesRequest request_;
+    std::unique_ptr<grpc::ClientContext> context_;
+    std::unique_ptr<grpc::ClientReader<rayvisiongrpc::ImageData>> reader_;
+};
+
+class RayVisionSegmentationWorkload : public Workload {
+public:
+    RayVisionSegmentationWorkload(std::shared_ptr<grpc::Channel> channel, const BenchOptions&, int)
+        : stub_(rayvisiongrpc::RayVisionGrpc::NewStub(channel)) {
+        request_.set_max_results(1);
+    }
+
+    grpc::Status runOnce(CallBytes* bytes, std::chrono::system_clock::time_point deadline) override {
+        grpc::ClientContext context;
+        context.set_deadline(deadline);
+        auto reader = stub_->doSegmentation(&context, request_);
+        bytes->sent = request_.ByteSizeLong();
+
+        rayvisiongrpc::SegmentationResult response;
+        while (reader->Read(&response)) {
+            bytes->received += response.ByteSizeLong();
+        }
+        return reader->Finish();
+    }
+
+private:
+    std::unique_ptr<rayvisiongrpc::RayVisionGrpc::Stub> stub_;
+    rayvisiongrpc::SegmentationRequest request_;
+};
+
+std::unique_ptr<Workload> createWorkload(const BenchOptions& options, std::shared_ptr<grpc::Channel> channel, int worker) {
+    if (options.service == "image") {
+        if (options.rpc == "getimage") {
+            return std::make_unique<ImageGetImageWorkload>(channel, options, worker);
+        } else if (options.rpc == "segmentation") {
+            return std::make_unique<ImageSegmentationWorkload>(channel, options, worker);
+        } else if (options.rpc == "notifications") {
+            return std::make_unique<ImageNotificationsWorkload>(channel, options, worker);
+        } else if (options.rpc == "broadcast") {
+            return std::make_unique<ImageBroadcastWorkload>(channel, options, worker);
+        }
+    } else if (options.service == "rayvision") {
+        if (options.rpc == "getimage") {
+            return std::make_unique<RayVisionGetImageWorkload>(channel, options, worker);
+        } else if (options.rpc == "batch") {
+            return std::make_unique<RayVisionBatchWorkload>(channel, options, worker);
+        } else if (options.rpc == "chunked") {
+            return std::make_unique<RayVisionChunkedWorkload>(channel, options, worker);
+        } else if (options.rpc == "segmentation") {
+            return std::make_unique<RayVisionSegmentationWorkload>(channel, options, worker);
+        } else if (options.rpc == "subscribe") {
+            return std::make_unique<RayVisionSubscribeWorkload>(channel, options, worker);
+        }
+    }
+    return nullptr;
+}
+
+// --- Measurement and reporting ---
+
+struct WorkerStats {
+    common::LatencyHistogram latency;
+    uint64_t bytes_sent = 0;
+    uint64_t bytes_received = 0;
+    std::map<grpc::StatusCode, uint64_t> errors;
+};
+
+const char* statusCodeName(grpc::StatusCode code) {
+    switch (code) {
+    case grpc::StatusCode::OK: return "OK";
+    case grpc::StatusCode::CANCELLED: return "CANCELLED";
+    case grpc::StatusCode::UNKNOWN: return "UNKNOWN";
+    case grpc::StatusCode::INVALID_ARGUMENT: return "INVALID_ARGUMENT";
+    case grpc::StatusCode::DEADLINE_EXCEEDED: return "DEADLINE_EXCEEDED";
+    case grpc::StatusCode::NOT_FOUND: return "NOT_FOUND";
+    case grpc::StatusCode::RESOURCE_EXHAUSTED: return "RESOURCE_EXHAUSTED";
+    case grpc::StatusCode::FAILED_PRECONDITION: return "FAILED_PRECONDITION";
+    case grpc::StatusCode::UNIMPLEMENTED: return "UNIMPLEMENTED";
+    case grpc::StatusCode::INTERNAL: return "INTERNAL";
+    case grpc::StatusCode::UNAVAILABLE: return "UNAVAILABLE";
+    default: return "OTHER";
+    }
+}
+
+void runWorker(const BenchOptions& options, std::shared_ptr<grpc::Channel> channel, int worker,
+               Clock::time_point measure_from, Clock::time_point stop_at, WorkerStats* stats) {
+    auto workload = createWorkload(options, channel, worker);
+    auto deadline = std::chrono::system_clock::now() + (stop_at - Clock::now()) +
+                    std::chrono::seconds(options.grace_seconds);
+    while (true) {
+        auto start = Clock::now();
+        if (start >= stop_at) {
+            break;
+        }
+
+        CallBytes bytes;
+        grpc::Status status = workload->runOnce(&bytes, deadline);
+        auto end = Clock::now();
+        if (start < measure_from) {
+            continue; // Warmup
+        }
+
+        if (status.ok()) {
+            stats->latency.record(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+            stats->bytes_sent += bytes.sent;
+            stats->bytes_received += bytes.received;
+        } else {
+            stats->errors[status.error_code()]++;
+            if (status.error_code() == grpc::StatusCode::UNAVAILABLE) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(10)); // Don't spin on a dead server
+            }
+        }
+    }
+}
+
+void printReport(const BenchOptions& options, const WorkerStats& total, double seconds) {
+    uint64_t ok = total.latency.count();
+    uint64_t failed = 0;
+    for (const auto& error : total.errors) {
+        failed += error.second;
+    }
+    auto us = [&total](double quantile) { return total.latency.percentile(quantile) / 1000.0; };
+
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << "grpc_bench " << options.service << "/" << options.rpc << " -> " << options.target << std::endl;
+    std::cout << "  channels " << options.channels << ", concurrency " << options.concurrency
+              << ", duration " << options.duration_seconds << "s, payload " << options.payload_size << " bytes" << std::endl;
+    std::cout << "  requests:   " << ok << " ok, " << failed << " failed";
+    for (const auto& error : total.errors) {
+        std::cout << " (" << statusCodeName(error.first) << ": " << error.second << ")";
+    }
+    std::cout << std::endl;
+    std::cout << "  throughput: " << ok / seconds << " req/s, "
+              << total.bytes_received / seconds / 1e6 << " MB/s received, "
+              << total.bytes_sent / seconds / 1e6 << " MB/s sent" << std::endl;
+    std::cout << "  latency us: min " << total.latency.min() / 1000.0
+              << "  p50 " << us(0.50) << "  p90 " << us(0.90) << "  p99 " << us(0.99)
+              << "  p999 " << us(0.999) << "  max " << total.latency.max() / 1000.0
+              << "  mean " << total.latency.mean() / 1000.0 << std::endl;
+}
+
+bool writeJsonReport(const BenchOptions& options, const WorkerStats& total, double seconds) {
+    std::ofstream out(options.json_path);
+    if (!out) {
+        return false;
+    }
+    auto us = [&total](double quantile) { return total.latency.percentile(quantile) / 1000.0; };
+
+    out << std::fixed << std::setprecision(3);
+    out << "{\n";
+    out << "  \"service\": \"" << options.service << "\",\n";
+    out << "  \"rpc\": \"" << options.rpc << "\",\n";
+    out << "  \"target\": \"" << options.target << "\",\n";
+    out << "  \"channels\": " << options.channels << ",\n";
+    out << "  \"concurrency\": " << options.concurrency << ",\n";
+    out << "  \"duration_seconds\": " << options.duration_seconds << ",\n";
+    out << "  \"payload_bytes\": " << options.payload_size << ",\n";
+    out << "  \"requests_ok\": " << total.latency.count() << ",\n";
+    out << "  \"errors\": {";
+    const char* separator = "";
+    for (const auto& error : total.errors) {
+        out << separator << "\"" << statusCodeName(error.first) << "\": " << error.second;
+        separator = ", ";
+    }
+    out << "},\n";
+    out << "  \"qps\": " << total.latency.count() / seconds << ",\n";
+    out << "  \"mb_per_sec_received\": " << total.bytes_received / seconds / 1e6 << ",\n";
+    out << "  \"mb_per_sec_sent\": " << total.bytes_sent / seconds / 1e6 << ",\n";
+    out << "  \"latency_us\": {\"min\": " << total.latency.min() / 1000.0
+        << ", \"p50\": " << us(0.50) << ", \"p90\": " << us(0.90) << ", \"p99\": " << us(0.99)
+        << ", \"p999\": " << us(0.999) << ", \"max\": " << total.latency.max() / 1000.0
+        << ", \"mean\": " << total.latency.mean() / 1000.0 << "}\n";
+    out << "}\n";
+    return static_cast<bool>(out);
+}
+
+void printUsage(const char* program) {
+    std::cout << "Usage: " << program << " [options]\n"
+              << "  --service image|rayvision     Service to drive (default image)\n"
+              << "  --rpc NAME                    image: getimage|segmentation|notifications|broadcast\n"
+              << "                                rayvision: getimage|batch|chunked|segmentation|subscribe (default getimage)\n"
+              << "  --target ADDRESS              Server address (default: the service's Unix socket)\n"
+              << "  --channels N                  Channels, each with its own connection (default 1)\n"
+              << "  --concurrency N               Concurrent closed-loop workers (default 4)\n"
+              << "  --duration SECONDS            Measured run time (default 10)\n"
+              << "  --warmup SECONDS              Unmeasured warmup (default 1)\n"
+              << "  --payload BYTES               Request padding; chunk size for rayvision/chunked (default 0)\n"
+              << "  --grace SECONDS               Deadline for calls still running at the end (default 5)\n"
+              << "  --batch N                     image/broadcast: notifications per message (default 1)\n"
+              << "  --linger MS                   image/broadcast: longest wait for a full batch (default 0)\n"
+              << "  --json PATH                   Also write the report as JSON\n";
+}
+
+int main(int argc, char** argv) {
+    BenchOptions options;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--service" && i + 1 < argc) {
+            options.service = argv[++i];
+        } else if (arg == "--rpc" && i + 1 < argc) {
+            options.rpc = argv[++i];
+        } else if (arg == "--target" && i + 1 < argc) {
+            options.target = argv[++i];
+        } else if (arg == "--channels" && i + 1 < argc) {
+            options.channels = std::max(1, std::stoi(argv[++i]));
+        } else if (arg == "--concurrency" && i + 1 < argc) {
+            options.concurrency = std::max(1, std::stoi(argv[++i]));
+        } else if (arg == "--duration" && i + 1 < argc) {
+            options.duration_seconds = std::max(1, std::stoi(argv[++i]));
+        } else if (arg == "--warmup" && i + 1 < argc) {
+            options.warmup_seconds = std::max(0, std::stoi(argv[++i]));
+        } else if (arg == "--payload" && i + 1 < argc) {
+            options.payload_size = std::stoul(argv[++i]);
+        } else if (arg == "--grace" && i + 1 < argc) {
+            options.grace_seconds = std::max(0, std::stoi(argv[++i]));
+        } else if (arg == "--batch" && i + 1 < argc) {
+            options.batch_size = std::max(1, std::stoi(argv[++i]));
+        } else if (arg == "--linger" && i + 1 < argc) {
+            options.linger_ms = std::max(0.0, std::stod(argv[++i]));
+        } else if (arg == "--json" && i + 1 < argc) {
+            options.json_path = argv[++i];
+        } else {
+            printUsage(argv[0]);
+            return arg == "--help" ? 0 : 1;
+        }
+    }
+
+    if (options.target.empty()) {
+        options.target = options.service == "rayvision" ? "unix:///tmp/rayvision_service.sock"
+                                                        : "unix:///tmp/image_service.sock";
+    }
+
+    // Every channel has its own connection; each worker stays on one of them
+    common::ChannelPool channels(options.target, options.channels);
+
+    if (!createWorkload(options, channels.channel(0), 0)) {
+        std::cerr << "Unknown rpc '" << options.rpc << "' for service '" << options.service << "'" << std::endl;
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    auto measure_from = Clock::now() + std::chrono::seconds(options.warmup_seconds);
+    auto stop_at = measure_from + std::chrono::seconds(options.duration_seconds);
+
+    std::vector<std::unique_ptr<WorkerStats>> stats;
+    std::vector<std::thread> workers;
+    for (int i = 0; i < options.concurrency; ++i) {
+        stats.push_back(std::make_unique<WorkerStats>());
+        workers.emplace_back(runWorker, std::cref(options), channels.channel(i % channels.size()), i,
+                             measure_from, stop_at, stats.back().get());
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    // Calls still in flight at stop_at finish after it; count them against the full run
+    double seconds = std::max<double>(options.duration_seconds,
+                                      std::chrono::duration<double>(Clock::now() - measure_from).count());
+
+    WorkerStats total;
+    for (const auto& worker_stats : stats) {
+        total.latency.merge(worker_stats->latency);
+        total.bytes_sent += worker_stats->bytes_sent;
+        total.bytes_received += worker_stats->bytes_received;
+        for (const auto& error : worker_stats->errors) {
+            total.errors[error.first] += error.second;
+        }
+    }
+
+    printReport(options, total, seconds);
+    if (!options.json_path.empty()) {
+        if (!writeJsonReport(options, total, seconds)) {
+            std::cerr << "Failed to write JSON report to " << options.json_path << std::endl;
+            return 1;
+        }
+        std::cout << "  JSON report written to " << options.json_path << std::endl;
+    }
+    return total.latency.count() > 0 ? 0 : 1;
+}
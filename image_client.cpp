@@ -1,13 +1,20 @@
+#include <algorithm>
 #include <iostream>
 #include <memory>
 #include <string>
 #include <thread>
 #include <chrono>
+#include <cstdlib>
+#include <iomanip>
 #include <random>
 
 #include <grpcpp/grpcpp.h>
 
 #include "image_service.grpc.pb.h"
+#include "ChannelPool.h"
+#include "Compression.h"
+#include "Metrics.h"
+#include "SharedFrameRing.h"
 
 using grpc::Channel;
 using grpc::ClientContext;
@@ -22,8 +29,10 @@ using imageservice::ServerNotification;
 
 class ImageServiceClient {
 public:
-    ImageServiceClient(std::shared_ptr<Channel> channel, const std::string& client_name = "default_client")
-        : stub_(ImageService::NewStub(channel)), client_name_(client_name) {}
+    ImageServiceClient(std::shared_ptr<common::ChannelPool> channels, const std::string& client_name = "default_client",
+                       bool use_shared_memory = false, grpc_compression_algorithm compression = GRPC_COMPRESS_NONE)
+        : stubs_(std::move(channels)), client_name_(client_name),
+          use_shared_memory_(use_shared_memory), compression_(compression) {}
 
     // Assembles the client's payload, sends it and presents the response back
     // from the server.
@@ -31,6 +40,7 @@ public:
         // Data we are sending to the server.
         GetImageRequest request;
         request.set_image_id(image_id);
+        request.set_use_shared_memory(use_shared_memory_);
 
         // Container for the data we expect from the server.
         ImageData reply;
@@ -38,6 +48,7 @@ public:
         // Context for the client. It could be used to convey extra information to
         // the server and/or tweak certain RPC behaviors.
         ClientContext context;
+        common::requestCompression(&context, compression_);
 
         // Set client name in metadata
         context.AddMetadata("client-name", client_name_);
@@ -47,7 +58,8 @@ public:
         context.set_deadline(deadline);
 
         // The actual RPC.
-        Status status = stub_->GetImage(&context, request, &reply);
+        auto stub = stubs_.acquire();
+        Status status = stub->GetImage(&context, request, &reply);
 
         // Act upon its status.
         if (status.ok()) {
@@ -57,6 +69,9 @@ public:
             std::cout << "   Format: " << reply.format() << std::endl;
             std::cout << "   Dimensions: " << reply.width() << "x" << reply.height() << std::endl;
             std::cout << "   Size: " << reply.size() << " bytes" << std::endl;
+            if (reply.has_shared_frame()) {
+                return printSharedFrame(reply.shared_frame());
+            }
             std::cout << "   Content preview: " << reply.image_content().substr(0, 50) << "..." << std::endl;
             std::cout << std::endl;
             return true;
@@ -87,6 +102,7 @@ public:
 
         // Context for the client
         ClientContext context;
+        common::requestCompression(&context, compression_);
         context.AddMetadata("client-name", client_name_);
 
         // Set a longer deadline for segmentation (it might take time)
@@ -94,8 +110,9 @@ public:
         context.set_deadline(deadline);
 
         // Create the streaming reader
+        auto stub = stubs_.acquire();
         std::unique_ptr<grpc::ClientReader<SegmentationResult>> reader(
-            stub_->doSegmentation(&context, request));
+            stub->doSegmentation(&context, request));
 
         SegmentationResult result;
         bool first_response = true;
@@ -161,8 +178,10 @@ public:
         return true;
     }
 
-    // Subscribe to server notifications
-    bool subscribeToNotifications(const std::vector<std::string>& topics = {"system", "status"}) {
+    // Subscribe to server notifications; batch_max_size above 1 asks the server
+    // to deliver up to that many per message, waiting up to batch_linger_ms
+    bool subscribeToNotifications(const std::vector<std::string>& topics = {"system", "status"},
+                                  int batch_max_size = 1, double batch_linger_ms = 0) {
         std::cout << "🔔 Subscribing to notifications..." << std::endl;
         std::cout << "   Client: " << client_name_ << std::endl;
         std::cout << "   Topics: ";
@@ -174,6 +193,7 @@ public:
 
         // Context for the client
         ClientContext context;
+        common::requestCompression(&context, compression_);
         context.AddMetadata("client-name", client_name_);
 
         // Set a long deadline for subscription (it's a long-running connection)
@@ -181,8 +201,9 @@ public:
         context.set_deadline(deadline);
 
         // Create the bidirectional streaming
+        auto stub = stubs_.acquire();
         std::unique_ptr<grpc::ClientReaderWriter<SubscriptionRequest, ServerNotification>> stream(
-            stub_->subscribeToNotifications(&context));
+            stub->subscribeToNotifications(&context));
 
         // Send initial subscription request
         SubscriptionRequest request;
@@ -197,6 +218,10 @@ public:
         // Add some preferences
         request.mutable_preferences()->insert({"notification_format", "detailed"});
         request.mutable_preferences()->insert({"language", "en"});
+        if (batch_max_size > 1) {
+            request.mutable_preferences()->insert({"batch_max_size", std::to_string(batch_max_size)});
+            request.mutable_preferences()->insert({"batch_linger_ms", std::to_string(batch_linger_ms)});
+        }
 
         if (!stream->Write(request)) {
             std::cout << "❌ Failed to send subscription request" << std::endl;
@@ -210,29 +235,14 @@ public:
         std::thread notification_thread([&stream]() {
             ServerNotification notification;
             while (stream->Read(&notification)) {
-                auto timestamp = std::chrono::milliseconds(notification.timestamp());
-                auto time_point = std::chrono::system_clock::time_point(timestamp);
-                auto time_t = std::chrono::system_clock::to_time_t(time_point);
-
-                std::cout << "📢 [" << std::put_time(std::localtime(&time_t), "%H:%M:%S") << "] "
-                          << notification.notification_type() << " - " << notification.topic()
-                          << ": " << notification.message() << std::endl;
-
-                // Display metadata if present
-                if (!notification.metadata().empty()) {
-                    std::cout << "   📋 Metadata: ";
-                    for (const auto& meta : notification.metadata()) {
-                        std::cout << meta.first << "=" << meta.second << " ";
+                // A batched stream delivers several notifications per message
+                if (notification.has_batch()) {
+                    for (const auto& batched : notification.batch().notifications()) {
+                        printNotification(batched);
                     }
-                    std::cout << std::endl;
+                } else {
+                    printNotification(notification);
                 }
-
-                // Display data size if present
-                if (!notification.data().empty()) {
-                    std::cout << "   📦 Data size: " << notification.data().size() << " bytes" << std::endl;
-                }
-
-                std::cout << std::endl;
             }
         });
 
@@ -291,15 +301,93 @@ public:
     }
 
     // Test notification functionality
-    void TestNotifications() {
+    void TestNotifications(std::vector<std::string> test_topics, int batch_max_size, double batch_linger_ms) {
         std::cout << "🚀 Testing notification subscription..." << std::endl;
         std::cout << "===========================================" << std::endl;
 
-        std::vector<std::string> test_topics = {"system", "status", "updates", "alerts"};
-        subscribeToNotifications(test_topics);
+        if (test_topics.empty()) {
+            test_topics = {"system", "status", "segmentation/#", "alerts"};
+        }
+        subscribeToNotifications(test_topics, batch_max_size, batch_linger_ms);
+    }
+
+    // Print the server's per-method counters, latencies and gauges
+    void PrintStats() {
+        imageservice::StatsRequest request;
+        imageservice::StatsReply reply;
+        ClientContext context;
+        common::requestCompression(&context, compression_);
+        auto stub = stubs_.acquire();
+        Status status = stub->GetStats(&context, request, &reply);
+        if (!status.ok()) {
+            std::cout << "❌ GetStats failed: " << status.error_message() << std::endl;
+            return;
+        }
+        std::cout << "📊 Server stats" << std::endl;
+        std::cout << common::formatStatsReply(reply);
     }
 
 private:
+    static void printNotification(const ServerNotification& notification) {
+        auto timestamp = std::chrono::milliseconds(notification.timestamp());
+        auto time_point = std::chrono::system_clock::time_point(timestamp);
+        auto time_t = std::chrono::system_clock::to_time_t(time_point);
+
+        std::cout << "📢 [" << std::put_time(std::localtime(&time_t), "%H:%M:%S") << "] "
+                  << notification.notification_type() << " - " << notification.topic()
+                  << ": " << notification.message() << std::endl;
+
+        // Display metadata if present
+        if (!notification.metadata().empty()) {
+            std::cout << "   📋 Metadata: ";
+            for (const auto& meta : notification.metadata()) {
+                std::cout << meta.first << "=" << meta.second << " ";
+            }
+            std::cout << std::endl;
+        }
+
+        // Display data size if present
+        if (!notification.data().empty()) {
+            std::cout << "   📦 Data size: " << notification.data().size() << " bytes" << std::endl;
+        }
+
+        std::cout << std::endl;
+    }
+
+    // Reads a frame in place from the server's shared-memory ring
+    bool printSharedFrame(const imageservice::SharedFrameHandle& grpc_handle) {
+        if (!frame_reader_ || frame_reader_->channelPath() != grpc_handle.channel_path()) {
+            frame_reader_ = std::make_unique<common::SharedFrameReader>(grpc_handle.channel_path());
+        }
+        if (!frame_reader_->connect()) {
+            std::cout << "❌ Failed to map shared frame ring via " << grpc_handle.channel_path() << std::endl;
+            return false;
+        }
+
+        common::SharedFrameHandle handle;
+        handle.slot = grpc_handle.slot();
+        handle.sequence = grpc_handle.sequence();
+        handle.offset = grpc_handle.offset();
+        handle.length = grpc_handle.length();
+
+        const std::byte* frame = frame_reader_->data(handle);
+        if (!frame) {
+            std::cout << "❌ Shared frame was overwritten before it could be read" << std::endl;
+            return false;
+        }
+
+        std::string preview(reinterpret_cast<const char*>(frame), std::min<uint64_t>(handle.length, 50));
+        if (!frame_reader_->isCurrent(handle)) {
+            std::cout << "❌ Shared frame was overwritten while it was being read" << std::endl;
+            return false;
+        }
+
+        std::cout << "   Shared memory: slot " << handle.slot << ", sequence " << handle.sequence << std::endl;
+        std::cout << "   Content preview: " << preview << "..." << std::endl;
+        std::cout << std::endl;
+        return true;
+    }
+
     std::string generateClientId() {
         static std::atomic<int> counter{0};
         static std::random_device rd;
@@ -309,8 +397,11 @@ private:
         return "client_" + std::to_string(counter.fetch_add(1)) + "_" + std::to_string(dis(gen));
     }
 
-    std::unique_ptr<ImageService::Stub> stub_;
+    common::StubPool<ImageService> stubs_; // Each call leases the stub of one pooled channel
     std::string client_name_;
+    bool use_shared_memory_;
+    grpc_compression_algorithm compression_; // Both directions of every call
+    std::unique_ptr<common::SharedFrameReader> frame_reader_;
 };
 
 // Generate a random client name
@@ -332,6 +423,14 @@ int main(int argc, char** argv) {
     std::string segmentation_type = "";
     bool test_segmentation = false;
     bool test_notifications = false;
+    std::vector<std::string> topics; // Filters for --test-notifications
+    int batch_max_size = 1;          // Notifications per message for --test-notifications
+    double batch_linger_ms = 0;
+    bool use_shared_memory = false;
+    bool print_stats = false;
+    grpc_compression_algorithm compression = GRPC_COMPRESS_NONE;
+    int channels = 1; // Connections to the server
+    auto channel_policy = common::ChannelPool::Policy::LeastOutstanding;
 
     // Parse command line arguments
     for (int i = 1; i < argc; i++) {
@@ -346,6 +445,38 @@ int main(int argc, char** argv) {
             test_segmentation = true;
         } else if (arg == "--test-notifications") {
             test_notifications = true;
+        } else if (arg == "--topics" && i + 1 < argc) {
+            // Comma-separated, e.g. "status,segmentation/+/completed"
+            std::string list = argv[++i];
+            size_t start = 0;
+            while (start <= list.size()) {
+                size_t end = std::min(list.find(',', start), list.size());
+                if (end > start) {
+                    topics.push_back(list.substr(start, end - start));
+                }
+                start = end + 1;
+            }
+        } else if (arg == "--batch" && i + 1 < argc) {
+            batch_max_size = std::atoi(argv[++i]);
+        } else if (arg == "--linger" && i + 1 < argc) {
+            batch_linger_ms = std::atof(argv[++i]);
+        } else if (arg == "--shm") {
+            use_shared_memory = true;
+        } else if (arg == "--stats") {
+            print_stats = true;
+        } else if (arg == "--compression" && i + 1 < argc) {
+            if (!common::parseCompression(argv[++i], &compression)) {
+                std::cout << "Unknown compression " << argv[i] << " (expected none, gzip or deflate)" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--channels" && i + 1 < argc) {
+            channels = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--channel-policy" && i + 1 < argc) {
+            if (!common::parseChannelPolicy(argv[++i], &channel_policy)) {
+                std::cout << "Unknown channel policy " << argv[i] << " (expected round-robin or least-outstanding)"
+                          << std::endl;
+                return 1;
+            }
         } else if (arg[0] != '-') {
             // Non-flag argument - treat as image_id if we don't have one yet
             if (image_id.empty()) {
@@ -359,13 +490,15 @@ int main(int argc, char** argv) {
 
     // Instantiate the client
     ImageServiceClient client(
-        grpc::CreateChannel(target_str, grpc::InsecureChannelCredentials()),
-        client_name);
+        std::make_shared<common::ChannelPool>(target_str, channels, channel_policy),
+        client_name, use_shared_memory, compression);
 
     // Check what operation to perform
-    if (test_notifications) {
+    if (print_stats) {
+        client.PrintStats();
+    } else if (test_notifications) {
         // Run notification tests
-        client.TestNotifications();
+        client.TestNotifications(topics, batch_max_size, batch_linger_ms);
     } else if (test_segmentation) {
         // Run segmentation tests
         client.TestSegmentation();
@@ -1,40 +1,112 @@
-#include <iostream>
+#include <algorithm>
 #include <memory>
 #include <string>
+#include <vector>
 #include <thread>
 #include <chrono>
 #include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <iostream>
+#include <fcntl.h>
+#include <poll.h>
 #include <signal.h>
 #include <unistd.h>
 
 #include "ImageServiceAgent.h"
+#include "Logger.h"
+#include "WorkerProcesses.h"
+#include "WorkerPool.h"
 
 using namespace vision;
 
-// Global flag for graceful shutdown
+constexpr long long kMaxMetricsIntervalMs = 24LL * 60 * 60 * 1000;
+constexpr double kMinStatusRate = 0.01; // Keeps the heartbeat interval representable
+constexpr double kMaxStatusRate = 10000;
+
+// Global flag for graceful shutdown, and the signal that requested it
 std::atomic<bool> g_shutdown_requested(false);
+std::atomic<int> g_shutdown_signal(0);
 
-// Signal handler for graceful shutdown
+// Socket files of the configured Unix listen addresses; set before the signal
+// handlers are installed
+std::vector<std::string> g_socket_paths;
+
+// Self-pipe the signal handler writes to, so waits in main wake at once
+int g_shutdown_pipe[2] = {-1, -1};
+
+// Signal handler for graceful shutdown. Only async-signal-safe work here: the
+// logger takes locks and allocates, so main logs the shutdown once it wakes.
 void signalHandler(int signal) {
-    std::cout << "\n[SHUTDOWN] Received signal " << signal << ", shutting down gracefully..." << std::endl;
+    int saved_errno = errno;
+    g_shutdown_signal = signal;
     g_shutdown_requested = true;
 
-    // Clean up Unix socket
-    if (unlink("/tmp/image_service.sock") == 0) {
-        std::cout << "[SHUTDOWN] Unix socket cleaned up" << std::endl;
+    // Clean up Unix sockets
+    for (const auto& socket_path : g_socket_paths) {
+        unlink(socket_path.c_str());
+    }
+    if (g_shutdown_pipe[1] >= 0) {
+        char wake = 1;
+        ssize_t written = write(g_shutdown_pipe[1], &wake, 1);
+        (void)written; // A full pipe already holds a wake-up
+    }
+    errno = saved_errno;
+}
+
+void createShutdownPipe() {
+    if (pipe(g_shutdown_pipe) != 0) {
+        AGENT_LOG_WARN("[SERVER] Failed to create the shutdown pipe, shutdown may wait for the next heartbeat");
+        g_shutdown_pipe[0] = g_shutdown_pipe[1] = -1;
+        return;
+    }
+    for (int fd : g_shutdown_pipe) {
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+        fcntl(fd, F_SETFL, O_NONBLOCK);
     }
 }
 
+// Sleeps until the deadline, returning early once shutdown is requested
+void waitForShutdown(std::chrono::steady_clock::time_point deadline) {
+    pollfd wake = {g_shutdown_pipe[0], POLLIN, 0};
+    while (!g_shutdown_requested) {
+        auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline
+                                                                               - std::chrono::steady_clock::now());
+        if (remaining.count() <= 0) {
+            std::this_thread::sleep_until(deadline); // Under a millisecond left
+            return;
+        }
+        poll(&wake, 1, static_cast<int>(remaining.count()));
+    }
+}
+
+void logShutdownSignal() {
+    if (int signal = g_shutdown_signal.load()) {
+        AGENT_LOG_INFO("[SHUTDOWN] Received signal " << signal << ", shutting down gracefully");
+    }
+}
+
+// A client-supplied string as a single topic level: separators and wildcards
+// would change the topic's depth or make it unpublishable
+std::string topicLevel(const std::string& text) {
+    if (text.empty()) {
+        return "_";
+    }
+    std::string level = text;
+    std::replace_if(level.begin(), level.end(), [](char c) { return c == '/' || c == '+' || c == '#'; }, '_');
+    return level;
+}
+
 // Segmentation processor that handles the actual segmentation work
 class SegmentationProcessor {
 public:
     SegmentationProcessor() {
-        std::cout << "[PROCESSOR] SegmentationProcessor initialized" << std::endl;
+        AGENT_LOG_INFO("[PROCESSOR] SegmentationProcessor initialized");
     }
 
     SegmentationResult processSegmentation(const std::string& image_id, const std::string& segmentation_type) {
-        std::cout << "[PROCESSOR] Processing segmentation for image: " << image_id
-                  << ", type: " << segmentation_type << std::endl;
+        AGENT_LOG_DEBUG("[PROCESSOR] Processing segmentation for image: " << image_id
+                        << ", type: " << segmentation_type);
 
         // Simulate segmentation processing
         std::this_thread::sleep_for(std::chrono::milliseconds(2000));
@@ -43,7 +115,7 @@ public:
         SegmentationResult result;
         result.segmentation_result = "SEGMENTED_RESULT_FOR_" + image_id + "_" + segmentation_type;
 
-        std::cout << "[PROCESSOR] Segmentation completed for image: " << image_id << std::endl;
+        AGENT_LOG_DEBUG("[PROCESSOR] Segmentation completed for image: " << image_id);
 
         return result;
     }
@@ -54,58 +126,76 @@ class VisionConnector : public ImageServiceAgent::IImageServiceListener,
                        public std::enable_shared_from_this<VisionConnector> {
 public:
     VisionConnector() {
-        std::cout << "[CONNECTOR] VisionConnector initialized" << std::endl;
+        AGENT_LOG_INFO("[CONNECTOR] VisionConnector initialized");
 
         // Create the segmentation processor
         processor_ = std::make_unique<SegmentationProcessor>();
 
-        std::cout << "[CONNECTOR] SegmentationProcessor created" << std::endl;
+        // Fixed number of segmentation workers; bursts wait in a bounded queue
+        // and are rejected once it is full
+        unsigned int worker_count = std::max(1u, std::thread::hardware_concurrency());
+        workers_ = std::make_unique<common::WorkerPool>(worker_count, kMaxQueuedSegmentations);
+
+        AGENT_LOG_INFO("[CONNECTOR] SegmentationProcessor created with " << worker_count << " workers");
+    }
+
+    ~VisionConnector() {
+        // Stop the workers while the agent they report to is still alive
+        workers_.reset();
     }
 
     // Method to initialize the agent after the object is created as shared_ptr
-    void initializeAgent() {
+    void initializeAgent(const common::ServerConfig& server_config) {
         // Create the agent with this connector as the listener
-        agent_ = std::make_unique<ImageServiceAgent>(std::weak_ptr<ImageServiceAgent::IImageServiceListener>(shared_from_this()));
-        std::cout << "[CONNECTOR] ImageServiceAgent created and connected" << std::endl;
+        agent_ = std::make_unique<ImageServiceAgent>(
+            std::weak_ptr<ImageServiceAgent::IImageServiceListener>(shared_from_this()), std::chrono::milliseconds(33),
+            NotificationOptions(), server_config);
+        AGENT_LOG_INFO("[CONNECTOR] ImageServiceAgent created and connected");
     }
 
-    void onDoSegmentation() override {
-        std::cout << "[CONNECTOR] Segmentation requested, delegating to processor..." << std::endl;
-
-        // Store the current request info for processing
-        current_image_id_ = "img001"; // In a real implementation, this would come from the request
-        current_segmentation_type_ = "object"; // In a real implementation, this would come from the request
+    bool onDoSegmentation(const SegmentationRequest& request) override {
+        AGENT_LOG_DEBUG("[CONNECTOR] Segmentation " << request.request_id << " requested for image "
+                        << request.image_id << ", delegating to processor...");
 
-        // Start processing in a separate thread to avoid blocking
-        std::thread([this]() {
+        // Queue on the worker pool to avoid blocking; the request is captured by
+        // value so concurrent requests cannot overwrite each other
+        return workers_->trySubmit([this, request]() {
             try {
                 // Delegate to the segmentation processor
-                auto result = processor_->processSegmentation(current_image_id_, current_segmentation_type_);
+                auto result = processor_->processSegmentation(request.image_id, request.segmentation_type);
+
+                // Send the result back to the agent for this request
+                agent_->sendSegmentationResult(request.request_id, result);
 
-                // Send the result back to the agent
-                agent_->sendSegmentationResult(result);
+                Notification update;
+                update.message = "Segmentation of " + request.image_id + " completed";
+                update.notification_type = "update";
+                update.metadata["request_id"] = std::to_string(request.request_id);
+                update.metadata["segmentation_type"] = request.segmentation_type;
+                agent_->publishNotification("segmentation/" + topicLevel(request.segmentation_type) + "/completed",
+                                            update);
 
-                std::cout << "[CONNECTOR] Segmentation result sent back to agent" << std::endl;
+                AGENT_LOG_DEBUG("[CONNECTOR] Segmentation result sent back to agent");
             } catch (const std::exception& e) {
-                std::cerr << "[CONNECTOR] Error during segmentation: " << e.what() << std::endl;
+                AGENT_LOG_ERROR("[CONNECTOR] Error during segmentation: " << e.what());
 
                 // Send error result
                 SegmentationResult error_result;
                 error_result.segmentation_result = "ERROR: " + std::string(e.what());
-                agent_->sendSegmentationResult(error_result);
+                agent_->sendSegmentationResult(request.request_id, error_result);
             }
-        }).detach();
+        }, request.priority);
     }
 
     ImageData onGetImage() override {
-        std::cout << "[CONNECTOR] Image requested, returning sample data..." << std::endl;
+        AGENT_LOG_DEBUG("[CONNECTOR] Image requested, returning sample data...");
 
         // Return sample image data
         ImageData image_data;
         image_data.image_data = "SAMPLE_IMAGE_DATA_FROM_CONNECTOR";
         image_data.image_type = "JPEG";
 
-        std::cout << "[CONNECTOR] Returning image data (size: " << image_data.image_data.size() << " bytes)" << std::endl;
+        AGENT_LOG_DEBUG("[CONNECTOR] Returning image data (size: " << image_data.image_data.size() << " bytes)");
 
         return image_data;
     }
@@ -116,33 +206,36 @@ public:
     }
 
 private:
+    static constexpr size_t kMaxQueuedSegmentations = 32;
+
     std::unique_ptr<SegmentationProcessor> processor_;
     std::unique_ptr<ImageServiceAgent> agent_;
-    std::string current_image_id_;
-    std::string current_segmentation_type_;
+    std::unique_ptr<common::WorkerPool> workers_;
 };
 
 // Main VisionApp class that manages the entire application
 class VisionApp {
 public:
-    VisionApp() {
-        std::cout << "[VISION_APP] VisionApp initialized" << std::endl;
+    explicit VisionApp(const common::ServerConfig& server_config) : server_config_(server_config) {
+        AGENT_LOG_INFO("[VISION_APP] VisionApp initialized");
 
         // Create the connector as a shared_ptr first
         connector_ = std::make_shared<VisionConnector>();
 
         // Initialize the agent after the connector is created as shared_ptr
-        connector_->initializeAgent();
+        connector_->initializeAgent(server_config_);
 
-        std::cout << "[VISION_APP] VisionConnector created and agent is running" << std::endl;
+        AGENT_LOG_INFO("[VISION_APP] VisionConnector created and agent is running");
     }
 
     ~VisionApp() {
-        std::cout << "[VISION_APP] VisionApp shutting down..." << std::endl;
+        AGENT_LOG_INFO("[VISION_APP] VisionApp shutting down...");
 
-        // Clean up Unix socket
-        if (unlink("/tmp/image_service.sock") == 0) {
-            std::cout << "[VISION_APP] Unix socket cleaned up in destructor" << std::endl;
+        // Clean up Unix sockets
+        for (const auto& socket_path : g_socket_paths) {
+            if (unlink(socket_path.c_str()) == 0) {
+                AGENT_LOG_INFO("[VISION_APP] Unix socket cleaned up in destructor");
+            }
         }
     }
 
@@ -157,45 +250,143 @@ public:
     }
 
 private:
+    const common::ServerConfig server_config_;
     std::shared_ptr<VisionConnector> connector_;
 };
 
 
 
-void RunServer() {
-    std::cout << "[SERVER] Starting VisionApp..." << std::endl;
+void RunServer(const common::ServerConfig& server_config, const std::string& metrics_dump_path,
+               std::chrono::milliseconds metrics_interval, double status_rate) {
+    AGENT_LOG_INFO("[SERVER] Starting VisionApp...");
 
     // Create the VisionApp (which will create the connector and agent)
-    auto vision_app = std::make_unique<VisionApp>();
+    auto vision_app = std::make_unique<VisionApp>(server_config);
 
     if (!vision_app->isRunning()) {
         throw std::runtime_error("Failed to initialize VisionApp");
     }
 
-    std::cout << "[SERVER] VisionApp is running and ready to handle requests" << std::endl;
+    if (!metrics_dump_path.empty()) {
+        vision_app->getAgent()->enableMetricsDump(metrics_dump_path, metrics_interval);
+    }
 
-    // Keep the server running until shutdown is requested
+    AGENT_LOG_INFO("[SERVER] VisionApp is running and ready to handle requests");
+
+    // Publish a status heartbeat until shutdown is requested
+    auto started_at = std::chrono::steady_clock::now();
+    auto status_interval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(1.0 / status_rate));
+    auto next_status_at = started_at;
+    uint64_t heartbeat = 0;
     while (!g_shutdown_requested) {
-        std::this_thread::sleep_for(std::chrono::seconds(1));
+        Notification status;
+        status.message = "Server running";
+        status.metadata["heartbeat"] = std::to_string(++heartbeat);
+        status.metadata["uptime_ms"] = std::to_string(std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - started_at).count());
+        vision_app->getAgent()->publishNotification("status", status);
+
+        next_status_at += status_interval;
+        waitForShutdown(next_status_at);
     }
 
-    std::cout << "[SERVER] Shutting down..." << std::endl;
+    logShutdownSignal();
+    AGENT_LOG_INFO("[SERVER] Shutting down...");
 }
 
 int main(int argc, char** argv) {
-    std::cout << "Starting VisionApp with ImageServiceAgent..." << std::endl;
+    AGENT_LOG_INFO("Starting VisionApp with ImageServiceAgent...");
+
+    std::string metrics_dump_path;
+    std::chrono::milliseconds metrics_interval(10000);
+    double status_rate = 1.0; // Heartbeats per second on the "status" topic
+    common::ServerConfig server_config;
+    std::string config_error;
+    if (!common::loadServerConfig(argc, argv, "IMAGE_SERVER_", &server_config, &config_error)) {
+        AGENT_LOG_ERROR("[SERVER] " << config_error);
+        return 1;
+    }
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (common::isServerConfigFlag(arg)) {
+            ++i; // Read by loadServerConfig
+        } else if (arg == common::kWorkerIndexFlag && i + 1 < argc) {
+            server_config.worker_index = std::stoi(argv[++i]);
+        } else if (arg == "--help") {
+            std::cout << "Usage: " << argv[0] << " [options]\n"
+                      << "  --metrics-dump PATH              Write metrics as JSON periodically\n"
+                      << "  --metrics-interval MS            Metrics dump interval (default 10000)\n"
+                      << "  --status-rate HZ                 Heartbeats on the status topic (default 1)\n"
+                      << "  --log-level LEVEL                debug, info, warn, error or off\n"
+                      << common::serverConfigUsage()
+                      << "Settings may also come from IMAGE_SERVER_<SETTING> environment variables.\n";
+            return 0;
+        } else if (arg == "--metrics-dump" && i + 1 < argc) {
+            metrics_dump_path = argv[++i];
+        } else if (arg == "--metrics-interval" && i + 1 < argc) {
+            // Capped at a day so the dump thread's wait deadline cannot overflow
+            char* end = nullptr;
+            long long interval_ms = std::strtoll(argv[++i], &end, 10);
+            if (end == argv[i] || *end != '\0' || interval_ms <= 0 || interval_ms > kMaxMetricsIntervalMs) {
+                AGENT_LOG_ERROR("[SERVER] --metrics-interval must be between 1 and " << kMaxMetricsIntervalMs << " ms");
+                return 1;
+            }
+            metrics_interval = std::chrono::milliseconds(interval_ms);
+        } else if (arg == "--status-rate" && i + 1 < argc) {
+            char* end = nullptr;
+            status_rate = std::strtod(argv[++i], &end);
+            // Negated so NaN is refused too
+            if (end == argv[i] || *end != '\0' || !(status_rate >= kMinStatusRate && status_rate <= kMaxStatusRate)) {
+                AGENT_LOG_ERROR("[SERVER] --status-rate must be between " << kMinStatusRate << " and " << kMaxStatusRate
+                                << " Hz");
+                return 1;
+            }
+        } else if (arg == "--log-level" && i + 1 < argc) {
+            common::LogLevel level;
+            if (!common::parseLogLevel(argv[++i], &level)) {
+                AGENT_LOG_ERROR("[SERVER] Unknown log level " << argv[i] << " (expected debug, info, warn, error or off)");
+                return 1;
+            }
+            common::setLogLevel(level);
+        }
+    }
+
+    // Sharded mode: this process only supervises the workers, which serve
+    bool supervisor = server_config.workers > 0 && server_config.worker_index < 0;
+    if (server_config.worker_index >= 0) {
+        common::watchSupervisor();
+        if (!metrics_dump_path.empty()) {
+            metrics_dump_path += "." + std::to_string(server_config.worker_index);
+        }
+    }
+    for (const auto& address : common::listenAddresses(server_config, "unix:///tmp/image_service.sock")) {
+        std::string socket_path = common::unixSocketPath(address);
+        if (!supervisor && !socket_path.empty()) {
+            g_socket_paths.push_back(socket_path);
+        }
+    }
 
     // Set up signal handlers for graceful shutdown
+    createShutdownPipe();
     signal(SIGINT, signalHandler);
     signal(SIGTERM, signalHandler);
 
+    if (supervisor) {
+        AGENT_LOG_INFO("[SERVER] Supervising " << server_config.workers << " worker processes");
+        int result = common::runWorkerProcesses(argc, argv, static_cast<int>(server_config.workers),
+                                                g_shutdown_requested);
+        logShutdownSignal();
+        return result;
+    }
+
     try {
-        RunServer();
+        RunServer(server_config, metrics_dump_path, metrics_interval, status_rate);
     } catch (const std::exception& e) {
-        std::cerr << "[ERROR] Server failed: " << e.what() << std::endl;
+        AGENT_LOG_ERROR("[ERROR] Server failed: " << e.what());
         return 1;
     }
 
-    std::cout << "[SERVER] Server shutdown complete" << std::endl;
+    AGENT_LOG_INFO("[SERVER] Server shutdown complete");
     return 0;
 }
\ No newline at end of file
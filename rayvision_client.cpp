@@ -1,7 +1,20 @@
 #include "RayVision.grpc.pb.h"
+#include "ChannelPool.h"
+#include "Compression.h"
+#include "FrameCodec.h"
+#include "Metrics.h"
+#include "SharedFrameRing.h"
 #include <grpcpp/grpcpp.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
 #include <iostream>
+#include <map>
 #include <memory>
+#include <string>
+#include <thread>
+#include <vector>
 
 using grpc::Channel;
 using grpc::ClientContext;
@@ -11,39 +24,139 @@ using rayvisiongrpc::GetImageRequest;
 using rayvisiongrpc::ImageData;
 using rayvisiongrpc::SegmentationResult;
 using rayvisiongrpc::CameraType;
-using rayvisiongrpc::Empty;
+using rayvisiongrpc::SegmentationRequest;
 
 class RayVisionClient {
 public:
-    RayVisionClient(std::shared_ptr<Channel> channel)
-        : stub_(RayVisionGrpc::NewStub(channel)) {}
+    RayVisionClient(std::shared_ptr<common::ChannelPool> channels, bool use_shared_memory = false,
+                    grpc_compression_algorithm compression = GRPC_COMPRESS_NONE, bool frame_codec = false,
+                    const GetImageRequest& transform = GetImageRequest())
+        : stubs_(std::move(channels)), use_shared_memory_(use_shared_memory),
+          compression_(compression), frame_codec_(frame_codec), transform_(transform) {}
 
     void GetImage(int cameraType) {
-        GetImageRequest request;
+        GetImageRequest request(transform_);
         request.set_type(static_cast<CameraType>(cameraType));
+        request.set_use_shared_memory(use_shared_memory_);
+        if (frame_codec_) {
+            // The frame we still hold lets the server send only what changed
+            request.set_accept_frame_codec(true);
+            auto it = decoded_frames_.find(cameraType);
+            if (it != decoded_frames_.end()) {
+                request.set_reference_frame_id(it->second.frame_id);
+            }
+        }
 
         ImageData response;
         ClientContext context;
+        common::requestCompression(&context, compression_);
 
-        Status status = stub_->GetImage(&context, request, &response);
+        auto stub = stubs_.acquire();
+        Status status = stub->GetImage(&context, request, &response);
 
         if (status.ok()) {
             std::cout << "GetImage successful:" << std::endl;
             std::cout << "  Width: " << response.width() << std::endl;
             std::cout << "  Height: " << response.height() << std::endl;
             std::cout << "  Colorspace: " << response.colorspace() << std::endl;
-            std::cout << "  Buffer size: " << response.buffer().size() << " bytes" << std::endl;
+            if (response.has_shared_frame()) {
+                ReadSharedFrame(response.shared_frame());
+            } else if (response.frame_id()) {
+                DecodeFrame(cameraType, response);
+            } else {
+                std::cout << "  Buffer size: " << response.buffer().size() << " bytes" << std::endl;
+            }
         } else {
             std::cout << "GetImage failed: " << status.error_message() << std::endl;
         }
     }
 
-    void DoSegmentation() {
-        Empty request;
+    // Captures several cameras together and reports how far apart their frames are
+    void BatchGetImage(const std::vector<int>& cameraTypes) {
+        rayvisiongrpc::BatchGetImageRequest request;
+        for (int camera_type : cameraTypes) {
+            request.add_types(static_cast<CameraType>(camera_type));
+        }
+
+        rayvisiongrpc::BatchGetImageReply response;
         ClientContext context;
+        common::requestCompression(&context, compression_);
+        auto stub = stubs_.acquire();
+        Status status = stub->BatchGetImage(&context, request, &response);
+        if (!status.ok()) {
+            std::cout << "BatchGetImage failed: " << status.error_message() << std::endl;
+            return;
+        }
+
+        std::cout << "BatchGetImage successful: " << response.images_size() << " frames captured within "
+                  << response.capture_spread_us() << " us" << std::endl;
+        for (int i = 0; i < response.images_size(); ++i) {
+            const auto& image = response.images(i);
+            std::cout << "  Camera " << cameraTypes[i] << ": " << image.width() << "x" << image.height()
+                      << ", colorspace " << image.colorspace() << ", " << image.buffer().size()
+                      << " bytes, captured at " << image.capture_time_us() << " us" << std::endl;
+        }
+    }
 
+    // Streams a frame as a header plus chunks and reassembles it
+    void GetImageChunked(int cameraType, uint32_t chunk_size) {
+        rayvisiongrpc::GetImageChunkedRequest request;
+        request.set_type(static_cast<CameraType>(cameraType));
+        request.set_chunk_size(chunk_size);
+
+        ClientContext context;
+        common::requestCompression(&context, compression_);
+        auto stub = stubs_.acquire();
+        std::unique_ptr<grpc::ClientReader<rayvisiongrpc::ImageChunk>> reader(
+            stub->GetImageChunked(&context, request));
+
+        rayvisiongrpc::ImageChunk chunk;
+        rayvisiongrpc::ImageHeader header;
+        std::vector<std::byte> buffer;
+        bool have_header = false;
+        int chunks = 0;
+
+        while (reader->Read(&chunk)) {
+            if (chunk.has_header()) {
+                header = chunk.header();
+                buffer.reserve(header.total_size());
+                have_header = true;
+            } else if (have_header) {
+                const auto& data = chunk.data();
+                const auto* bytes = reinterpret_cast<const std::byte*>(data.data());
+                buffer.insert(buffer.end(), bytes, bytes + data.size());
+                chunks++;
+            }
+        }
+
+        Status status = reader->Finish();
+        if (!status.ok()) {
+            std::cout << "GetImageChunked failed: " << status.error_message() << std::endl;
+            return;
+        }
+        if (!have_header || buffer.size() != header.total_size()) {
+            std::cout << "GetImageChunked failed: received " << buffer.size() << " of "
+                      << header.total_size() << " bytes" << std::endl;
+            return;
+        }
+
+        std::cout << "GetImageChunked successful:" << std::endl;
+        std::cout << "  Width: " << header.width() << std::endl;
+        std::cout << "  Height: " << header.height() << std::endl;
+        std::cout << "  Colorspace: " << header.colorspace() << std::endl;
+        std::cout << "  Buffer size: " << buffer.size() << " bytes in " << chunks
+                  << " chunks of up to " << header.chunk_size() << " bytes" << std::endl;
+    }
+
+    void DoSegmentation(uint32_t max_results) {
+        SegmentationRequest request;
+        request.set_max_results(max_results);
+        ClientContext context;
+        common::requestCompression(&context, compression_);
+
+        auto stub = stubs_.acquire();
         std::unique_ptr<grpc::ClientReader<SegmentationResult>> reader(
-            stub_->doSegmentation(&context, request));
+            stub->doSegmentation(&context, request));
 
         SegmentationResult response;
         while (reader->Read(&response)) {
@@ -67,23 +180,254 @@ public:
         }
     }
 
+    // Receives frames pushed by the server and reports their pacing
+    void SubscribeFrames(int cameraType, int frames, float max_fps, rayvisiongrpc::FrameDropPolicy drop_policy) {
+        rayvisiongrpc::SubscribeFramesRequest request;
+        request.set_type(static_cast<CameraType>(cameraType));
+        request.set_max_fps(max_fps);
+        request.set_drop_policy(drop_policy);
+
+        ClientContext context;
+        common::requestCompression(&context, compression_);
+        auto stub = stubs_.acquire();
+        std::unique_ptr<grpc::ClientReader<ImageData>> reader(stub->SubscribeFrames(&context, request));
+
+        ImageData frame;
+        int received = 0;
+        auto previous = std::chrono::steady_clock::now();
+        while (received < frames && reader->Read(&frame)) {
+            auto now = std::chrono::steady_clock::now();
+            std::cout << "Frame " << ++received << ": " << frame.width() << "x" << frame.height() << ", "
+                      << frame.buffer().size() << " bytes, "
+                      << std::chrono::duration_cast<std::chrono::milliseconds>(now - previous).count()
+                      << " ms after the previous one" << std::endl;
+            previous = now;
+        }
+
+        // The stream only ends when the client cancels it
+        context.TryCancel();
+        Status status = reader->Finish();
+        if (received < frames) {
+            std::cout << "SubscribeFrames failed after " << received << " frames: " << status.error_message()
+                      << std::endl;
+        }
+    }
+
+    void PrintStats() {
+        rayvisiongrpc::StatsRequest request;
+        rayvisiongrpc::StatsReply reply;
+        ClientContext context;
+        common::requestCompression(&context, compression_);
+        auto stub = stubs_.acquire();
+        Status status = stub->GetStats(&context, request, &reply);
+        if (!status.ok()) {
+            std::cout << "GetStats failed: " << status.error_message() << std::endl;
+            return;
+        }
+        std::cout << common::formatStatsReply(reply);
+    }
+
 private:
-    std::unique_ptr<RayVisionGrpc::Stub> stub_;
+    // Last frame reconstructed from a camera: the reference for its next delta
+    struct DecodedFrame {
+        uint64_t frame_id = 0;
+        std::vector<std::byte> data;
+    };
+
+    // Reconstructs a frame codec reply and keeps it as the camera's reference
+    void DecodeFrame(int cameraType, const ImageData& response) {
+        DecodedFrame& previous = decoded_frames_[cameraType];
+        const std::string& encoded = response.buffer();
+        decode_buffer_.resize(response.raw_size());
+
+        bool ok = false;
+        switch (response.encoding()) {
+        case rayvisiongrpc::FRAME_RAW:
+            ok = encoded.size() == response.raw_size();
+            if (ok) {
+                std::memcpy(decode_buffer_.data(), encoded.data(), encoded.size());
+            }
+            break;
+        case rayvisiongrpc::FRAME_DEFLATE:
+            ok = common::decodeFrame(encoded.data(), encoded.size(), nullptr, decode_buffer_.data(),
+                                     decode_buffer_.size());
+            break;
+        case rayvisiongrpc::FRAME_XOR_DEFLATE:
+            ok = previous.frame_id == response.reference_frame_id() && previous.data.size() == response.raw_size() &&
+                 common::decodeFrame(encoded.data(), encoded.size(), previous.data.data(), decode_buffer_.data(),
+                                     decode_buffer_.size());
+            break;
+        default:
+            break;
+        }
+        if (!ok) {
+            // Ask for a key frame next time
+            decoded_frames_.erase(cameraType);
+            std::cout << "  Failed to decode frame " << response.frame_id() << " ("
+                      << rayvisiongrpc::FrameEncoding_Name(response.encoding()) << ")" << std::endl;
+            return;
+        }
+
+        previous.frame_id = response.frame_id();
+        previous.data.swap(decode_buffer_);
+        std::cout << "  Buffer size: " << previous.data.size() << " bytes (frame " << previous.frame_id << ", "
+                  << rayvisiongrpc::FrameEncoding_Name(response.encoding()) << ", " << encoded.size()
+                  << " bytes on the wire)" << std::endl;
+    }
+
+    // Reads a frame in place from the server's shared-memory ring
+    void ReadSharedFrame(const rayvisiongrpc::SharedFrameHandle& grpc_handle) {
+        if (!frame_reader_ || frame_reader_->channelPath() != grpc_handle.channel_path()) {
+            frame_reader_ = std::make_unique<common::SharedFrameReader>(grpc_handle.channel_path());
+        }
+        if (!frame_reader_->connect()) {
+            std::cout << "  Failed to map shared frame ring via " << grpc_handle.channel_path() << std::endl;
+            return;
+        }
+
+        common::SharedFrameHandle handle;
+        handle.slot = grpc_handle.slot();
+        handle.sequence = grpc_handle.sequence();
+        handle.offset = grpc_handle.offset();
+        handle.length = grpc_handle.length();
+
+        const std::byte* frame = frame_reader_->data(handle);
+        if (!frame) {
+            std::cout << "  Shared frame was overwritten before it could be read" << std::endl;
+            return;
+        }
+        std::string preview(reinterpret_cast<const char*>(frame), std::min<uint64_t>(handle.length, 32));
+        if (!frame_reader_->isCurrent(handle)) {
+            std::cout << "  Shared frame was overwritten while it was being read" << std::endl;
+            return;
+        }
+
+        std::cout << "  Shared memory: slot " << handle.slot << ", sequence " << handle.sequence
+                  << ", " << handle.length << " bytes" << std::endl;
+        std::cout << "  Content preview: " << preview << std::endl;
+    }
+
+    common::StubPool<RayVisionGrpc> stubs_; // Each call leases the stub of one pooled channel
+    bool use_shared_memory_;
+    grpc_compression_algorithm compression_; // Both directions of every call
+    bool frame_codec_;
+    GetImageRequest transform_; // Region, size and colorspace for every GetImage
+    std::map<int, DecodedFrame> decoded_frames_; // By camera type
+    std::vector<std::byte> decode_buffer_;
+    std::unique_ptr<common::SharedFrameReader> frame_reader_;
 };
 
-int main() {
+int main(int argc, char** argv) {
     std::string target_address("unix:///tmp/rayvision_service.sock");
-    auto channel = grpc::CreateChannel(target_address, grpc::InsecureChannelCredentials());
-    RayVisionClient client(channel);
+    bool use_shared_memory = false;
+    uint32_t chunk_size = 0; // Server default
+    uint32_t segmentation_results = 1;
+    bool print_stats = false;
+    grpc_compression_algorithm compression = GRPC_COMPRESS_NONE;
+    bool frame_codec = false;
+    int frames = 1;
+    int subscribe_frames = 0;
+    float max_fps = 0;
+    auto drop_policy = rayvisiongrpc::DROP_TO_LATEST;
+    GetImageRequest transform;
+    int channels = 1; // Connections to the server
+    auto channel_policy = common::ChannelPool::Policy::LeastOutstanding;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--target" && i + 1 < argc) {
+            target_address = argv[++i];
+        } else if (arg == "--shm") {
+            use_shared_memory = true;
+        } else if (arg == "--chunk-size" && i + 1 < argc) {
+            chunk_size = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (arg == "--results" && i + 1 < argc) {
+            segmentation_results = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (arg == "--stats") {
+            print_stats = true;
+        } else if (arg == "--compression" && i + 1 < argc) {
+            if (!common::parseCompression(argv[++i], &compression)) {
+                std::cout << "Unknown compression " << argv[i] << " (expected none, gzip or deflate)" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--frame-codec") {
+            frame_codec = true;
+        } else if (arg == "--subscribe" && i + 1 < argc) {
+            subscribe_frames = std::max(1, std::stoi(argv[++i]));
+        } else if (arg == "--max-fps" && i + 1 < argc) {
+            max_fps = std::stof(argv[++i]);
+        } else if (arg == "--drop-oldest") {
+            drop_policy = rayvisiongrpc::DROP_OLDEST;
+        } else if (arg == "--roi" && i + 1 < argc) {
+            auto* roi = transform.mutable_roi();
+            int x, y, width, height;
+            if (std::sscanf(argv[++i], "%d,%d,%d,%d", &x, &y, &width, &height) != 4) {
+                std::cout << "Expected --roi X,Y,WIDTH,HEIGHT" << std::endl;
+                return 1;
+            }
+            roi->set_x(x);
+            roi->set_y(y);
+            roi->set_width(width);
+            roi->set_height(height);
+        } else if (arg == "--size" && i + 1 < argc) {
+            int width = 0, height = 0;
+            if (std::sscanf(argv[++i], "%dx%d", &width, &height) < 1) {
+                std::cout << "Expected --size WIDTHxHEIGHT (or WIDTH to keep the aspect ratio)" << std::endl;
+                return 1;
+            }
+            transform.set_target_width(width);
+            transform.set_target_height(height);
+        } else if (arg == "--gray") {
+            transform.set_colorspace(rayvisiongrpc::GRAY);
+        } else if (arg == "--rgb") {
+            transform.set_colorspace(rayvisiongrpc::RGB);
+        } else if (arg == "--frames" && i + 1 < argc) {
+            frames = std::max(1, std::stoi(argv[++i]));
+        } else if (arg == "--channels" && i + 1 < argc) {
+            channels = std::max(1, std::stoi(argv[++i]));
+        } else if (arg == "--channel-policy" && i + 1 < argc) {
+            if (!common::parseChannelPolicy(argv[++i], &channel_policy)) {
+                std::cout << "Unknown channel policy " << argv[i] << " (expected round-robin or least-outstanding)"
+                          << std::endl;
+                return 1;
+            }
+        }
+    }
+
+    auto channel_pool = std::make_shared<common::ChannelPool>(target_address, channels, channel_policy);
+    RayVisionClient client(channel_pool, use_shared_memory, compression, frame_codec, transform);
+
+    if (print_stats) {
+        client.PrintStats();
+        return 0;
+    }
+
+    if (subscribe_frames) {
+        std::cout << "Subscribing to HEAD camera frames..." << std::endl;
+        client.SubscribeFrames(1, subscribe_frames, max_fps, drop_policy);
+        return 0;
+    }
 
     std::cout << "Testing GetImage for HEAD camera..." << std::endl;
     client.GetImage(1); // HEAD camera
+    for (int frame = 1; frame < frames; ++frame) {
+        // A camera period apart; with --frame-codec every frame after the first
+        // can go out as a delta
+        std::this_thread::sleep_for(std::chrono::milliseconds(40));
+        client.GetImage(1);
+    }
 
     std::cout << "\nTesting GetImage for BODY camera..." << std::endl;
     client.GetImage(2); // BODY camera
 
+    std::cout << "\nTesting BatchGetImage for HEAD and BODY cameras..." << std::endl;
+    client.BatchGetImage({1, 2});
+
+    std::cout << "\nTesting GetImageChunked for HEAD camera..." << std::endl;
+    client.GetImageChunked(1, chunk_size);
+
     std::cout << "\nTesting doSegmentation..." << std::endl;
-    client.DoSegmentation();
+    client.DoSegmentation(segmentation_results);
 
     return 0;
 }
\ No newline at end of file
@@ -1,31 +1,82 @@
 #include "RayVisionServiceAgent.h"
-#include <iostream>
+#include "Logger.h"
+#include "SharedFrameRing.h"
+#include "WorkerPool.h"
+#include "WorkerProcesses.h"
 #include <memory>
 #include <chrono>
 #include <thread>
 #include <signal.h>
 #include <unistd.h>
 #include <atomic>
+#include <cstdlib>
 #include <cstring>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
 
-// Global flag for graceful shutdown
+// Global flag for graceful shutdown, and the signal that requested it
 std::atomic<bool> g_shutdown_requested(false);
+std::atomic<int> g_shutdown_signal(0);
+
+// Socket files of the configured Unix listen addresses; set before the signal
+// handlers are installed
+std::vector<std::string> g_socket_paths;
 
-// Signal handler for graceful shutdown
+// Signal handler for graceful shutdown. Only async-signal-safe work here: the
+// logger takes locks and allocates, so main logs the shutdown once it wakes.
 void signalHandler(int signal) {
-    std::cout << "\n[SHUTDOWN] Received signal " << signal << ", shutting down gracefully..." << std::endl;
+    g_shutdown_signal = signal;
     g_shutdown_requested = true;
 
-    // Clean up Unix socket
-    if (unlink("/tmp/rayvision_service.sock") == 0) {
-        std::cout << "[SHUTDOWN] Unix socket cleaned up" << std::endl;
+    // Clean up Unix sockets
+    for (const auto& socket_path : g_socket_paths) {
+        unlink(socket_path.c_str());
+    }
+}
+
+void logShutdownSignal() {
+    if (int signal = g_shutdown_signal.load()) {
+        AGENT_LOG_INFO("[SHUTDOWN] Received signal " << signal << ", shutting down gracefully");
     }
 }
 
+// Sharded mode: the supervisor captures each camera once into a shared ring
+// and every worker serves those frames, instead of each running the cameras.
+// A ring entry is this header followed by the pixels.
+struct SharedFrameHeader {
+    int32_t camera_type;
+    int32_t width;
+    int32_t height;
+    int32_t colorspace;
+    int64_t capture_time_us;
+};
+
+constexpr char kDefaultFrameSourcePath[] = "/tmp/rayvision_frames.shm.sock";
+constexpr int kSharedCameraTypes[] = {0, 1, 2}; // HEAD and BODY, plus the cameras the frame streams publish
+constexpr uint32_t kSharedFrameSlots = 8;
+constexpr uint64_t kSharedFrameSlotSize = 1 << 20; // A 640x480 RGB scene frame and its header
+constexpr size_t kMaxQueuedSegmentations = 16;
+constexpr long long kMaxMetricsIntervalMs = 24LL * 60 * 60 * 1000;
+
 class RayVisionListener : public rayvision::RayVisionServiceAgent::IRayVisionServiceListener {
 public:
+    // With a frame source, frames come from the supervisor's shared ring
+    // instead of the simulated cameras
+    explicit RayVisionListener(bool render_scene = false,
+                               std::shared_ptr<common::SharedFrameReader> frame_source = nullptr)
+        : mRenderScene(render_scene), mFrameSource(std::move(frame_source)) {}
+
     rayvision::ImageData onGetImage(int cameraType) override {
-        std::cout << "[LISTENER] Getting image for camera type: " << cameraType << std::endl;
+        AGENT_LOG_DEBUG("[LISTENER] Getting image for camera type: " << cameraType);
+        if (mFrameSource) {
+            return readSharedFrame(cameraType, nullptr);
+        }
+        if (mRenderScene) {
+            return renderScene();
+        }
 
         // Simulate getting image data
         rayvision::ImageData image_data;
@@ -33,42 +84,300 @@ public:
         image_data.height = 1080;
         image_data.colorspace = 0; // RGB
 
-        // Create a simulated buffer with some data
+        // Create a simulated buffer with some data; pooled, so steady capture allocates nothing
         std::string buffer_str = "simulated_image_data_" + std::to_string(cameraType);
-        image_data.buffer.resize(buffer_str.size());
-        std::memcpy(image_data.buffer.data(), buffer_str.data(), buffer_str.size());
+        image_data.buffer = mFramePool.copyOf(buffer_str.data(), buffer_str.size());
 
         return image_data;
     }
 
     void onDoSegmentation() override {
-        std::cout << "[LISTENER] Performing segmentation" << std::endl;
+        AGENT_LOG_DEBUG("[LISTENER] Performing segmentation");
+
+        // Simulate the model off the gRPC thread and publish the result to all subscribers
+        bool queued = mSegmentationWorker.trySubmit([this]() {
+            std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+            // One pixel buffer for all masks, bounding boxes as parallel arrays
+            constexpr int kSegments = 3;
+            constexpr int kMaskSide = 64;
+            rayvision::FlatSegmentationResult result(mFramePool, kSegments, kSegments * kMaskSide * kMaskSide);
+            for (int i = 0; i < kSegments; ++i) {
+                int left = i * 100;
+                int top = i * 50;
+                std::byte* mask = result.addSegment(left, top, left + kMaskSide, top + kMaskSide,
+                                                    kMaskSide, kMaskSide, 1 /* GRAY mask */, kMaskSide * kMaskSide);
+                std::memset(mask, i + 1, kMaskSide * kMaskSide);
+            }
+
+            std::lock_guard<std::mutex> lock(mAgentMutex);
+            if (mAgent) {
+                mAgent->sendSegmentationResult(std::move(result));
+            }
+        });
+        if (!queued) {
+            AGENT_LOG_WARN("[LISTENER] Segmentation backlog full, request dropped");
+        }
+    }
+
+    // Simulated cameras: captures a frame of each camera someone subscribed to
+    // and pushes it to the SubscribeFrames streams
+    void publishFrames() {
+        std::lock_guard<std::mutex> lock(mAgentMutex);
+        if (!mAgent) {
+            return;
+        }
+        for (int camera_type : {1, 2}) {
+            if (!mAgent->hasFrameSubscribers(camera_type)) {
+                continue;
+            }
+            if (!mFrameSource) {
+                mAgent->publishFrame(camera_type, onGetImage(camera_type));
+                continue;
+            }
+            // The ring is polled faster than the cameras run; publish each frame once
+            uint64_t sequence = 0;
+            rayvision::ImageData frame = readSharedFrame(camera_type, &sequence);
+            if (frame.buffer && sequence != mPublishedSequences[camera_type]) {
+                mPublishedSequences[camera_type] = sequence;
+                mAgent->publishFrame(camera_type, std::move(frame));
+            }
+        }
+    }
+
+    // Supervisor side of sharded mode: captures a frame of cameraType into ring
+    void captureSharedFrame(int cameraType, common::SharedFrameRing* ring) {
+        rayvision::ImageData image_data = onGetImage(cameraType);
+        SharedFrameHeader header{cameraType, image_data.width, image_data.height, image_data.colorspace,
+                                 std::chrono::duration_cast<std::chrono::microseconds>(
+                                     std::chrono::system_clock::now().time_since_epoch()).count()};
+        size_t pixels = image_data.buffer ? image_data.buffer->size() : 0;
+        mStaging.resize(sizeof(header) + pixels);
+        std::memcpy(mStaging.data(), &header, sizeof(header));
+        if (pixels > 0) {
+            std::memcpy(mStaging.data() + sizeof(header), image_data.buffer->data(), pixels);
+        }
+        common::SharedFrameHandle handle;
+        if (!ring->write(mStaging.data(), mStaging.size(), &handle)) {
+            AGENT_LOG_WARN("[LISTENER] Camera " << cameraType << " frame of " << mStaging.size()
+                           << " bytes does not fit the shared ring");
+        }
+    }
+
+    void setAgent(rayvision::RayVisionServiceAgent* agent) {
+        std::lock_guard<std::mutex> lock(mAgentMutex);
+        mAgent = agent;
+    }
 
+private:
+    // Newest frame of cameraType in the shared ring, or an empty image if there
+    // is none yet. *sequence, if given, identifies the frame.
+    rayvision::ImageData readSharedFrame(int cameraType, uint64_t* sequence) {
+        common::SharedFrameHandle handle;
+        bool found = mFrameSource->latest(&handle);
+        for (uint32_t step = 0; found && step < kSharedFrameSlots; ++step) {
+            const std::byte* data = mFrameSource->data(handle);
+            SharedFrameHeader header;
+            if (data && handle.length >= sizeof(header)) {
+                std::memcpy(&header, data, sizeof(header));
+                if (header.camera_type == cameraType) {
+                    rayvision::ImageData image_data{header.width, header.height, header.colorspace,
+                                                    mFramePool.copyOf(data + sizeof(header),
+                                                                      handle.length - sizeof(header)),
+                                                    header.capture_time_us};
+                    if (mFrameSource->isCurrent(handle)) {
+                        if (sequence) {
+                            *sequence = handle.sequence;
+                        }
+                        return image_data;
+                    }
+                    // Overwritten while copying; a newer frame is in the ring by now
+                    found = mFrameSource->latest(&handle);
+                    continue;
+                }
+            }
+            found = mFrameSource->previous(handle, &handle);
+        }
+        return rayvision::ImageData{0, 0, 0, nullptr};
     }
+
+    // A mostly static RGB scene: a fixed gradient with one small square moving
+    // across it, the kind of input the frame codec is built for
+    rayvision::ImageData renderScene() {
+        constexpr int kWidth = 640;
+        constexpr int kHeight = 480;
+        constexpr int kObjectSide = 32;
+
+        rayvision::ImageData image_data;
+        image_data.width = kWidth;
+        image_data.height = kHeight;
+        image_data.colorspace = 0; // RGB
+        image_data.buffer = mFramePool.acquire(kWidth * kHeight * 3);
+
+        int object_left = static_cast<int>(mSceneTick++ * 4 % (kWidth - kObjectSide));
+        int object_top = kHeight / 2 - kObjectSide / 2;
+        std::byte* pixel = image_data.buffer->data();
+        for (int y = 0; y < kHeight; ++y) {
+            for (int x = 0; x < kWidth; ++x, pixel += 3) {
+                bool object = x >= object_left && x < object_left + kObjectSide && y >= object_top &&
+                              y < object_top + kObjectSide;
+                pixel[0] = static_cast<std::byte>(object ? 255 : x * 255 / kWidth);
+                pixel[1] = static_cast<std::byte>(object ? 255 : y * 255 / kHeight);
+                pixel[2] = static_cast<std::byte>(object ? 255 : 128);
+            }
+        }
+        return image_data;
+    }
+
+    const bool mRenderScene;
+    const std::shared_ptr<common::SharedFrameReader> mFrameSource;
+    std::map<int, uint64_t> mPublishedSequences; // Per camera; guarded by mAgentMutex
+    std::vector<std::byte> mStaging;             // Supervisor's frame being written to the ring
+    std::atomic<uint64_t> mSceneTick{0};
+    rayvision::FrameBufferPool mFramePool; // Frames and segment masks
+    std::mutex mAgentMutex;
+    rayvision::RayVisionServiceAgent* mAgent = nullptr;
+    // Runs the simulated model. Declared last so it is destroyed first: a job
+    // still running is joined while the members it uses are alive.
+    common::WorkerPool mSegmentationWorker{1, kMaxQueuedSegmentations};
 };
 
-int main() {
-    std::cout << "[MAIN] Starting RayVision Service" << std::endl;
+int main(int argc, char** argv) {
+    AGENT_LOG_INFO("[MAIN] Starting RayVision Service");
+
+    std::string metrics_dump_path;
+    std::chrono::milliseconds metrics_interval(10000);
+    bool render_scene = false;
+    std::string frame_source_path = kDefaultFrameSourcePath;
+    common::ServerConfig server_config;
+    std::string config_error;
+    if (!common::loadServerConfig(argc, argv, "RAYVISION_SERVER_", &server_config, &config_error)) {
+        AGENT_LOG_ERROR("[MAIN] " << config_error);
+        return 1;
+    }
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (common::isServerConfigFlag(arg)) {
+            ++i; // Read by loadServerConfig
+        } else if (arg == common::kWorkerIndexFlag && i + 1 < argc) {
+            server_config.worker_index = std::stoi(argv[++i]);
+        } else if (arg == "--help") {
+            std::cout << "Usage: " << argv[0] << " [options]\n"
+                      << "  --metrics-dump PATH              Write metrics as JSON periodically\n"
+                      << "  --metrics-interval MS            Metrics dump interval (default 10000)\n"
+                      << "  --scene                          Render a moving test scene\n"
+                      << "  --frame-source PATH              Side channel of the workers' shared frame ring\n"
+                      << "  --log-level LEVEL                debug, info, warn, error or off\n"
+                      << common::serverConfigUsage()
+                      << "Settings may also come from RAYVISION_SERVER_<SETTING> environment variables.\n";
+            return 0;
+        } else if (arg == "--metrics-dump" && i + 1 < argc) {
+            metrics_dump_path = argv[++i];
+        } else if (arg == "--metrics-interval" && i + 1 < argc) {
+            // Capped at a day so the dump thread's wait deadline cannot overflow
+            char* end = nullptr;
+            long long interval_ms = std::strtoll(argv[++i], &end, 10);
+            if (end == argv[i] || *end != '\0' || interval_ms <= 0 || interval_ms > kMaxMetricsIntervalMs) {
+                AGENT_LOG_ERROR("[MAIN] --metrics-interval must be between 1 and " << kMaxMetricsIntervalMs << " ms");
+                return 1;
+            }
+            metrics_interval = std::chrono::milliseconds(interval_ms);
+        } else if (arg == "--scene") {
+            render_scene = true;
+        } else if (arg == "--frame-source" && i + 1 < argc) {
+            frame_source_path = argv[++i];
+        } else if (arg == "--log-level" && i + 1 < argc) {
+            common::LogLevel level;
+            if (!common::parseLogLevel(argv[++i], &level)) {
+                AGENT_LOG_ERROR("[MAIN] Unknown log level " << argv[i] << " (expected debug, info, warn, error or off)");
+                return 1;
+            }
+            common::setLogLevel(level);
+        }
+    }
+
+    // Sharded mode: this process only supervises the workers, which serve
+    bool supervisor = server_config.workers > 0 && server_config.worker_index < 0;
+    if (server_config.worker_index >= 0) {
+        common::watchSupervisor();
+        if (!metrics_dump_path.empty()) {
+            metrics_dump_path += "." + std::to_string(server_config.worker_index);
+        }
+    }
+    for (const auto& address : common::listenAddresses(server_config, "unix:///tmp/rayvision_service.sock")) {
+        std::string socket_path = common::unixSocketPath(address);
+        if (!supervisor && !socket_path.empty()) {
+            g_socket_paths.push_back(socket_path);
+        }
+    }
 
     // Set up signal handlers for graceful shutdown
     signal(SIGINT, signalHandler);
     signal(SIGTERM, signalHandler);
 
-    auto listener = std::make_shared<RayVisionListener>();
-    rayvision::RayVisionServiceAgent agent(listener);
+    if (supervisor) {
+        // Run the cameras here, once, into the ring the workers read
+        common::SharedFrameRing frame_ring(frame_source_path, kSharedFrameSlots, kSharedFrameSlotSize);
+        if (!frame_ring.isValid()) {
+            return 1;
+        }
+        RayVisionListener camera(render_scene);
+        std::thread capture_thread([&camera, &frame_ring]() {
+            auto next_capture_at = std::chrono::steady_clock::now();
+            while (!g_shutdown_requested) {
+                for (int camera_type : kSharedCameraTypes) {
+                    camera.captureSharedFrame(camera_type, &frame_ring);
+                }
+                next_capture_at += std::chrono::milliseconds(33);
+                std::this_thread::sleep_until(next_capture_at);
+            }
+        });
+
+        AGENT_LOG_INFO("[MAIN] Supervising " << server_config.workers << " worker processes");
+        int result = common::runWorkerProcesses(argc, argv, static_cast<int>(server_config.workers),
+                                                g_shutdown_requested);
+        logShutdownSignal();
+        capture_thread.join();
+        return result;
+    }
+
+    // A worker serves the supervisor's frames; the ring exists before workers start
+    std::shared_ptr<common::SharedFrameReader> frame_source;
+    if (server_config.worker_index >= 0) {
+        frame_source = std::make_shared<common::SharedFrameReader>(frame_source_path);
+        if (!frame_source->connect()) {
+            AGENT_LOG_ERROR("[MAIN] Cannot connect to the frame source at " << frame_source_path);
+            return 1;
+        }
+    }
+
+    auto listener = std::make_shared<RayVisionListener>(render_scene, frame_source);
+    rayvision::RayVisionServiceAgent agent(listener, rayvision::SegmentationStreamOptions(),
+                                           std::chrono::milliseconds(33), server_config);
+    listener->setAgent(&agent);
+    if (!metrics_dump_path.empty()) {
+        agent.enableMetricsDump(metrics_dump_path, metrics_interval);
+    }
 
-    std::cout << "[MAIN] RayVision Service started. Press Ctrl+C to exit..." << std::endl;
+    AGENT_LOG_INFO("[MAIN] RayVision Service started. Press Ctrl+C to exit...");
 
-    // Keep the server running until shutdown is requested
+    // Capture at 30 Hz until shutdown is requested; a worker polls the shared
+    // ring more often so that published frames lag the capture only slightly
+    auto publish_interval = std::chrono::milliseconds(frame_source ? 5 : 33);
     while (!g_shutdown_requested) {
-        std::this_thread::sleep_for(std::chrono::seconds(1));
+        listener->publishFrames();
+        std::this_thread::sleep_for(publish_interval);
     }
 
-    std::cout << "[MAIN] Shutting down RayVision Service" << std::endl;
+    logShutdownSignal();
+    AGENT_LOG_INFO("[MAIN] Shutting down RayVision Service");
+    listener->setAgent(nullptr);
 
-    // Clean up Unix socket
-    if (unlink("/tmp/rayvision_service.sock") == 0) {
-        std::cout << "[MAIN] Unix socket cleaned up" << std::endl;
+    // Clean up Unix sockets
+    for (const auto& socket_path : g_socket_paths) {
+        if (unlink(socket_path.c_str()) == 0) {
+            AGENT_LOG_INFO("[MAIN] Unix socket cleaned up");
+        }
     }
 
     return 0;
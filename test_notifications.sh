@@ -26,7 +26,7 @@ start_notification_client() {
 
     # Start client in background and redirect output to log file
     (
-        echo "y" | timeout 30s ./build/image_client --name "$client_name" --test-notifications > "$log_file" 2>&1
+        echo "y" | timeout 30s ./build/image_client --name "$client_name" --test-notifications --topics "${topics// /,}" > "$log_file" 2>&1
     ) &
 
     echo "   Client started with PID: $!"
@@ -44,7 +44,7 @@ start_notification_client "system_monitor" "system status"
 sleep 2
 
 # Client 2: All notifications
-start_notification_client "all_notifications" "system status updates alerts"
+start_notification_client "all_notifications" "system status segmentation/# alerts"
 
 # Wait a bit
 sleep 2
@@ -56,7 +56,7 @@ start_notification_client "status_watcher" "status"
 sleep 2
 
 # Client 4: Custom topics
-start_notification_client "custom_watcher" "updates alerts"
+start_notification_client "custom_watcher" "segmentation/+/completed alerts"
 
 echo "⏳ Waiting for notifications to be received..."
 echo "   (Clients will run for 30 seconds)"
@@ -0,0 +1,64 @@
+#!/bin/bash
+
+echo "🧪 Testing Shared-Memory Frame Transport"
+echo "========================================"
+
+# Function to cleanup on exit
+cleanup() {
+    echo ""
+    echo "🧹 Cleaning up..."
+    if [ ! -z "$IMAGE_SERVER_PID" ]; then
+        kill $IMAGE_SERVER_PID 2>/dev/null
+        echo "   Killed image server process (PID: $IMAGE_SERVER_PID)"
+    fi
+    if [ ! -z "$RAYVISION_SERVER_PID" ]; then
+        kill $RAYVISION_SERVER_PID 2>/dev/null
+        echo "   Killed rayvision server process (PID: $RAYVISION_SERVER_PID)"
+    fi
+    rm -f server_output.log
+    echo "✅ Cleanup completed!"
+}
+
+# Set trap to cleanup on script exit
+trap cleanup EXIT
+
+echo "🚀 Starting ImageService server..."
+./build/image_server > server_output.log 2>&1 &
+IMAGE_SERVER_PID=$!
+
+echo "🚀 Starting RayVision server..."
+./build/rayvision_server >> server_output.log 2>&1 &
+RAYVISION_SERVER_PID=$!
+
+# Wait for servers to start
+echo "⏳ Waiting for servers to start..."
+sleep 3
+
+# The fd side channels are created next to the gRPC sockets
+for sock in /tmp/image_service.shm.sock /tmp/rayvision_service.shm.sock; do
+    if [ -S "$sock" ]; then
+        echo "✅ Frame ring channel exists: $sock"
+    else
+        echo "❌ Frame ring channel missing: $sock"
+        cat server_output.log
+        exit 1
+    fi
+done
+echo ""
+
+# Test 1: ImageService GetImage through the frame ring
+echo "🔍 Test 1: ImageService GetImage with --shm"
+./build/image_client --shm img001
+echo ""
+
+# Test 2: RayVision GetImage through the frame ring
+echo "🔍 Test 2: RayVision GetImage with --shm"
+timeout 5 ./build/rayvision_client --shm
+echo ""
+
+echo "📋 Server Output:"
+echo "=================="
+cat server_output.log
+
+echo ""
+echo "✅ Shared-memory transport test completed!"